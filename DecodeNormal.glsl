@@ -0,0 +1,11 @@
+// Shared by the vertex shaders, included after the declaration of the normal input and of the COMPACT_VERTEX specialization constant.
+
+// Returns the normal of the vertex, decoding it if it is octahedral encoded. The same decoding as _decodeOctahedral in vkQuantize.h.
+vec3 decodeNormal()
+{
+    if (COMPACT_VERTEX == 0) return normal;
+
+    vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
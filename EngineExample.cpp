@@ -11,9 +11,13 @@
 void EngineExample::drawFrame()
 {
     eng.startCurrentBuffer();
+    eng.logCullingStats();
 
     updateUniformBuffers(eng.appManager.frameId);
 
+    // The command buffer is recorded every frame, after the fence of the frame has been signalled.
+    eng.recordCommandBuffer();
+
     eng.presentCurrentBuffer();
 }
 
@@ -128,48 +132,13 @@ void EngineExample::updateUniformBuffers(int idx)
 
     mProjection.perspectiveFovRH(camera.yfov, aspectRatio, camera.znear, camera.zfar, isRotated);
 
-    // Set the tarnsformation matrix for each mesh
-    size_t minimumUboAlignment = static_cast<size_t>(eng.appManager.deviceProperties.limits.minUniformBufferOffsetAlignment);
-    uint32_t bufferDataSize = static_cast<uint32_t>(_getAlignedDataSize(sizeof(UBO), minimumUboAlignment));
-    uint32_t scene_offset = 0;
-
-    for (Mesh mesh : eng.appManager.meshes)
-    {
-         MATRIX mModel, mMVP;
-         mModel.scaling(mesh.transform.scale.x, mesh.transform.scale.y, mesh.transform.scale.z);
-         mModel.rotationQ(mesh.transform.rotation);
-         mModel.translation(mesh.transform.translation.x, mesh.transform.translation.y, mesh.transform.translation.z);
-         //mModel.rotationZ(eng.appManager.angle); // FOR TESTING
-
-         mMVP = mModel * mView * mProjection;
-
-         UBO ubo;
-         ubo.matrixMVP = mMVP;
-
-         // Transform the light using the inverse model matrix. This will
-         // allow to do smooth shading with just a dot product in the vertex shader
-         mModel.inverse();
-         VEC3 vOut, vIn = {lightDir.x, lightDir.y, lightDir.z};
-         vOut = mModel * vIn;
-         ubo.lightDirection.x =  vOut.x;
-         ubo.lightDirection.y =  vOut.y;
-         ubo.lightDirection.z =  vOut.z;
-
-         // Copy the matrix to the mapped memory using the offset calculated above.
-         memcpy(static_cast<unsigned char*>(eng.appManager.dynamicUniformBufferData.mappedData) + eng.appManager.dynamicUniformBufferData.bufferInfo.range * idx + scene_offset, &ubo, sizeof(UBO));
-         scene_offset += bufferDataSize;
-    }
-
-    VkMappedMemoryRange mapMemRange = {
-        VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
-        nullptr,
-        eng.appManager.dynamicUniformBufferData.memory,
-        eng.appManager.offset * idx,
-        eng.appManager.dynamicUniformBufferData.bufferInfo.range,
-    };
-
-    // ONLY flush the memory if it does not support VK_MEMORY_PROPERTY_HOST_COHERENT_BIT.
-    if ((eng.appManager.dynamicUniformBufferData.memPropFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) { vk::FlushMappedMemoryRanges(eng.appManager.device, 1, &mapMemRange); }
+    // Set the tarnsformation matrices.
+    // The view projection matrix goes to the per-frame uniform buffer. The model matrix of every mesh and the light transformed by its
+    // inverse (this allows to do smooth shading with just a dot product in the vertex shader) are cached, and only recomputed and
+    // copied to the per-object uniform buffer when the mesh or the light move. The memory is flushed if it is not host coherent.
+    MATRIX mViewProjection = mView * mProjection;
+    eng.setLodCamera(camera.from, camera.yfov);
+    eng.updateTransforms(mViewProjection, lightDir, idx);
 
     eng.appManager.angle += 0.02f;
 }
@@ -194,16 +163,29 @@ void EngineExample::initialize(const char* appName, const char* gltfFile)
     eng.initSwapChain();
     eng.initImagesAndViews();
     eng.initCommandPoolAndBuffer();
+    eng.initStagingBuffer();
+    eng.initWorkerThreads();
 
     eng.loadGLTF(gltfFile);
+    eng.initIndirectDraws();
+    eng.initTransforms();
     eng.initShaders(); // requires num meshes from gltf
     eng.initUniformBuffers();
 
     eng.initRenderPass();
     eng.initDescriptorPoolAndSet();
     eng.initFrameBuffers();
+    eng.initPipelineCache();
     eng.initPipeline();
+    eng.initCulling();
     eng.initViewportAndScissor();
     eng.initSemaphoreAndFence();
-    eng.recordCommandBuffer();
+    eng.initRecordingThreads();
+
+    eng.logMemoryStats();
+
+#if RUN_BENCHMARKS
+    eng.logMathTimings();
+    eng.logPushConstantTimings();
+#endif
 }
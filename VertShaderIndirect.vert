@@ -0,0 +1,61 @@
+#version 320 es
+#extension GL_GOOGLE_include_directive : require
+
+//// Vertex Shader inputs
+layout(location = 0) in highp vec3 vertex;
+layout(location = 1) in highp vec3 normal;
+layout(location = 2) in highp vec2 uv;
+
+//// Specialization constants ////
+// Distance between the per-object blocks, in vec4s. Matches the dynamic uniform buffer alignment.
+layout(constant_id = 0) const int OBJECT_STRIDE = 16;
+// 1 if the vertices are CompactVertex (see vkQuantize.h): the normal is octahedral encoded in xy.
+layout(constant_id = 1) const int COMPACT_VERTEX = 0;
+
+//// Shader Resources ////
+// The same data as the per-object uniform buffer of VertShader.vert, for all the objects.
+// Each block is a mat4 (modelMatrix), a vec3 (lightDirection), and two vec4 (positionOffset and positionScale).
+layout(std430, set = 1, binding = 0) readonly buffer PerObjectData
+{
+	vec4 objectData[];
+};
+
+// Per-frame data, shared by all the objects.
+layout(std140, set = 1, binding = 1) uniform FrameUniformBufferObject
+{
+	mat4 viewProjectionMatrix;
+};
+
+// Object of each instance: the objects of the nodes sharing a mesh, or the visible ones written by the culling.
+layout(std430, set = 1, binding = 2) readonly buffer InstanceData
+{
+	uint instanceObjects[];
+};
+
+//// Per Vertex Outputs ////
+layout(location = 0) out mediump vec2 UV_OUT;
+layout(location = 1) out highp float SHADE_OUT;
+
+#include "DecodeNormal.glsl"
+
+void main()
+{
+    vec3 light;
+
+	// The firstInstance of each indirect draw is where its instances start in the instance buffer.
+	int base = int(instanceObjects[gl_InstanceIndex]) * OBJECT_STRIDE;
+	mat4 modelMatrix = mat4(objectData[base], objectData[base + 1], objectData[base + 2], objectData[base + 3]);
+	vec3 lightDirection = objectData[base + 4].xyz;
+	vec4 positionOffset = objectData[base + 5];
+	vec4 positionScale = objectData[base + 6];
+
+    // The quantized position is moved back to object space (the identity for uncompressed vertices).
+    vec3 position = vertex * positionScale.xyz + positionOffset.xyz;
+    vec4 pos = vec4(position, 1.0);
+
+	// Calculate the ndc position for the current vertex using the model and view projection matrices.
+        gl_Position = viewProjectionMatrix * (modelMatrix * pos);
+        light = normalize(lightDirection-position);
+        SHADE_OUT = dot(decodeNormal(),light)*0.5+0.5;
+	UV_OUT = uv;
+}
@@ -0,0 +1,47 @@
+#version 320 es
+#extension GL_GOOGLE_include_directive : require
+
+//// Vertex Shader inputs
+layout(location = 0) in highp vec3 vertex;
+layout(location = 1) in highp vec3 normal;
+layout(location = 2) in highp vec2 uv;
+
+//// Specialization constants ////
+// 1 if the vertices are CompactVertex (see vkQuantize.h): the normal is octahedral encoded in xy.
+layout(constant_id = 1) const int COMPACT_VERTEX = 0;
+
+//// Shader Resources ////
+// Per-object data, sent with vkCmdPushConstants before each draw. The same layout as the UBO of VertShader.vert.
+layout(push_constant) uniform PushConstants
+{
+	mat4 modelMatrix;
+        vec3 lightDirection;
+        vec4 positionOffset; // Quantization of the positions of the object.
+        vec4 positionScale;
+};
+
+// Per-frame data, shared by all the objects.
+layout(std140, set = 1, binding = 1) uniform FrameUniformBufferObject
+{
+	mat4 viewProjectionMatrix;
+};
+
+//// Per Vertex Outputs ////
+layout(location = 0) out mediump vec2 UV_OUT;
+layout(location = 1) out highp float SHADE_OUT;
+
+#include "DecodeNormal.glsl"
+
+void main()
+{
+    vec3 light;
+    // The quantized position is moved back to object space (the identity for uncompressed vertices).
+    vec3 position = vertex * positionScale.xyz + positionOffset.xyz;
+    vec4 pos = vec4(position, 1.0);
+
+	// Calculate the ndc position for the current vertex using the model and view projection matrices.
+        gl_Position = viewProjectionMatrix * (modelMatrix * pos);
+        light = normalize(lightDirection-position);
+        SHADE_OUT = dot(decodeNormal(),light)*0.5+0.5;
+	UV_OUT = uv;
+}
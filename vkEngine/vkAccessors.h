@@ -0,0 +1,178 @@
+#ifndef VKACCESSORS_H
+#define VKACCESSORS_H
+
+#include <cstring>
+#include "vkStructs.h"
+#include "vkIndices.h"
+
+// Included by vkGLTF.h after tiny_gltf.h, which can only be included once because it defines its implementation.
+
+// Concept: Accessor Views
+// A glTF accessor describes an array inside a buffer: where it starts (the offset of its buffer view plus its own offset), the
+// distance between elements (the byteStride of the buffer view, or the element size when the array is packed), the type of
+// the components (float, or 8, 16 or 32-bit integers) and whether integers are normalized to [0, 1] or [-1, 1].
+// An AccessorView keeps those values and a pointer into the buffer, so the data is read where it is without copying it first.
+// When the attributes are already stored as Vertex (interleaved floats in the same order), the vertices are copied as one block.
+// Otherwise each attribute is converted into Vertex, four elements at a time with the FLOAT4 helpers.
+
+// A typed view of the elements of an accessor, inside the buffer that holds them.
+struct AccessorView
+{
+    const uint8_t* data; // First element.
+    size_t count;
+    size_t stride;       // Bytes from one element to the next.
+    int componentType;   // TINYGLTF_COMPONENT_TYPE_*
+    int components;      // Number of components of an element: 1 for SCALAR, 2 for VEC2, 3 for VEC3...
+    bool normalized;
+};
+
+/// <summary>Creates the view of an accessor. Returns false if the accessor does not exist or its elements are outside its buffer.</summary>
+inline bool _getAccessorView(const tinygltf::Model& model, int accessorIndex, AccessorView& view)
+{
+    if (accessorIndex < 0 || accessorIndex >= static_cast<int>(model.accessors.size())) return false;
+
+    const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+    if (accessor.bufferView < 0 || accessor.sparse.isSparse)
+    {
+        Log(true, "GLTF - accessor %d: sparse accessors and accessors without a buffer view are not supported", accessorIndex);
+        return false;
+    }
+
+    const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+    const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+
+    const int componentSize = tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(accessor.componentType));
+    const int components = tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type));
+    const int stride = accessor.ByteStride(bufferView);
+    if (componentSize <= 0 || components <= 0 || stride <= 0) return false;
+
+    view.data = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
+    view.count = accessor.count;
+    view.stride = static_cast<size_t>(stride);
+    view.componentType = accessor.componentType;
+    view.components = components;
+    view.normalized = accessor.normalized;
+
+    // The last element has to end inside the buffer.
+    const size_t begin = bufferView.byteOffset + accessor.byteOffset;
+    const size_t size = view.count == 0 ? 0 : view.stride * (view.count - 1) + static_cast<size_t>(componentSize * components);
+    if (begin > buffer.data.size() || size > buffer.data.size() - begin)
+    {
+        Log(true, "GLTF - accessor %d is outside its buffer", accessorIndex);
+        return false;
+    }
+    return true;
+}
+
+/// <summary>Returns a component as a float, without normalization</summary>
+inline float _readComponent(const uint8_t* data, int componentType)
+{
+    switch (componentType)
+    {
+    case TINYGLTF_COMPONENT_TYPE_BYTE:           return static_cast<float>(*reinterpret_cast<const int8_t*>(data));
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:  return static_cast<float>(*data);
+    case TINYGLTF_COMPONENT_TYPE_SHORT:          { int16_t value; memcpy(&value, data, 2); return static_cast<float>(value); }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: { uint16_t value; memcpy(&value, data, 2); return static_cast<float>(value); }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:   { uint32_t value; memcpy(&value, data, 4); return static_cast<float>(value); }
+    default:                                     { float value; memcpy(&value, data, 4); return value; }
+    }
+}
+
+/// <summary>Reads the first components of every element of a view as floats and writes them to out, with outStride bytes between elements</summary>
+/// <param name="components">Number of floats written per element. Missing components are written as 0.</param>
+inline void _readAccessorFloats(const AccessorView& view, int components, uint8_t* out, size_t outStride)
+{
+    const int copied = std::min(components, view.components);
+
+    if (view.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && copied == components)
+    {
+        // Floats only change their stride.
+        for (size_t i = 0; i < view.count; i++) memcpy(out + i * outStride, view.data + i * view.stride, sizeof(float) * components);
+        return;
+    }
+
+    // Normalized integers are mapped to [0, 1] (unsigned) or [-1, 1] (signed, where the smallest value is clamped to -1).
+    float scale = 1.0f;
+    if (view.normalized)
+    {
+        switch (view.componentType)
+        {
+        case TINYGLTF_COMPONENT_TYPE_BYTE:           scale = 1.0f / 127.0f; break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:  scale = 1.0f / 255.0f; break;
+        case TINYGLTF_COMPONENT_TYPE_SHORT:          scale = 1.0f / 32767.0f; break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: scale = 1.0f / 65535.0f; break;
+        default: break;
+        }
+    }
+    const FLOAT4 scale4 = f4Set(scale);
+    const FLOAT4 minimum4 = f4Set(view.normalized ? -1.0f : -FLT_MAX);
+    const size_t componentSize = static_cast<size_t>(tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(view.componentType)));
+
+    // Each component of four elements is converted with one multiply and one max.
+    for (size_t first = 0; first < view.count; first += 4)
+    {
+        const size_t elements = std::min<size_t>(4, view.count - first);
+
+        float values[4][4] = {}; // [component][element]
+        for (size_t e = 0; e < elements; e++)
+        {
+            const uint8_t* element = view.data + (first + e) * view.stride;
+            for (int c = 0; c < copied; c++) values[c][e] = _readComponent(element + c * componentSize, view.componentType);
+        }
+
+        for (int c = 0; c < copied; c++) f4Store(values[c], f4Max(f4Mul(f4Load(values[c]), scale4), minimum4));
+
+        for (size_t e = 0; e < elements; e++)
+        {
+            float* element = reinterpret_cast<float*>(out + (first + e) * outStride);
+            for (int c = 0; c < components; c++) element[c] = values[c][e];
+        }
+    }
+}
+
+/// <summary>Reads the indices of a view (8, 16 or 32-bit) and writes them to out as indexType</summary>
+/// <param name="vertexCount">Number of vertices of the primitive. indexType has to be able to address them.</param>
+/// <returns>False if an index is not a vertex of the primitive</returns>
+inline bool _readAccessorIndices(const AccessorView& view, VkIndexType indexType, uint32_t vertexCount, uint8_t* out)
+{
+    const size_t indexSize = _getIndexSize(indexType);
+    const size_t sourceSize = static_cast<size_t>(tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(view.componentType)));
+
+    bool valid = true;
+    if (sourceSize == indexSize && view.stride == indexSize)
+    {
+        // Same width and packed: one copy, then only the range is checked.
+        memcpy(out, view.data, indexSize * view.count);
+        for (size_t i = 0; i < view.count && valid; i++)
+        {
+            uint32_t index = 0;
+            memcpy(&index, out + i * indexSize, indexSize); // Little endian.
+            valid = index < vertexCount;
+        }
+        return valid;
+    }
+
+    for (size_t i = 0; i < view.count; i++)
+    {
+        uint32_t index = 0;
+        memcpy(&index, view.data + i * view.stride, sourceSize);
+        valid = valid && index < vertexCount;
+        memcpy(out + i * indexSize, &index, indexSize);
+    }
+    return valid;
+}
+
+/// <summary>Returns true if the attributes are interleaved floats with the layout of Vertex, so they can be copied as one block</summary>
+inline bool _isVertexLayout(const AccessorView& position, const AccessorView& normal, const AccessorView& texCoord)
+{
+    const AccessorView* views[] = { &position, &normal, &texCoord };
+    for (const AccessorView* view : views)
+    {
+        if (view->componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || view->stride != sizeof(Vertex) || view->count != position.count) return false;
+    }
+
+    return normal.data == position.data + offsetof(Vertex, nor) && texCoord.data == position.data + offsetof(Vertex, tex) &&
+           position.components == 3 && normal.components == 3 && texCoord.components == 2;
+}
+
+#endif // VKACCESSORS_H
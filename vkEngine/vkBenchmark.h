@@ -0,0 +1,135 @@
+#ifndef VKBENCHMARK_H
+#define VKBENCHMARK_H
+
+#include <chrono>
+#include "vkStructs.h"
+#include "vkShaders.h"
+#include "vkCommandBuffer.h"
+
+// Timings of the CPU kernels, printed with Log when the application is built with RUN_BENCHMARKS=1.
+// The results are accumulated in a volatile variable so the compiler cannot remove the loops.
+
+/// <summary>Returns the milliseconds elapsed since startTime</summary>
+inline double _elapsedMilliseconds(const std::chrono::high_resolution_clock::time_point& startTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+/// <summary>Compares the SIMD MATRIX kernels with their scalar reference implementations</summary>
+/// <param name="iterations">Number of times each kernel is run</param>
+inline void _logMathTimings(uint32_t iterations)
+{
+#if defined(VKMATH_AVX)
+    const char* simd = "AVX";
+#elif defined(VKMATH_SSE)
+    const char* simd = "SSE";
+#elif defined(VKMATH_NEON)
+    const char* simd = "NEON";
+#else
+    const char* simd = "none";
+#endif
+
+    // A typical model matrix and view projection matrix.
+    MATRIX mModel, mViewProjection;
+    QUATERNION rotation(0.18f, 0.36f, 0.0f, 0.915f);
+    mModel.scaling(2.0f, 2.0f, 2.0f);
+    mModel.rotationQ(rotation);
+    mModel.translation(1.0f, -3.0f, 5.0f);
+    mViewProjection.lookAtRH(VEC3(0.0f, -30.0f, 0.0f), VEC3(0.0f, 0.0f, 0.0f), VEC3(0.0f, 0.0f, 1.0f));
+    mViewProjection.perspectiveFovRH(0.4f, 1.5f, 0.01f, 5000.0f, false);
+
+    volatile float sink = 0.0f;
+    std::chrono::high_resolution_clock::time_point startTime;
+
+    startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) { MATRIX m = mModel; m.multiplyScalar(mViewProjection); sink = sink + m.f[i & 15]; }
+    double multiplyScalarTime = _elapsedMilliseconds(startTime);
+
+    startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) { MATRIX m = mModel; m.multiply(mViewProjection); sink = sink + m.f[i & 15]; }
+    double multiplyTime = _elapsedMilliseconds(startTime);
+
+    startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) { VEC3 v = mModel.vectorMultiplyScalar(VEC3(float(i), 1.0f, 2.0f)); sink = sink + v.x; }
+    double vectorScalarTime = _elapsedMilliseconds(startTime);
+
+    startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) { VEC3 v = mModel.vectorMultiply(VEC3(float(i), 1.0f, 2.0f)); sink = sink + v.x; }
+    double vectorTime = _elapsedMilliseconds(startTime);
+
+    startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) { MATRIX m = mModel; m.inverseScalar(); sink = sink + m.f[i & 15]; }
+    double inverseScalarTime = _elapsedMilliseconds(startTime);
+
+    startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) { MATRIX m = mModel; m.inverse(); sink = sink + m.f[i & 15]; }
+    double inverseTime = _elapsedMilliseconds(startTime);
+
+    startTime = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) { MATRIX m = mModel; m.inverseTRS(); sink = sink + m.f[i & 15]; }
+    double inverseTRSTime = _elapsedMilliseconds(startTime);
+
+    Log(false, "Math timings (%u iterations, SIMD: %s)", iterations, simd);
+    Log(false, "  multiply:       scalar %.3f ms, SIMD %.3f ms", multiplyScalarTime, multiplyTime);
+    Log(false, "  vectorMultiply: scalar %.3f ms, SIMD %.3f ms", vectorScalarTime, vectorTime);
+    Log(false, "  inverse:        scalar %.3f ms, SIMD %.3f ms, inverseTRS %.3f ms", inverseScalarTime, inverseTime, inverseTRSTime);
+}
+
+/// <summary>Compares recording the direct draws with dynamic uniform buffer offsets and with push constants, and the memory each path uses</summary>
+/// <param name="iterations">Number of times the draws of all the meshes are recorded with each path</param>
+inline void _logPushConstantTimings(AppManager& appManager, uint32_t iterations)
+{
+    if (appManager.pushPipeline == VK_NULL_HANDLE || appManager.meshes.empty()) return;
+
+    // The secondary command buffer of the first thread of frame 0 is borrowed before the first frame is recorded.
+    VkCommandPool commandPool = appManager.threadCommandPools[0];
+    VkCommandBuffer cmdBuffer = appManager.secondaryCmdBuffers[0];
+    const uint32_t meshCount = static_cast<uint32_t>(appManager.meshes.size());
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = appManager.renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = appManager.frameBuffers[0];
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    // The command buffers are only recorded, never submitted, so the draws are recorded even if the uploads are still running.
+    const uint32_t residentSerial = appManager.staging.residentSerial;
+    appManager.staging.residentSerial = 0xFFFFFFFF;
+
+    double recordingTime[2];
+    for (int path = 0; path < 2; path++)
+    {
+        std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            vk::ResetCommandPool(appManager.device, commandPool, 0);
+            vk::BeginCommandBuffer(cmdBuffer, &beginInfo);
+            if (path == 0) _recordDynamicUniformDraws(appManager, cmdBuffer, 0, 0, meshCount);
+            else _recordPushConstantDraws(appManager, cmdBuffer, 0, 0, meshCount);
+            vk::EndCommandBuffer(cmdBuffer);
+        }
+        recordingTime[path] = _elapsedMilliseconds(startTime);
+    }
+    vk::ResetCommandPool(appManager.device, commandPool, 0);
+    appManager.staging.residentSerial = residentSerial;
+
+    // The dynamic uniform buffer pads every object to the offset alignment and needs a copy per frame in flight.
+    // Push constants are recorded in the command buffer, with no padding.
+    uint32_t stride = _getUniformDataStride(appManager);
+    const uint32_t objectCount = static_cast<uint32_t>(appManager.objectTransforms.size());
+    // The meshes with several instances are drawn instanced by both paths, only the others are timed.
+    uint32_t singleMeshes = 0;
+    for (const Mesh& mesh : appManager.meshes) singleMeshes += mesh.instanceCount == 1 ? 1 : 0;
+    Log(false, "Per-draw data (%u single instance meshes, %u iterations)", singleMeshes, iterations);
+    Log(false, "  dynamic uniform buffer: %.3f ms, %u bytes per object (%u padding), %u bytes with %u frames in flight",
+        recordingTime[0], stride, stride - (uint32_t)sizeof(UBO), stride * objectCount * MAX_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT);
+    Log(false, "  push constants:         %.3f ms, %u bytes per draw in the command buffer",
+        recordingTime[1], (uint32_t)sizeof(UBO));
+}
+
+#endif // VKBENCHMARK_H
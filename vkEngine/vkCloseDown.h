@@ -2,6 +2,11 @@
 #define VKCLOSEDOWN_H
 
 #include "vkStructs.h"
+#include "vkMemory.h"
+#include "vkStaging.h"
+#include "vkCulling.h"
+#include "vkCommandBuffer.h"
+#include "vkPipelineCache.h"
 
 inline void _closeDown(AppManager& appManager)
 {
@@ -25,19 +30,34 @@ inline void _closeDown(AppManager& appManager)
     for(int i=0; i<appManager.textures.size(); i++)
         vk::FreeDescriptorSets(appManager.device, appManager.descriptorPool, 1, &appManager.staticDescSet[i]);
     vk::FreeDescriptorSets(appManager.device, appManager.descriptorPool, 1, &appManager.dynamicDescSet);
+    if (appManager.useIndirectPipeline) vk::FreeDescriptorSets(appManager.device, appManager.descriptorPool, 1, &appManager.indirectDescSet);
 
     // Destroy both the descriptor layouts and descriptor pool.
     vk::DestroyDescriptorSetLayout(appManager.device, appManager.staticDescriptorSetLayout, nullptr);
     vk::DestroyDescriptorSetLayout(appManager.device, appManager.dynamicDescriptorSetLayout, nullptr);
+    if (appManager.useIndirectPipeline) vk::DestroyDescriptorSetLayout(appManager.device, appManager.indirectDescriptorSetLayout, nullptr);
     vk::DestroyDescriptorPool(appManager.device, appManager.descriptorPool, nullptr);
 
-    // Destroy the uniform buffer and free the memory.
-    vk::DestroyBuffer(appManager.device, appManager.dynamicUniformBufferData.buffer, nullptr);
-    vk::FreeMemory(appManager.device, appManager.dynamicUniformBufferData.memory, nullptr);
+    // Destroy the culling pass, its descriptor pool and buffers.
+    _destroyCulling(appManager);
+
+    // Destroy the uniform buffers and free the memory.
+    _destroyBuffer(appManager, appManager.dynamicUniformBufferData);
+    _destroyBuffer(appManager, appManager.frameUniformBufferData);
 
     // Destroy the pipeline followed by the pipeline layout.
     vk::DestroyPipeline(appManager.device, appManager.pipeline, nullptr);
     vk::DestroyPipelineLayout(appManager.device, appManager.pipelineLayout, nullptr);
+    if (appManager.pushPipeline != VK_NULL_HANDLE)
+    {
+        vk::DestroyPipeline(appManager.device, appManager.pushPipeline, nullptr);
+        vk::DestroyPipelineLayout(appManager.device, appManager.pushPipelineLayout, nullptr);
+    }
+    if (appManager.useIndirectPipeline)
+    {
+        vk::DestroyPipeline(appManager.device, appManager.indirectPipeline, nullptr);
+        vk::DestroyPipelineLayout(appManager.device, appManager.indirectPipelineLayout, nullptr);
+    }
 
     for(auto &texture : appManager.textures)
     {
@@ -48,27 +68,26 @@ inline void _closeDown(AppManager& appManager)
         vk::DestroyImageView(appManager.device, texture.view, nullptr);
 
         // Free the memory allocated for the texture.
-        vk::FreeMemory(appManager.device, texture.memory, nullptr);
+        _freeMemory(appManager, texture.memory);
 
         // Destroy the sampler.
         vk::DestroySampler(appManager.device, texture.sampler, nullptr);
     }
 
-    // Destroy then free the memory for the vertex buffer.
-    for (Mesh m : appManager.meshes)
-    {
-        vk::DestroyBuffer(appManager.device, m.vertexBuffer.buffer, nullptr);
-        vk::FreeMemory(appManager.device, m.vertexBuffer.memory, nullptr);
-        vk::DestroyBuffer(appManager.device, m.indexBuffer.buffer, nullptr);
-        vk::FreeMemory(appManager.device, m.indexBuffer.memory, nullptr);
-    }
+    // Destroy the staging ring used for the uploads.
+    _destroyStagingBuffer(appManager);
+
+    // Destroy then free the memory for the vertex and index buffers shared by all the meshes.
+    _destroyBuffer(appManager, appManager.vertexBuffer);
+    _destroyBuffer(appManager, appManager.indexBuffer);
+    _destroyBuffer(appManager, appManager.indirectBuffer);
+    _destroyBuffer(appManager, appManager.instanceBuffer);
 
     // Iterate through each of the framebuffers and destroy them.
     for (uint32_t i = 0; i < appManager.frameBuffers.size(); i++) { vk::DestroyFramebuffer(appManager.device, appManager.frameBuffers[i], nullptr); }
 
-    // Destroy the two shader modules - vertex and fragment.
-    vk::DestroyShaderModule(appManager.device, appManager.shaderStages[0].module, nullptr);
-    vk::DestroyShaderModule(appManager.device, appManager.shaderStages[1].module, nullptr);
+    // Destroy the shader modules.
+    for (uint32_t i = 0; i < NUM_SHADER_STAGES; i++) { vk::DestroyShaderModule(appManager.device, appManager.shaderStages[i].module, nullptr); }
 
     // Destroy the render pass.
     vk::DestroyRenderPass(appManager.device, appManager.renderPass, nullptr);
@@ -76,8 +95,15 @@ inline void _closeDown(AppManager& appManager)
     // Clean up the swapchain image views.
     for (auto& imagebuffers : appManager.swapChainImages) { vk::DestroyImageView(appManager.device, imagebuffers.view, nullptr); vk::DestroyImageView(appManager.device, imagebuffers.depth_view, nullptr);}
 
-    // Free the depth buffer memory
-    //vk::FreeMemory(appManager.device, appManager.depth_memory, nullptr);
+    // Destroy the depth buffers and free their memory.
+    for (auto& imagebuffers : appManager.swapChainImages)
+    {
+        vk::DestroyImage(appManager.device, imagebuffers.depth_image, nullptr);
+        _freeMemory(appManager, imagebuffers.depth_memory);
+    }
+
+    // Stop the recording threads and destroy their command pools.
+    _destroyRecordingThreads(appManager);
 
     // Free the allocated memory in the command buffers.
     vk::FreeCommandBuffers(appManager.device, appManager.commandPool, static_cast<uint32_t>(appManager.cmdBuffers.size()), appManager.cmdBuffers.data());
@@ -91,6 +117,12 @@ inline void _closeDown(AppManager& appManager)
     // Clean up the surface.
     vk::DestroySurfaceKHR(appManager.instance, appManager.surface, nullptr);
 
+    // Save the compiled pipelines for the next run.
+    _savePipelineCache(appManager);
+
+    // All the resources are gone, release the memory pages.
+    _destroyAllocator(appManager);
+
     // Destroy the logical device.
     vk::DestroyDevice(appManager.device, nullptr);
 }
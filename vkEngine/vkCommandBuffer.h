@@ -1,14 +1,21 @@
 #ifndef VKCOMMANDBUFFER_H
 #define VKCOMMANDBUFFER_H
 
+#include <chrono>
 #include "vkStructs.h"
-
-/// <summary>Creates a command pool and then allocates out of it a number of command buffers equal to the number of swapchain images</summary>
+#include "vkThreads.h"
+#include "vkShaders.h"
+#include "vkIndices.h"
+#include "vkIndirect.h"
+#include "vkCulling.h"
+#include "vkLod.h"
+
+/// <summary>Creates a command pool and then allocates out of it a number of command buffers equal to the number of frames in flight</summary>
 inline void _initCommandPoolAndBuffer(AppManager& appManager)
 {
     // This function creates a command pool to reserve memory for the command buffers are created to execute commands.
-    // After the command pool is created, command buffers are allocated from it. A number of command buffers equal to
-    // the number of images in the swapchain are needed, assuming the command buffers are used for rendering.
+    // After the command pool is created, command buffers are allocated from it. One command buffer is needed per frame in flight,
+    // the CPU records one while the GPU still executes the others.
 
     // Populate a command pool info struct with the queue family that will be used and the intended usage behaviour of command buffers
     // that can be allocated out of it.
@@ -21,8 +28,8 @@ inline void _initCommandPoolAndBuffer(AppManager& appManager)
     // Create the actual command pool.
     debugAssertFunctionResult(vk::CreateCommandPool(appManager.device, &commandPoolInfo, nullptr, &appManager.commandPool), "Command Pool Creation");
 
-    // Resize the vector to have a number of elements equal to the number of swapchain images.
-    appManager.cmdBuffers.resize(appManager.swapChainImages.size());
+    // Resize the vector to have a number of elements equal to the number of frames in flight.
+    appManager.cmdBuffers.resize(MAX_FRAMES_IN_FLIGHT);
 
     // Populate a command buffer info struct with a reference to the command pool from which the memory for the command buffer is taken.
     // Notice the "level" parameter which ensures these will be primary command buffers.
@@ -37,15 +44,305 @@ inline void _initCommandPoolAndBuffer(AppManager& appManager)
     debugAssertFunctionResult(vk::AllocateCommandBuffers(appManager.device, &commandBufferAllocateInfo, appManager.cmdBuffers.data()), "Command Buffer Creation");
 }
 
-/// <summary>Records rendering commands to the command buffers</summary>
-inline void _recordCommandBuffer(AppManager& appManager)
+/// <summary>Creates a command pool and a secondary command buffer per worker thread and frame in flight</summary>
+inline void _initRecordingThreads(AppManager& appManager)
+{
+    // Concept: Secondary Command Buffers
+    // A secondary command buffer cannot be submitted to a queue, it is executed from a primary command buffer with vkCmdExecuteCommands.
+    // Secondaries that draw inside a render pass inherit it (VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT), so the draws of a frame
+    // can be split in several secondaries recorded at the same time by different threads.
+    // Command pools are not thread safe, each thread records from its own pool. There is also a set of pools per frame in flight, so
+    // a pool can be reset (which recycles the memory of all its command buffers at once) while the other frames are still executing.
+    // The worker threads themselves are started before the scene is loaded (see _initWorkerThreads).
+
+    const uint32_t threadCount = appManager.workers.threadCount;
+    const size_t poolCount = MAX_FRAMES_IN_FLIGHT * threadCount;
+
+    appManager.threadCommandPools.resize(poolCount);
+    appManager.secondaryCmdBuffers.resize(poolCount);
+
+    for (size_t i = 0; i < poolCount; i++)
+    {
+        // The command buffers are re-recorded every frame, TRANSIENT lets the driver optimise the pool for it.
+        VkCommandPoolCreateInfo commandPoolInfo = {};
+        commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        commandPoolInfo.pNext = nullptr;
+        commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        commandPoolInfo.queueFamilyIndex = appManager.graphicsQueueFamilyIndex;
+
+        debugAssertFunctionResult(vk::CreateCommandPool(appManager.device, &commandPoolInfo, nullptr, &appManager.threadCommandPools[i]), "Thread Command Pool Creation");
+
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocateInfo.pNext = nullptr;
+        commandBufferAllocateInfo.commandPool = appManager.threadCommandPools[i];
+        commandBufferAllocateInfo.commandBufferCount = 1;
+        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+        debugAssertFunctionResult(vk::AllocateCommandBuffers(appManager.device, &commandBufferAllocateInfo, &appManager.secondaryCmdBuffers[i]), "Secondary Command Buffer Creation");
+    }
+
+    appManager.recordingTime = 0.0;
+    appManager.recordedFrames = 0;
+}
+
+/// <summary>Records the direct draws of a range of meshes, selecting the per-object data with a dynamic uniform buffer offset</summary>
+/// <param name="cmdBuffer">Command buffer to record to, inside the render pass</param>
+/// <param name="frameIndex">Frame in flight being recorded, selects the uniform buffer slice</param>
+inline void _recordDynamicUniformDraws(AppManager& appManager, VkCommandBuffer cmdBuffer, uint32_t frameIndex, uint32_t firstMesh, uint32_t meshCount)
+{
+    // Bind the pipeline to the command buffer.
+    vk::CmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.pipeline);
+
+    uint32_t bufferDataSize = _getUniformDataStride(appManager);
+
+    uint32_t boundTexture = 0xFFFFFFFF;
+    VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    for (uint32_t m = firstMesh; m < firstMesh + meshCount; m++)
+    {
+        const Mesh& mesh = appManager.meshes[m];
+
+        // The meshes wait for their texture to be uploaded. The meshes with several instances are drawn by _recordInstancedDraws.
+        if (!_isTextureResident(appManager, mesh.textureID)) continue;
+        if (mesh.instanceCount > 1) continue;
+
+        // The section of the index buffer and the texture set are only bound when they change. The meshes are sorted by both.
+        if (mesh.indexType != boundIndexType)
+        {
+            _bindIndexBuffer(appManager, cmdBuffer, mesh.indexType);
+            boundIndexType = mesh.indexType;
+        }
+        if (mesh.textureID != boundTexture)
+        {
+            vk::CmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.pipelineLayout, 0, 1, &appManager.staticDescSet[mesh.textureID], 0, nullptr);
+            boundTexture = mesh.textureID;
+        }
+
+        // The meshes left have a single instance: its object is the first of the mesh.
+        const uint32_t object = mesh.objectIndex;
+
+        // Offsets are used to select each slice of the uniform buffer objects that contain the transformation
+        // matrices related to each frame in flight.
+        // Calculate the offsets into the per-object and the per-frame uniform buffer objects for the current slice.
+        uint32_t offsets[2] = {
+            static_cast<uint32_t>(appManager.dynamicUniformBufferData.bufferInfo.range * frameIndex + bufferDataSize * object),
+            static_cast<uint32_t>(appManager.frameUniformBufferData.bufferInfo.range * frameIndex),
+        };
+
+        // Bind the dynamic descriptor set. The offsets parameter has the offsets into the dynamic uniform buffers which are
+        // contained within the dynamic descriptor set, in binding order.
+        vk::CmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.pipelineLayout, 1, 1, &appManager.dynamicDescSet, 2, offsets);
+
+        // Draw the mesh range of the shared buffers, at the level of detail for its distance to the camera.
+        const MeshLod& lod = mesh.lods[_selectMeshLod(appManager.lodCamera, mesh, appManager.transforms.uniformCache[object].matrixModel)];
+        vk::CmdDrawIndexed(cmdBuffer, lod.indexCount, 1, lod.firstIndex, mesh.vertexOffset, 0);
+    }
+}
+
+/// <summary>Records the direct draws of a range of meshes, sending the per-object data of each one as push constants</summary>
+/// <param name="cmdBuffer">Command buffer to record to, inside the render pass</param>
+/// <param name="frameIndex">Frame in flight being recorded, selects the per-frame uniform buffer slice</param>
+inline void _recordPushConstantDraws(AppManager& appManager, VkCommandBuffer cmdBuffer, uint32_t frameIndex, uint32_t firstMesh, uint32_t meshCount)
+{
+    vk::CmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.pushPipeline);
+
+    // The shader only reads the per-frame uniform buffer of set 1, so the set is bound once. The per-object binding is not used
+    // but, being dynamic, it still takes an offset.
+    uint32_t offsets[2] = { 0, static_cast<uint32_t>(appManager.frameUniformBufferData.bufferInfo.range * frameIndex) };
+    vk::CmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.pushPipelineLayout, 1, 1, &appManager.dynamicDescSet, 2, offsets);
+
+    uint32_t boundTexture = 0xFFFFFFFF;
+    VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    for (uint32_t m = firstMesh; m < firstMesh + meshCount; m++)
+    {
+        const Mesh& mesh = appManager.meshes[m];
+        if (!_isTextureResident(appManager, mesh.textureID)) continue;
+        if (mesh.instanceCount > 1) continue;
+
+        // The texture set and the section of the index buffer are only bound when they change.
+        if (mesh.indexType != boundIndexType)
+        {
+            _bindIndexBuffer(appManager, cmdBuffer, mesh.indexType);
+            boundIndexType = mesh.indexType;
+        }
+
+        if (mesh.textureID != boundTexture)
+        {
+            vk::CmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.pushPipelineLayout, 0, 1, &appManager.staticDescSet[mesh.textureID], 0, nullptr);
+            boundTexture = mesh.textureID;
+        }
+
+        // The cached model matrix and light of the single instance go straight into the command buffer, before its draw.
+        const uint32_t object = mesh.objectIndex;
+        vk::CmdPushConstants(cmdBuffer, appManager.pushPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(UBO), &appManager.transforms.uniformCache[object]);
+
+        const MeshLod& lod = mesh.lods[_selectMeshLod(appManager.lodCamera, mesh, appManager.transforms.uniformCache[object].matrixModel)];
+        vk::CmdDrawIndexed(cmdBuffer, lod.indexCount, 1, lod.firstIndex, mesh.vertexOffset, 0);
+    }
+}
+
+/// <summary>Records the direct draws of the meshes with several instances, one vkCmdDrawIndexed with all the instances per mesh</summary>
+/// <param name="cmdBuffer">Command buffer to record to, inside the render pass</param>
+/// <param name="frameIndex">Frame in flight being recorded, selects the per-object data slice</param>
+inline void _recordInstancedDraws(AppManager& appManager, VkCommandBuffer cmdBuffer, uint32_t frameIndex, uint32_t firstMesh, uint32_t meshCount)
+{
+    if (!appManager.useIndirectPipeline) return;
+
+    // The indirect pipeline reads the per-object data of gl_InstanceIndex from the storage buffer, through the instance buffer, which
+    // holds every object at its own index when there is no culling.
+    const uint32_t dynamicOffsets[3] = {
+        static_cast<uint32_t>(appManager.dynamicUniformBufferData.bufferInfo.range * frameIndex),
+        static_cast<uint32_t>(appManager.frameUniformBufferData.bufferInfo.range * frameIndex),
+        0,
+    };
+
+    bool bound = false;
+    uint32_t boundTexture = 0xFFFFFFFF;
+    VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    for (uint32_t m = firstMesh; m < firstMesh + meshCount; m++)
+    {
+        const Mesh& mesh = appManager.meshes[m];
+        if (mesh.instanceCount <= 1) continue;
+        if (!_isTextureResident(appManager, mesh.textureID)) continue;
+
+        if (!bound)
+        {
+            vk::CmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.indirectPipeline);
+            vk::CmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.indirectPipelineLayout, 1, 1, &appManager.indirectDescSet, 3, dynamicOffsets);
+            bound = true;
+        }
+        if (mesh.indexType != boundIndexType)
+        {
+            _bindIndexBuffer(appManager, cmdBuffer, mesh.indexType);
+            boundIndexType = mesh.indexType;
+        }
+        if (mesh.textureID != boundTexture)
+        {
+            vk::CmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.indirectPipelineLayout, 0, 1, &appManager.staticDescSet[mesh.textureID], 0, nullptr);
+            boundTexture = mesh.textureID;
+        }
+
+        // All the instances share one level of detail: the finest one any of them needs.
+        uint32_t lodIndex = mesh.lodCount - 1;
+        for (uint32_t object = mesh.objectIndex; object < mesh.objectIndex + mesh.instanceCount; object++)
+        {
+            lodIndex = std::min(lodIndex, _selectMeshLod(appManager.lodCamera, mesh, appManager.transforms.uniformCache[object].matrixModel));
+        }
+
+        const MeshLod& lod = mesh.lods[lodIndex];
+        vk::CmdDrawIndexed(cmdBuffer, lod.indexCount, mesh.instanceCount, lod.firstIndex, mesh.vertexOffset, mesh.objectIndex);
+    }
+}
+
+/// <summary>Records the direct draws of a range of meshes, one vkCmdDrawIndexed per mesh</summary>
+/// <param name="cmdBuffer">Command buffer to record to, inside the render pass</param>
+/// <param name="frameIndex">Frame in flight being recorded, selects the uniform buffer slices</param>
+inline void _recordDirectDraws(AppManager& appManager, VkCommandBuffer cmdBuffer, uint32_t frameIndex, uint32_t firstMesh, uint32_t meshCount)
+{
+    if (appManager.usePushConstants) _recordPushConstantDraws(appManager, cmdBuffer, frameIndex, firstMesh, meshCount);
+    else _recordDynamicUniformDraws(appManager, cmdBuffer, frameIndex, firstMesh, meshCount);
+
+    _recordInstancedDraws(appManager, cmdBuffer, frameIndex, firstMesh, meshCount);
+}
+
+/// <summary>Records the draws of one thread in a secondary command buffer that continues the render pass</summary>
+/// <param name="frameIndex">Frame in flight being recorded</param>
+/// <param name="imageIndex">Swapchain image the frame renders to</param>
+/// <param name="threadIndex">Thread recording, selects the command pool</param>
+/// <returns>False if the thread had nothing to draw</returns>
+inline bool _recordSecondaryCommandBuffer(AppManager& appManager, uint32_t frameIndex, uint32_t imageIndex, uint32_t threadIndex)
+{
+    const uint32_t threadCount = appManager.workers.threadCount;
+    const uint32_t poolIndex = frameIndex * threadCount + threadIndex;
+
+    // Resetting the pool recycles the commands recorded the last time this frame was drawn.
+    // The fence of the frame has been waited on, so the GPU is not using them anymore.
+    debugAssertFunctionResult(vk::ResetCommandPool(appManager.device, appManager.threadCommandPools[poolIndex], 0), "Thread Command Pool Reset");
+
+    // Split the work evenly: texture groups for indirect drawing, meshes otherwise.
+    uint32_t itemCount = static_cast<uint32_t>(appManager.useIndirectDraw ? appManager.drawGroups.size() : appManager.meshes.size());
+    uint32_t first = itemCount * threadIndex / threadCount;
+    uint32_t last = itemCount * (threadIndex + 1) / threadCount;
+    if (first == last) return false;
+
+    VkCommandBuffer cmdBuffer = appManager.secondaryCmdBuffers[poolIndex];
+
+    // The secondary command buffer is executed inside the render pass, in the first subpass, of the image framebuffer.
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.pNext = nullptr;
+    inheritanceInfo.renderPass = appManager.renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = appManager.frameBuffers[imageIndex];
+    inheritanceInfo.occlusionQueryEnable = VK_FALSE;
+    inheritanceInfo.queryFlags = 0;
+    inheritanceInfo.pipelineStatistics = 0;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.pNext = nullptr;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    debugAssertFunctionResult(vk::BeginCommandBuffer(cmdBuffer, &beginInfo), "Secondary Command Buffer Recording Started.");
+
+    // The state is not inherited from the primary command buffer, so the viewport, scissor and buffers are set again.
+    vk::CmdSetViewport(cmdBuffer, 0, 1, &appManager.viewport);
+    vk::CmdSetScissor(cmdBuffer, 0, 1, &appManager.scissor);
+
+    // All the meshes share the same vertex buffer, so it is bound once. The index buffer is bound by the draws, at the section
+    // of the index type of each mesh.
+    const VkDeviceSize vertexOffsets[1] = { 0 };
+    vk::CmdBindVertexBuffers(cmdBuffer, 0, 1, &appManager.vertexBuffer.buffer, vertexOffsets);
+
+    if (appManager.useIndirectDraw)
+    {
+        // All the draws come from the indirect buffer.
+        _recordIndirectDraws(appManager, cmdBuffer, frameIndex, first, last - first);
+    }
+    else
+    {
+        _recordDirectDraws(appManager, cmdBuffer, frameIndex, first, last - first);
+    }
+
+    debugAssertFunctionResult(vk::EndCommandBuffer(cmdBuffer), "Secondary Command Buffer Recording Ended.");
+    return true;
+}
+
+/// <summary>Records the rendering commands of a frame. Called every frame, after the fence of the frame is signalled.</summary>
+/// <param name="frameIndex">Frame in flight to record the command buffer of</param>
+/// <param name="imageIndex">Swapchain image the frame renders to</param>
+inline void _recordCommandBuffer(AppManager& appManager, uint32_t frameIndex, uint32_t imageIndex)
 {
     // Concept: Command Buffers
     // Command buffers are containers that contain GPU commands. They are passed to the queues to be executed on the device.
     // Each command buffer when executed performs a different task. For instance, the command buffer required to render an object is
     // recorded before the rendering. When the rendering stage of the application is reached, the command buffer is submitted to execute its tasks.
 
-    // This function will record a set of commands in the command buffers which will render a basic triangle on screen.
+    // This function records the command buffer of one frame. The draws are recorded in parallel in secondary command buffers,
+    // one per thread, and the primary command buffer clears the screen, runs the culling and executes the secondaries.
+    // Recording every frame lets the draws change from frame to frame (meshes added or removed, levels of detail...).
+    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+    const uint32_t threadCount = appManager.workers.threadCount;
+    std::vector<uint8_t> recorded(threadCount, 0);
+
+    // While the shared buffers are uploading the frame only clears the screen: they cannot be used until the frame that acquires
+    // them (see vkStaging.h). The draws of the meshes whose texture is still uploading are skipped.
+    const bool uploadsResident = _isUploadResident(appManager, appManager.staging.bufferSerial);
+
+    if (uploadsResident)
+    {
+        _runOnWorkerThreads(appManager, [&appManager, &recorded, frameIndex, imageIndex](uint32_t threadIndex) {
+            recorded[threadIndex] = _recordSecondaryCommandBuffer(appManager, frameIndex, imageIndex, threadIndex) ? 1 : 0;
+        });
+    }
+
+    std::vector<VkCommandBuffer> secondaryCmdBuffers;
+    for (uint32_t t = 0; t < threadCount; t++)
+    {
+        if (recorded[t]) secondaryCmdBuffers.push_back(appManager.secondaryCmdBuffers[frameIndex * threadCount + t]);
+    }
 
     // State the clear values for rendering.
     // This is the colour value that the framebuffer is cleared to at the start of the render pass.
@@ -57,91 +354,70 @@ inline void _recordCommandBuffer(AppManager& appManager)
 
     VkClearValue clearValues[] = { clearColor, depthClear };
 
-    // This is a constant offset which specifies where the vertex data starts in the vertex
-    // buffer. In this case the data just starts at the beginning of the buffer.
-    const VkDeviceSize vertexOffsets[1] = { 0 };
-
-    // Iterate through each created command buffer to record to it.
-    for (size_t i = 0; i < appManager.cmdBuffers.size(); ++i)
+    VkCommandBuffer cmdBuffer = appManager.cmdBuffers[frameIndex];
+
+    // Reset the buffer to its initial state.
+    debugAssertFunctionResult(vk::ResetCommandBuffer(cmdBuffer, 0), "Command Buffer Reset");
+
+    // Begin the command buffer.
+    VkCommandBufferBeginInfo cmd_begin_info = {};
+    cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_begin_info.pNext = nullptr;
+    cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    cmd_begin_info.pInheritanceInfo = nullptr;
+
+    debugAssertFunctionResult(vk::BeginCommandBuffer(cmdBuffer, &cmd_begin_info), "Command Buffer Recording Started.");
+
+    // The culling compute pass writes the indirect draws of this frame. Dispatches are not allowed inside a render pass.
+    if (appManager.useGpuCulling && uploadsResident) _recordCulling(appManager, cmdBuffer, frameIndex);
+
+    // Begin the render pass.
+    // The render pass and framebuffer instances are passed here, along with the clear colour value and the extents of
+    // the rendering area. VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS means that the subpass commands are recorded in
+    // secondary command buffers and executed here with vkCmdExecuteCommands.
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.pNext = nullptr;
+    renderPassInfo.renderPass = appManager.renderPass;
+    renderPassInfo.framebuffer = appManager.frameBuffers[imageIndex];
+    renderPassInfo.clearValueCount = 2;
+    renderPassInfo.pClearValues = clearValues;
+    renderPassInfo.renderArea.extent = appManager.swapchainExtent;
+    renderPassInfo.renderArea.offset.x = 0;
+    renderPassInfo.renderArea.offset.y = 0;
+
+    vk::CmdBeginRenderPass(cmdBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    if (!secondaryCmdBuffers.empty())
     {
-        // Reset the buffer to its initial state.
-        debugAssertFunctionResult(vk::ResetCommandBuffer(appManager.cmdBuffers[i], 0), "Command Buffer Reset");
-
-        // Begin the command buffer.
-        VkCommandBufferBeginInfo cmd_begin_info = {};
-        cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        cmd_begin_info.pNext = nullptr;
-        cmd_begin_info.flags = 0;
-        cmd_begin_info.pInheritanceInfo = nullptr;
-
-        debugAssertFunctionResult(vk::BeginCommandBuffer(appManager.cmdBuffers[i], &cmd_begin_info), "Command Buffer Recording Started.");
-
-        // Start recording commands.
-        // In Vulkan, commands are recorded by calling vkCmd... functions.
-        // Set the viewport and scissor to previously defined values.
-        vk::CmdSetViewport(appManager.cmdBuffers[i], 0, 1, &appManager.viewport);
-
-        vk::CmdSetScissor(appManager.cmdBuffers[i], 0, 1, &appManager.scissor);
-
-        // Begin the render pass.
-        // The render pass and framebuffer instances are passed here, along with the clear colour value and the extents of
-        // the rendering area. VK_SUBPASS_CONTENTS_INLINE means that the subpass commands will be recorded here. The alternative is to
-        // record them in isolation in a secondary command buffer and then record them here with vkCmdExecuteCommands.
-        VkRenderPassBeginInfo renderPassInfo = {};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.pNext = nullptr;
-        renderPassInfo.renderPass = appManager.renderPass;
-        renderPassInfo.framebuffer = appManager.frameBuffers[i];
-        renderPassInfo.clearValueCount = 2;
-        renderPassInfo.pClearValues = clearValues;
-        renderPassInfo.renderArea.extent = appManager.swapchainExtent;
-        renderPassInfo.renderArea.offset.x = 0;
-        renderPassInfo.renderArea.offset.y = 0;
-
-        vk::CmdBeginRenderPass(appManager.cmdBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        // Bind the pipeline to the command buffer.
-        vk::CmdBindPipeline(appManager.cmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.pipeline);
-
-        size_t minimumUboAlignment = static_cast<size_t>(appManager.deviceProperties.limits.minUniformBufferOffsetAlignment);
-        uint32_t bufferDataSize = static_cast<uint32_t>(_getAlignedDataSize(sizeof(UBO), minimumUboAlignment));
-
-        uint32_t scene_offset = 0;
-        for(Mesh m : appManager.meshes)
-        {
-            // An offset is used to select each slice of the uniform buffer object that contains the transformation
-            // matrix related to each swapchain image.
-            // Calculate the offset into the uniform buffer object for the current slice.
-            uint32_t offset = static_cast<uint32_t>(appManager.dynamicUniformBufferData.bufferInfo.range * i + scene_offset);
-
-            // Bind the descriptor sets. The &offset parameter is the offset into the dynamic uniform buffer which is
-            // contained within the dynamic descriptor set.
-            const VkDescriptorSet descriptorSet[] = { appManager.staticDescSet[m.textureID], appManager.dynamicDescSet };
-            vk::CmdBindDescriptorSets(appManager.cmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.pipelineLayout, 0, 2, descriptorSet, 1, &offset);
-
-            vk::CmdBindVertexBuffers(appManager.cmdBuffers[i], 0, 1, &m.vertexBuffer.buffer, vertexOffsets);
-
-            // Bind the index buffer.
-            vk::CmdBindIndexBuffer(appManager.cmdBuffers[i], m.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-
-            // Draw the vertices.
-            vk::CmdDrawIndexed(appManager.cmdBuffers[i], m.vertexCount, 1, 0, 0, 0);
-
-            scene_offset += bufferDataSize;
-        }
+        vk::CmdExecuteCommands(cmdBuffer, static_cast<uint32_t>(secondaryCmdBuffers.size()), secondaryCmdBuffers.data());
+    }
 
-        // End the render pass.
-        vk::CmdEndRenderPass(appManager.cmdBuffers[i]);
+    // End the render pass.
+    vk::CmdEndRenderPass(cmdBuffer);
 
-        // End the command buffer recording process.
-        debugAssertFunctionResult(vk::EndCommandBuffer(appManager.cmdBuffers[i]), "Command Buffer Recording Ended.");
+    // End the command buffer recording process.
+    debugAssertFunctionResult(vk::EndCommandBuffer(cmdBuffer), "Command Buffer Recording Ended.");
 
-        // At this point the command buffer is ready to be submitted to a queue with all of the recorded operations executed
-        // asynchronously after that. A command buffer can, and if possible should, be executed multiple times, unless
-        // it is allocated with the VK_COMMAND_BUFFER_ONE_TIME_USE bit.
-        // The command buffers recorded here will be reused across the lifetime of the application.
+    // Print the average recording time every few hundred frames.
+    appManager.recordingTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    if (++appManager.recordedFrames == 500)
+    {
+        Log(false, "Recording: %.3f ms per frame with %u threads", appManager.recordingTime / appManager.recordedFrames, threadCount);
+        appManager.recordingTime = 0.0;
+        appManager.recordedFrames = 0;
     }
 }
 
+/// <summary>Stops the recording threads and destroys their command pools</summary>
+inline void _destroyRecordingThreads(AppManager& appManager)
+{
+    _destroyWorkerThreads(appManager);
+
+    // Destroying a pool frees its command buffers.
+    for (VkCommandPool pool : appManager.threadCommandPools) { vk::DestroyCommandPool(appManager.device, pool, nullptr); }
+    appManager.threadCommandPools.clear();
+    appManager.secondaryCmdBuffers.clear();
+}
 
 #endif // VKCOMMANDBUFFER_H
@@ -0,0 +1,316 @@
+#ifndef VKCULLING_H
+#define VKCULLING_H
+
+#include <algorithm>
+#include <cstring>
+#include "vkStructs.h"
+#include "vkMemory.h"
+#include "vkStaging.h"
+#include "vkShaders.h"
+#include "vkIndirect.h"
+
+// Concept: GPU Culling
+// Meshes outside of the view frustum still cost vertex processing, so they should not be drawn at all. As the draws already come
+// from an indirect buffer, a compute shader can decide which of them survive: it tests the bounding sphere of each mesh against the
+// frustum and writes the visible draws into a second indirect buffer, counting them with an atomic counter per draw group.
+// With VK_KHR_draw_indirect_count the draw call reads that counter, so the GPU only processes the visible draws. Without it the
+// culled draws are kept in place with an instance count of 0.
+// The frustum planes are extracted from the model-view-projection matrix of each object (the one written by updateUniformBuffers),
+// which gives them in object space and avoids transforming the bounding spheres.
+// A draw covers all the instances of its mesh (see vkIndirect.h), and each instance is tested on its own: the objects of the
+// visible ones are packed into the range of the draw in the instance buffer, and the draw is changed to draw only them.
+// The same pass selects the level of detail of each instance (see vkLod.h). Each level of a mesh is a draw of its own, which only
+// keeps the instances at that level.
+// The large meshes are drawn at full detail by their meshlets, one draw each (see vkMeshlets.h). A meshlet is tested against the
+// frustum with its sphere, and against the camera with its normal cone to drop the meshlets that only have back faces. The cone test
+// is made in world space and skipped for the objects with a non-uniform scale, which does not keep the angles of the normals.
+
+/// <summary>Creates the buffers, descriptor sets and compute pipeline of the culling pass</summary>
+inline void _initCulling(AppManager& appManager)
+{
+    GpuCulling& culling = appManager.culling;
+
+    appManager.useGpuCulling = _canUseGpuCulling(appManager);
+
+    if (!appManager.useGpuCulling)
+    {
+        Log(false, "Culling: disabled, all the meshes are drawn");
+        return;
+    }
+
+    const uint32_t drawCount = static_cast<uint32_t>(appManager.drawCommands.size());
+    const uint32_t groupCount = static_cast<uint32_t>(appManager.drawGroups.size());
+    const uint32_t frameCount = MAX_FRAMES_IN_FLIGHT;
+    const size_t storageAlignment = static_cast<size_t>(appManager.deviceProperties.limits.minStorageBufferOffsetAlignment);
+
+    // Packing the visible draws is only useful if the draw call can read how many there are.
+    culling.compact = appManager.supportsDrawIndirectCount;
+
+    // Static input: the bounding sphere of each draw, where its group starts and where its instances go. The ranges of the draws in
+    // the instance buffer follow each other, in the order of the draws (see _initIndirectDraws).
+    std::vector<CullData> cullData(drawCount);
+    uint32_t instanceBase = 0;
+    for (uint32_t g = 0; g < groupCount; g++)
+    {
+        const DrawGroup& group = appManager.drawGroups[g];
+        for (uint32_t i = group.firstDraw; i < group.firstDraw + group.drawCount; i++)
+        {
+            const Mesh& mesh = appManager.meshes[appManager.drawMeshes[i]];
+            cullData[i].sphere[0] = mesh.boundsCenter.x;
+            cullData[i].sphere[1] = mesh.boundsCenter.y;
+            cullData[i].sphere[2] = mesh.boundsCenter.z;
+            cullData[i].sphere[3] = mesh.boundsRadius;
+            cullData[i].group = g;
+            cullData[i].groupFirstDraw = group.firstDraw;
+            cullData[i].lodCount = mesh.lodCount;
+            cullData[i].drawLod = appManager.drawLods[i];
+            cullData[i].drawKind = DRAW_KIND_MESH;
+            cullData[i].instanceCount = appManager.drawCommands[i].instanceCount;
+            cullData[i].instanceBase = instanceBase;
+            cullData[i].padding = 0;
+            instanceBase += appManager.drawCommands[i].instanceCount;
+            for (uint32_t l = 0; l < MAX_MESH_LODS; l++)
+            {
+                // The unused levels repeat the last one.
+                cullData[i].lodError[l] = mesh.lods[std::min(l, mesh.lodCount - 1)].error;
+            }
+
+            memset(cullData[i].meshletSphere, 0, sizeof(cullData[i].meshletSphere));
+            memset(cullData[i].meshletCone, 0, sizeof(cullData[i].meshletCone));
+            if (appManager.drawMeshlets[i] != NO_MESHLET)
+            {
+                const Meshlet& meshlet = appManager.meshlets[appManager.drawMeshlets[i]];
+                cullData[i].drawKind = DRAW_KIND_MESHLET;
+                cullData[i].meshletSphere[0] = meshlet.center.x;
+                cullData[i].meshletSphere[1] = meshlet.center.y;
+                cullData[i].meshletSphere[2] = meshlet.center.z;
+                cullData[i].meshletSphere[3] = meshlet.radius;
+                cullData[i].meshletCone[0] = meshlet.coneAxis.x;
+                cullData[i].meshletCone[1] = meshlet.coneAxis.y;
+                cullData[i].meshletCone[2] = meshlet.coneAxis.z;
+                cullData[i].meshletCone[3] = meshlet.coneCutoff;
+            }
+        }
+    }
+
+    culling.cullDataBuffer.size = sizeof(CullData) * cullData.size();
+    _createDeviceLocalBuffer(appManager, culling.cullDataBuffer, reinterpret_cast<uint8_t*>(cullData.data()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    _flushStagingBuffer(appManager);
+
+    // The output draws are only accessed by the GPU.
+    culling.drawSliceSize = _getAlignedDataSize(sizeof(VkDrawIndexedIndirectCommand) * drawCount, storageAlignment);
+    culling.drawBuffer.size = static_cast<size_t>(culling.drawSliceSize * frameCount);
+    _createBuffer(appManager, culling.drawBuffer, nullptr, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    // The counters are cleared on the GPU every frame and read back by the CPU after the frame fence.
+    // They start as 0xFFFFFFFF so the readback knows which slices have not been written yet.
+    culling.countSliceSize = _getAlignedDataSize(sizeof(uint32_t) * groupCount, storageAlignment);
+    culling.countBuffer.size = static_cast<size_t>(culling.countSliceSize * frameCount);
+    _createBuffer(appManager, culling.countBuffer, nullptr, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    memset(culling.countBuffer.mappedData, 0xFF, culling.countBuffer.size);
+
+    // One descriptor set per frame in flight, each pointing to the slices of that frame.
+    VkDescriptorPoolSize descriptorPoolSize;
+    descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorPoolSize.descriptorCount = 7 * frameCount;
+
+    VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
+    descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolInfo.pNext = nullptr;
+    descriptorPoolInfo.flags = 0;
+    descriptorPoolInfo.poolSizeCount = 1;
+    descriptorPoolInfo.pPoolSizes = &descriptorPoolSize;
+    descriptorPoolInfo.maxSets = frameCount;
+
+    debugAssertFunctionResult(vk::CreateDescriptorPool(appManager.device, &descriptorPoolInfo, nullptr, &culling.descriptorPool), "Culling Descriptor Pool Creation");
+
+    // Bindings: 0 per-object data, 1 input draws, 2 cull data, 3 output draws, 4 counters, 5 per-frame data, 6 instances.
+    VkDescriptorSetLayoutBinding layoutBindings[7];
+    for (uint32_t b = 0; b < 7; b++)
+    {
+        layoutBindings[b].binding = b;
+        layoutBindings[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[b].descriptorCount = 1;
+        layoutBindings[b].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        layoutBindings[b].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorLayoutInfo = {};
+    descriptorLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorLayoutInfo.pNext = nullptr;
+    descriptorLayoutInfo.flags = 0;
+    descriptorLayoutInfo.bindingCount = 7;
+    descriptorLayoutInfo.pBindings = layoutBindings;
+
+    debugAssertFunctionResult(vk::CreateDescriptorSetLayout(appManager.device, &descriptorLayoutInfo, nullptr, &culling.descriptorSetLayout), "Culling Descriptor Set Layout Creation");
+
+    std::vector<VkDescriptorSetLayout> setLayouts(frameCount, culling.descriptorSetLayout);
+    culling.descSets.resize(frameCount);
+
+    VkDescriptorSetAllocateInfo descriptorAllocateInfo = {};
+    descriptorAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorAllocateInfo.pNext = nullptr;
+    descriptorAllocateInfo.descriptorPool = culling.descriptorPool;
+    descriptorAllocateInfo.descriptorSetCount = frameCount;
+    descriptorAllocateInfo.pSetLayouts = setLayouts.data();
+
+    debugAssertFunctionResult(vk::AllocateDescriptorSets(appManager.device, &descriptorAllocateInfo, culling.descSets.data()), "Culling Descriptor Set Allocation");
+
+    const VkDeviceSize objectSliceSize = appManager.dynamicUniformBufferData.bufferInfo.range;
+    const VkDeviceSize frameSliceSize = appManager.frameUniformBufferData.bufferInfo.range;
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        VkDescriptorBufferInfo bufferInfos[7] = {
+            { appManager.dynamicUniformBufferData.buffer, objectSliceSize * i, objectSliceSize },
+            { appManager.indirectBuffer.buffer, 0, VK_WHOLE_SIZE },
+            { culling.cullDataBuffer.buffer, 0, VK_WHOLE_SIZE },
+            { culling.drawBuffer.buffer, culling.drawSliceSize * i, culling.drawSliceSize },
+            { culling.countBuffer.buffer, culling.countSliceSize * i, culling.countSliceSize },
+            { appManager.frameUniformBufferData.buffer, frameSliceSize * i, sizeof(FrameUBO) },
+            { appManager.instanceBuffer.buffer, appManager.instanceSliceSize * i, appManager.instanceSliceSize },
+        };
+
+        VkWriteDescriptorSet descriptorSetWrites[7];
+        for (uint32_t b = 0; b < 7; b++)
+        {
+            descriptorSetWrites[b] = {};
+            descriptorSetWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorSetWrites[b].pNext = nullptr;
+            descriptorSetWrites[b].dstSet = culling.descSets[i];
+            descriptorSetWrites[b].dstBinding = b;
+            descriptorSetWrites[b].dstArrayElement = 0;
+            descriptorSetWrites[b].descriptorCount = 1;
+            descriptorSetWrites[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorSetWrites[b].pBufferInfo = &bufferInfos[b];
+        }
+
+        vk::UpdateDescriptorSets(appManager.device, 7, descriptorSetWrites, 0, nullptr);
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.pNext = nullptr;
+    pipelineLayoutInfo.flags = 0;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &culling.descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+    debugAssertFunctionResult(vk::CreatePipelineLayout(appManager.device, &pipelineLayoutInfo, nullptr, &culling.pipelineLayout), "Culling Pipeline Layout Creation");
+
+    // Specialization constants: 0 object stride (in vec4s), 1 number of draws, 2 compact the visible draws,
+    // 3 largest error of a level of detail in pixels (a float).
+    float lodPixelError = LOD_PIXEL_ERROR;
+    uint32_t specializationData[4] = { _getUniformDataStride(appManager) / 16, drawCount, culling.compact ? 1u : 0u, 0 };
+    memcpy(&specializationData[3], &lodPixelError, sizeof(float));
+
+    VkSpecializationMapEntry specializationEntries[4] = {
+        { 0, 0, sizeof(uint32_t) },
+        { 1, sizeof(uint32_t), sizeof(uint32_t) },
+        { 2, 2 * sizeof(uint32_t), sizeof(uint32_t) },
+        { 3, 3 * sizeof(uint32_t), sizeof(float) },
+    };
+
+    VkSpecializationInfo specializationInfo = {};
+    specializationInfo.mapEntryCount = 4;
+    specializationInfo.pMapEntries = specializationEntries;
+    specializationInfo.dataSize = sizeof(specializationData);
+    specializationInfo.pData = specializationData;
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.stage = appManager.shaderStages[SHADER_COMPUTE_CULL];
+    pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+    pipelineInfo.layout = culling.pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    debugAssertFunctionResult(vk::CreateComputePipelines(appManager.device, appManager.pipelineCache, 1, &pipelineInfo, nullptr, &culling.pipeline), "Culling Pipeline Creation");
+
+    Log(false, "Culling: compute frustum culling of %u draws and %u instances%s, %s", drawCount, instanceBase, appManager.useMeshletDraws ? " with meshlet backface culling" : "",
+        culling.compact ? "visible draws packed and drawn with vkCmdDrawIndexedIndirectCount" : "culled draws kept with an instance count of 0");
+}
+
+/// <summary>Records the culling pass. Must be recorded outside of the render pass.</summary>
+/// <param name="cmdBuffer">Command buffer to record to</param>
+/// <param name="frameIndex">Frame in flight being recorded</param>
+inline void _recordCulling(AppManager& appManager, VkCommandBuffer cmdBuffer, uint32_t frameIndex)
+{
+    GpuCulling& culling = appManager.culling;
+    const uint32_t drawCount = static_cast<uint32_t>(appManager.drawCommands.size());
+
+    // Reset the counters of this frame.
+    vk::CmdFillBuffer(cmdBuffer, culling.countBuffer.buffer, culling.countSliceSize * frameIndex, sizeof(uint32_t) * appManager.drawGroups.size(), 0);
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vk::CmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vk::CmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.pipeline);
+    vk::CmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.pipelineLayout, 0, 1, &culling.descSets[frameIndex], 0, nullptr);
+    vk::CmdDispatch(cmdBuffer, (drawCount + CULLING_GROUP_SIZE - 1) / CULLING_GROUP_SIZE, 1, 1);
+
+    // The draws and counters are read by the indirect draws and, after the frame fence, by the CPU. The instances are read by the
+    // vertex shader.
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+    vk::CmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                           0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+/// <summary>Reads back the counters of the current frame and logs the number of culled meshes when it changes.
+/// Must be called after the fence of the current frame has been waited on.</summary>
+inline void _logCullingStats(AppManager& appManager)
+{
+    if (!appManager.useGpuCulling) return;
+
+    GpuCulling& culling = appManager.culling;
+    const uint32_t* counts = reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(culling.countBuffer.mappedData) + culling.countSliceSize * appManager.frameId);
+
+    // Not HOST_COHERENT memory has to be invalidated before reading what the GPU wrote.
+    if ((culling.countBuffer.memPropFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0)
+    {
+        VkMappedMemoryRange mapMemRange = _getMappedMemoryRange(appManager, culling.countBuffer.memory, culling.countSliceSize * appManager.frameId, culling.countSliceSize);
+        vk::InvalidateMappedMemoryRanges(appManager.device, 1, &mapMemRange);
+    }
+
+    // The slice has not been written by the GPU yet.
+    if (counts[0] == 0xFFFFFFFF) return;
+
+    uint32_t visibleMeshes = 0;
+    for (size_t g = 0; g < appManager.drawGroups.size(); g++) visibleMeshes += counts[g];
+
+    uint32_t culledMeshes = static_cast<uint32_t>(appManager.drawCommands.size()) - visibleMeshes;
+    if (culledMeshes != culling.culledMeshes)
+    {
+        culling.culledMeshes = culledMeshes;
+        Log(false, "Culling: %u of %u draws culled", culledMeshes, (unsigned int)appManager.drawCommands.size());
+    }
+}
+
+/// <summary>Destroys the objects of the culling pass</summary>
+inline void _destroyCulling(AppManager& appManager)
+{
+    if (!appManager.useGpuCulling) return;
+
+    GpuCulling& culling = appManager.culling;
+
+    vk::DestroyPipeline(appManager.device, culling.pipeline, nullptr);
+    vk::DestroyPipelineLayout(appManager.device, culling.pipelineLayout, nullptr);
+    vk::DestroyDescriptorSetLayout(appManager.device, culling.descriptorSetLayout, nullptr);
+    vk::DestroyDescriptorPool(appManager.device, culling.descriptorPool, nullptr); // Also frees the sets.
+
+    _destroyBuffer(appManager, culling.cullDataBuffer);
+    _destroyBuffer(appManager, culling.drawBuffer);
+    _destroyBuffer(appManager, culling.countBuffer);
+}
+
+#endif // VKCULLING_H
@@ -23,16 +23,21 @@ inline void _initDescriptorPoolAndSet(AppManager& appManager)
     // These steps are demonstrated below.
 
     // This is the size of the descriptor pool. This establishes how many descriptors are needed and their type.
-    VkDescriptorPoolSize descriptorPoolSize[2];
+    VkDescriptorPoolSize descriptorPoolSize[3];
 
      int numTextures = appManager.textures.size(), numDescriptors = numTextures+1;
 
-    descriptorPoolSize[0].descriptorCount = 1;
+    // The per-object and per-frame uniform buffers, plus the per-frame buffer of the indirect drawing path.
+    descriptorPoolSize[0].descriptorCount = 3;
     descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 
-    descriptorPoolSize[1].descriptorCount = 1;
+    descriptorPoolSize[1].descriptorCount = std::max(numTextures, 1);
     descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 
+    // The per-object data and the instance buffer read as storage buffers by the indirect drawing path.
+    descriptorPoolSize[2].descriptorCount = 2;
+    descriptorPoolSize[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
     // This is the creation info struct for the descriptor pool.
     // This specifies the size of the pool
     // and the maximum number of descriptor sets that can be allocated out of it.
@@ -42,9 +47,9 @@ inline void _initDescriptorPoolAndSet(AppManager& appManager)
     descriptorPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
     descriptorPoolInfo.pNext = nullptr;
     descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    descriptorPoolInfo.poolSizeCount = numDescriptors;
+    descriptorPoolInfo.poolSizeCount = 3;
     descriptorPoolInfo.pPoolSizes = descriptorPoolSize;
-    descriptorPoolInfo.maxSets = numDescriptors;
+    descriptorPoolInfo.maxSets = numDescriptors + 1;
 
     // Create the descriptor pool.
     debugAssertFunctionResult(vk::CreateDescriptorPool(appManager.device, &descriptorPoolInfo, nullptr, &appManager.descriptorPool), "Descriptor Pool Creation");
@@ -71,21 +76,26 @@ inline void _initDescriptorPoolAndSet(AppManager& appManager)
     }
 
     // The process is then repeated for the descriptor set layout of the uniform buffer descriptor set.
+    // It has two bindings: 0 the per-object data (UBO) and 1 the per-frame data (FrameUBO). Both are dynamic, so each one takes an
+    // offset when the set is bound.
     {
-        VkDescriptorSetLayoutBinding descriptorLayoutBinding;
-        descriptorLayoutBinding.descriptorCount = 1;
-        descriptorLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-        descriptorLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-        descriptorLayoutBinding.binding = 0;
-        descriptorLayoutBinding.pImmutableSamplers = nullptr;
+        VkDescriptorSetLayoutBinding descriptorLayoutBinding[2];
+        for (uint32_t b = 0; b < 2; b++)
+        {
+            descriptorLayoutBinding[b].descriptorCount = 1;
+            descriptorLayoutBinding[b].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+            descriptorLayoutBinding[b].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+            descriptorLayoutBinding[b].binding = b;
+            descriptorLayoutBinding[b].pImmutableSamplers = nullptr;
+        }
 
         // Create the descriptor set layout using the array of VkDescriptorSetLayoutBindings.
         VkDescriptorSetLayoutCreateInfo descriptorLayoutInfo = {};
         descriptorLayoutInfo.flags = 0;
         descriptorLayoutInfo.pNext = nullptr;
         descriptorLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        descriptorLayoutInfo.bindingCount = 1;
-        descriptorLayoutInfo.pBindings = &descriptorLayoutBinding;
+        descriptorLayoutInfo.bindingCount = 2;
+        descriptorLayoutInfo.pBindings = descriptorLayoutBinding;
 
         // Create the descriptor set layout for the uniform buffer descriptor set.
         debugAssertFunctionResult(
@@ -113,7 +123,7 @@ inline void _initDescriptorPoolAndSet(AppManager& appManager)
     // Update the descriptor sets with the actual objects, in this case the texture image and the uniform buffer.
     // These structs specify which descriptor sets are going to be updated and hold a pointer to the actual objects.
     VkWriteDescriptorSet *descriptorSetWrite;
-    descriptorSetWrite = (VkWriteDescriptorSet *)malloc(sizeof(VkWriteDescriptorSet)*numDescriptors);
+    descriptorSetWrite = (VkWriteDescriptorSet *)malloc(sizeof(VkWriteDescriptorSet)*(numDescriptors+1));
 
     int count = 0;
 
@@ -153,9 +163,65 @@ inline void _initDescriptorPoolAndSet(AppManager& appManager)
     descriptorSetWrite[count].dstArrayElement = 0;
     descriptorSetWrite[count].dstBinding = 0;
 
-    vk::UpdateDescriptorSets(appManager.device, numDescriptors, descriptorSetWrite, 0, nullptr);
+    // The per-frame uniform buffer, in binding 1 of the same set.
+    count++;
+    descriptorSetWrite[count] = descriptorSetWrite[count - 1];
+    descriptorSetWrite[count].pBufferInfo = &appManager.frameUniformBufferData.bufferInfo;
+    descriptorSetWrite[count].dstBinding = 1;
+
+    vk::UpdateDescriptorSets(appManager.device, numDescriptors+1, descriptorSetWrite, 0, nullptr);
 
     free(descriptorSetWrite);
+
+    // The indirect drawing path reads the same per-object uniform buffer as a storage buffer, so the vertex shader can index it with
+    // gl_InstanceIndex, through the object of each instance in the instance buffer (binding 2). The per-frame data is a uniform
+    // buffer, as in the other path. The instanced direct draws use it too.
+    if (appManager.useIndirectPipeline)
+    {
+        VkDescriptorSetLayoutBinding descriptorLayoutBinding[3];
+        for (uint32_t b = 0; b < 3; b++)
+        {
+            descriptorLayoutBinding[b].descriptorCount = 1;
+            descriptorLayoutBinding[b].descriptorType = (b == 1) ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+            descriptorLayoutBinding[b].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+            descriptorLayoutBinding[b].binding = b;
+            descriptorLayoutBinding[b].pImmutableSamplers = nullptr;
+        }
+
+        VkDescriptorSetLayoutCreateInfo descriptorLayoutInfo = {};
+        descriptorLayoutInfo.flags = 0;
+        descriptorLayoutInfo.pNext = nullptr;
+        descriptorLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        descriptorLayoutInfo.bindingCount = 3;
+        descriptorLayoutInfo.pBindings = descriptorLayoutBinding;
+
+        debugAssertFunctionResult(
+            vk::CreateDescriptorSetLayout(appManager.device, &descriptorLayoutInfo, nullptr, &appManager.indirectDescriptorSetLayout), "Descriptor Set Layout Creation");
+
+        descriptorAllocateInfo.pSetLayouts = &appManager.indirectDescriptorSetLayout;
+        debugAssertFunctionResult(vk::AllocateDescriptorSets(appManager.device, &descriptorAllocateInfo, &appManager.indirectDescSet), "Descriptor Set Creation");
+
+        VkWriteDescriptorSet storageWrite[3] = {};
+        storageWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        storageWrite[0].pNext = nullptr;
+        storageWrite[0].dstSet = appManager.indirectDescSet;
+        storageWrite[0].descriptorCount = 1;
+        storageWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        storageWrite[0].pBufferInfo = &appManager.dynamicUniformBufferData.bufferInfo;
+        storageWrite[0].dstArrayElement = 0;
+        storageWrite[0].dstBinding = 0;
+
+        storageWrite[1] = storageWrite[0];
+        storageWrite[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        storageWrite[1].pBufferInfo = &appManager.frameUniformBufferData.bufferInfo;
+        storageWrite[1].dstBinding = 1;
+
+        storageWrite[2] = storageWrite[0];
+        storageWrite[2].pBufferInfo = &appManager.instanceBuffer.bufferInfo;
+        storageWrite[2].dstBinding = 2;
+
+        vk::UpdateDescriptorSets(appManager.device, 3, storageWrite, 0, nullptr);
+    }
 }
 
 
@@ -188,18 +188,22 @@ inline void _initLogicalDevice(AppManager& appManager, std::vector<std::string>&
 
     // There are priorities for queues (range: 0 - 1). Each queue in the same device is assigned a priority with higher priority queues
     // potentially being given more processing time than lower priority ones.
-    // In this case there is only one, so it does not matter.
+    // In this case there is one queue per family, so it does not matter.
     float queuePriorities[1] = { 0.0f };
 
-    // Populate the device queue creation info struct with the previously found compatible queue family
-    // and number of queues to be created. Again, only one queue is needed.
-    VkDeviceQueueCreateInfo deviceQueueInfo = {};
-    deviceQueueInfo.pNext = nullptr;
-    deviceQueueInfo.flags = 0;
-    deviceQueueInfo.queueFamilyIndex = appManager.graphicsQueueFamilyIndex;
-    deviceQueueInfo.pQueuePriorities = queuePriorities;
-    deviceQueueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    deviceQueueInfo.queueCount = 1;
+    // Populate the device queue creation info structs with the previously found compatible queue families
+    // and number of queues to be created. One graphics queue is needed, plus one transfer queue if the device has a transfer family.
+    VkDeviceQueueCreateInfo deviceQueueInfos[2] = {};
+    uint32_t queueInfoCount = (appManager.transferQueueFamilyIndex != appManager.graphicsQueueFamilyIndex) ? 2 : 1;
+    for (uint32_t i = 0; i < queueInfoCount; i++)
+    {
+        deviceQueueInfos[i].pNext = nullptr;
+        deviceQueueInfos[i].flags = 0;
+        deviceQueueInfos[i].queueFamilyIndex = (i == 0) ? appManager.graphicsQueueFamilyIndex : appManager.transferQueueFamilyIndex;
+        deviceQueueInfos[i].pQueuePriorities = queuePriorities;
+        deviceQueueInfos[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        deviceQueueInfos[i].queueCount = 1;
+    }
 
     // Declare and populate the logical device creation info struct. This will be used to create the logical device and its associated queues.
     // The device extensions that were looked up earlier are specified here. They will be initialised when the logical device
@@ -216,12 +220,19 @@ inline void _initLogicalDevice(AppManager& appManager, std::vector<std::string>&
 
     deviceInfo.enabledExtensionCount = static_cast<uint32_t>(appManager.deviceExtensionNames.size());
     deviceInfo.ppEnabledExtensionNames = appManager.deviceExtensionNames.data();
-    deviceInfo.queueCreateInfoCount = 1;
-    deviceInfo.pQueueCreateInfos = &deviceQueueInfo;
+    deviceInfo.queueCreateInfoCount = queueInfoCount;
+    deviceInfo.pQueueCreateInfos = deviceQueueInfos;
     VkPhysicalDeviceFeatures features;
     vk::GetPhysicalDeviceFeatures(appManager.physicalDevice, &features);
     features.robustBufferAccess = false;
     deviceInfo.pEnabledFeatures = &features;
+    appManager.deviceFeatures = features;
+
+    // The indexTypeUint8 feature was queried when the extension was selected (see _initDeviceExtensions).
+    VkPhysicalDeviceIndexTypeUint8FeaturesEXT indexTypeUint8Features = {};
+    indexTypeUint8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT;
+    indexTypeUint8Features.indexTypeUint8 = VK_TRUE;
+    if (appManager.supportsIndexTypeUint8) deviceInfo.pNext = &indexTypeUint8Features;
 
     // Create the logical device using the deviceInfo struct defined above.
     debugAssertFunctionResult(vk::CreateDevice(appManager.physicalDevice, &deviceInfo, nullptr, &appManager.device), "Logic Device Creation");
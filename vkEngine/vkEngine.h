@@ -8,15 +8,23 @@
 #include "vkQueues.h"
 #include "vkSurfaces.h"
 #include "vkMemory.h"
+#include "vkStaging.h"
+#include "vkIndices.h"
+#include "vkIndirect.h"
+#include "vkCulling.h"
+#include "vkLod.h"
+#include "vkTransforms.h"
 #include "vkTextures.h"
 #include "vkShaders.h"
 #include "vkGLTF.h"
 #include "vkRenderPass.h"
 #include "vkDescriptor.h"
+#include "vkPipelineCache.h"
 #include "vkPipeline.h"
 #include "vkFences.h"
 #include "vkCommandBuffer.h"
 #include "vkCloseDown.h"
+#include "vkBenchmark.h"
 
 class vkEngine
 {
@@ -40,7 +48,7 @@ public:
         return _initInstanceExtensions();
     }
     std::vector<std::string> initDeviceExtensions(){
-        return _initDeviceExtensions();
+        return _initDeviceExtensions(appManager);
     }
 
     // Initialise the application and instance.
@@ -83,14 +91,51 @@ public:
         _initImagesAndViews(appManager);
     }
 
+    // Start the worker threads, used to decode the scene, update the transforms and record the command buffers.
+    void initWorkerThreads(){
+        _initWorkerThreads(appManager, MAX_WORKER_THREADS);
+    }
+
+    // Create the staging ring used to upload geometry into device local memory.
+    void initStagingBuffer(){
+        _initStagingBuffer(appManager);
+    }
+
     // Create vertex buffers to draw the primitive.
     void loadGLTF(const char* fileName){
         _loadGLTF(appManager, fileName);
     }
 
-    // Create a texture to apply to the primitive.
+    // Build the indirect draw buffer (if the device supports indirect drawing with firstInstance).
+    void initIndirectDraws(){
+        _initIndirectDraws(appManager);
+    }
+
+    // Copy the transforms of the objects to the structure of arrays used to compute the uniform data.
+    void initTransforms(){
+        _initTransforms(appManager);
+    }
+
+    // Change the transform of an object, and so of all its meshes. Only the objects changed this way recompute their uniform data.
+    void setObjectTransform(uint32_t objectIndex, const Transform& transform){
+        appManager.objectTransforms[objectIndex] = transform;
+        _setTransform(appManager.transforms, objectIndex, transform);
+    }
+
+    // Set the camera that selects the levels of detail of the meshes, from the projected size of their bounding spheres.
+    void setLodCamera(const VEC3& position, float yfov){
+        _setLodCamera(appManager, position, yfov, surfaceData.height);
+    }
+
+    // Write the uniform data of the frame: the view projection matrix and the per-object data that changed.
+    void updateTransforms(const MATRIX& mViewProjection, const VEC3& lightPosition, uint32_t frameIndex){
+        _updateTransforms(appManager, mViewProjection, lightPosition, frameIndex);
+    }
+
+    // Create a texture to apply to the primitive. It is uploaded asynchronously, and usable from the frame that acquires it.
     void loadTexture(TextureData& texture, const char* textureFileName){
         _loadTexture(appManager, texture, textureFileName);
+        _flushStagingBuffer(appManager);
     }
 
     // Create a descriptor pool and allocate descriptor sets for the buffers.
@@ -108,6 +153,16 @@ public:
         _initPipeline(appManager);
     }
 
+    // Create the pipeline cache, with the pipelines saved by the previous run if they are valid for this device.
+    void initPipelineCache(){
+        _initPipelineCache(appManager);
+    }
+
+    // Create the compute pass that frustum culls the indirect draws.
+    void initCulling(){
+        _initCulling(appManager);
+    }
+
     // Create the render pass to use for rendering the triangle.
     void initRenderPass(){
         _initRenderPass(appManager);
@@ -138,14 +193,39 @@ public:
         _createBuffer(appManager, inBuffer, inData, inUsage);
     }
 
+    // Print the number of memory pages, bytes in use and fragmentation of the memory allocator.
+    void logMemoryStats(){
+        _logMemoryStats(appManager);
+    }
+
+    // Compare the SIMD math kernels with the scalar ones.
+    void logMathTimings(){
+        _logMathTimings(1000000);
+    }
+
+    // Compare the cost of sending the per-draw data with dynamic uniform buffer offsets and with push constants.
+    void logPushConstantTimings(){
+        _logPushConstantTimings(appManager, 1000);
+    }
+
+    // Read back how many meshes the GPU culled in the last frame of the current image and print it when it changes.
+    void logCullingStats(){
+        _logCullingStats(appManager);
+    }
+
     // Generic method for creating a shader module.
     void createShaderModule(const uint32_t* spvShader, size_t spvShaderSize, int indx, VkShaderStageFlagBits shaderStage){
         createShaderModule(spvShader, spvShaderSize, indx, shaderStage);
     }
 
-    // Record the command buffer for rendering.
+    // Create the command pools used by the worker threads to record the command buffers.
+    void initRecordingThreads(){
+        _initRecordingThreads(appManager);
+    }
+
+    // Record the command buffer of the current frame for rendering.
     void recordCommandBuffer(){
-        _recordCommandBuffer(appManager);
+        _recordCommandBuffer(appManager, appManager.frameId, appManager.currentBuffer);
     }
 
     void initUniformBuffers(){
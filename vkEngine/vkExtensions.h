@@ -3,6 +3,22 @@
 
 #include "vkStructs.h"
 
+/// <summary>Checks if the Vulkan implementation supports an instance-level extension</summary>
+inline bool _isInstanceExtensionSupported(const char* extensionName)
+{
+    uint32_t extensionCount = 0;
+    vk::EnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vk::EnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+
+    for (const VkExtensionProperties& extension : extensions)
+    {
+        if (strcmp(extension.extensionName, extensionName) == 0) return true;
+    }
+    return false;
+}
+
 /// <summary>Selects required instance-level extensions</summary>
 /// <returns>Vector of the names of required instance-level extensions</returns>
 inline std::vector<std::string> _initInstanceExtensions()
@@ -47,17 +63,68 @@ inline std::vector<std::string> _initInstanceExtensions()
     extensionNames.emplace_back(VK_KHR_DISPLAY_EXTENSION_NAME);
 #endif
 
+    // Optional: the instance is created for Vulkan 1.0, so the features of the device extensions (such as indexTypeUint8)
+    // can only be queried through vkGetPhysicalDeviceFeatures2KHR.
+    if (_isInstanceExtensionSupported(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+    { extensionNames.emplace_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME); }
+
     return extensionNames;
 }
 
-/// <summary>Selects required device-level extensions</summary>
-/// <returns>Vector of the names of required device-level extensions</returns>
-inline std::vector<std::string> _initDeviceExtensions()
+/// <summary>Checks if the physical device supports a device-level extension</summary>
+inline bool _isDeviceExtensionSupported(AppManager& appManager, const char* extensionName)
+{
+    uint32_t extensionCount = 0;
+    vk::EnumerateDeviceExtensionProperties(appManager.physicalDevice, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vk::EnumerateDeviceExtensionProperties(appManager.physicalDevice, nullptr, &extensionCount, extensions.data());
+
+    for (const VkExtensionProperties& extension : extensions)
+    {
+        if (strcmp(extension.extensionName, extensionName) == 0) return true;
+    }
+    return false;
+}
+
+/// <summary>Checks if the physical device supports the indexTypeUint8 feature of VK_EXT_index_type_uint8</summary>
+inline bool _isIndexTypeUint8FeatureSupported(AppManager& appManager)
+{
+    // The extension does not guarantee the feature: it has to be queried, which needs VK_KHR_get_physical_device_properties2 on the instance.
+    bool properties2Enabled = false;
+    for (const char* extensionName : appManager.instanceExtensionNames)
+    { properties2Enabled |= strcmp(extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0; }
+    if (!properties2Enabled || !vk::GetPhysicalDeviceFeatures2KHR) return false;
+
+    VkPhysicalDeviceIndexTypeUint8FeaturesEXT indexTypeUint8Features = {};
+    indexTypeUint8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT;
+
+    VkPhysicalDeviceFeatures2KHR features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+    features.pNext = &indexTypeUint8Features;
+    vk::GetPhysicalDeviceFeatures2KHR(appManager.physicalDevice, &features);
+
+    return indexTypeUint8Features.indexTypeUint8 == VK_TRUE;
+}
+
+/// <summary>Selects required and optional device-level extensions</summary>
+/// <returns>Vector of the names of the device-level extensions to enable</returns>
+inline std::vector<std::string> _initDeviceExtensions(AppManager& appManager)
 {
     // The VK_KHR_swapchain extension is device-level. The device-level extension names are stored in a
     // separate vector from the instance-level extension names.
     std::vector<std::string> extensionNames;
     extensionNames.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+    // Optional: lets the GPU read the number of indirect draws from a buffer (used by the GPU culling).
+    appManager.supportsDrawIndirectCount = _isDeviceExtensionSupported(appManager, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (appManager.supportsDrawIndirectCount) extensionNames.emplace_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+    // Optional: 8-bit indices for the meshes with at most 256 vertices.
+    appManager.supportsIndexTypeUint8 =
+        _isDeviceExtensionSupported(appManager, VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME) && _isIndexTypeUint8FeatureSupported(appManager);
+    if (appManager.supportsIndexTypeUint8) extensionNames.emplace_back(VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME);
+
     return extensionNames;
 }
 
@@ -12,24 +12,26 @@ inline void _initSemaphoreAndFence(AppManager& appManager)
     // Semaphores are GPU to GPU syncs, specifically used to sync queue submissions on the same or different queue. Again, they are signalled by
     // the GPU but are waited on by the GPU. They are reset after they are waited on.
 
-    // This function creates two sets of semaphores and a single fence for each swapchain image.
+    // This function creates an acquire semaphore and a fence for each frame in flight, and a render semaphore for each swapchain image.
 
     // The first semaphore will wait until the image has been acquired successfully from the
     // swapchain before signalling, the second semaphore will wait until the render has finished
     // on the image, and finally the fence will wait until the commands in the command
     // buffer have finished executing.
 
+    // The render semaphore belongs to the swapchain image rather than to the frame: the presentation engine may still be waiting
+    // on it when the frame objects are reused, but not once the same image has been acquired again.
+
     // The semaphores are created with default parameters, but the fence is created with the flags parameter set to
     // VK_FENCE_CREATE_SIGNALED_BIT. This is because of the specific way this example is structured. The
     // application waits for this fence to be signalled before starting to draw the frame, however, on the first
     // frame there is no previous frame to trigger the fence, so it must be created in a signalled state.
 
     // All of the objects created here are stored in std::vectors. The individual semaphores and fences
-    // will be accessed later with an index relating to the frame that is currently being rendered.
-    for (uint32_t i = 0; i < appManager.swapChainImages.size(); ++i)
+    // will be accessed later with the index of the frame in flight (frameId) or of the swapchain image (currentBuffer).
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         VkSemaphore acquireSemaphore;
-        VkSemaphore renderSemaphore;
 
         VkFence frameFence;
 
@@ -42,15 +44,6 @@ inline void _initSemaphoreAndFence(AppManager& appManager)
 
         appManager.acquireSemaphore.emplace_back(acquireSemaphore);
 
-        VkSemaphoreCreateInfo renderSemaphoreInfo = {};
-        renderSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-        renderSemaphoreInfo.pNext = nullptr;
-        renderSemaphoreInfo.flags = 0;
-
-        debugAssertFunctionResult(vk::CreateSemaphore(appManager.device, &renderSemaphoreInfo, nullptr, &renderSemaphore), "Render Semaphore creation");
-
-        appManager.presentSemaphores.emplace_back(renderSemaphore);
-
         VkFenceCreateInfo FenceInfo;
         FenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
         FenceInfo.pNext = nullptr;
@@ -60,6 +53,20 @@ inline void _initSemaphoreAndFence(AppManager& appManager)
 
         appManager.frameFences.emplace_back(frameFence);
     }
+
+    for (uint32_t i = 0; i < appManager.swapChainImages.size(); ++i)
+    {
+        VkSemaphore renderSemaphore;
+
+        VkSemaphoreCreateInfo renderSemaphoreInfo = {};
+        renderSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        renderSemaphoreInfo.pNext = nullptr;
+        renderSemaphoreInfo.flags = 0;
+
+        debugAssertFunctionResult(vk::CreateSemaphore(appManager.device, &renderSemaphoreInfo, nullptr, &renderSemaphore), "Render Semaphore creation");
+
+        appManager.presentSemaphores.emplace_back(renderSemaphore);
+    }
 }
 
 #endif // VKFENCES_H
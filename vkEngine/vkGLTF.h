@@ -2,11 +2,24 @@
 #define VKGLTF_H
 
 #include "tiny_gltf.h"
+#include <atomic>
+#include <cfloat>
+#include <chrono>
 
 #include "vkStructs.h"
 #include "vkMemory.h"
+#include "vkStaging.h"
+#include "vkThreads.h"
+#include "vkAccessors.h"
+#include "vkIndirect.h"
+#include "vkMeshOptimize.h"
+#include "vkQuantize.h"
+#include "vkSimplify.h"
+#include "vkLod.h"
+#include "vkMeshlets.h"
 
 #include "vkTextures.h"
+#include "vkMeshCache.h"
 
 // Callback function required for tiny_gltf
 static bool myTextureLoadingFunction(tinygltf::Image *image, const int image_idx, std::string * err,
@@ -24,6 +37,7 @@ static bool myTextureLoadingFunction(tinygltf::Image *image, const int image_idx
     std::string uri = appManager->gltfPath+"\\"+name+".dds";
 
     appManager->textures.emplace_back();
+    appManager->textures.back().uri = name + ".dds";
     _loadTexture(*appManager, appManager->textures[appManager->textures.size()-1], uri.c_str());
 
     return true;
@@ -48,6 +62,172 @@ static void getTransform(Transform& transform, const tinygltf::Node node)
     transform.scale.z = (size>0) ? node.scale[2] : 1.0f;
 }
 
+// Concept: Parallel Decoding
+// The attributes of a glTF primitive are stored in separate arrays (all the positions, then all the normals...) and have to be
+// interleaved into Vertex. The number of vertices and indices of every primitive is known from its accessors before decoding, so the
+// place of each one in the shared vertex and index buffers is found first, and then the primitives are decoded by the worker
+// threads straight into those buffers. Each primitive writes its own ranges, so no locking is needed.
+
+// A primitive to decode and the place of its data in the shared buffers.
+struct PrimitiveDecodeJob
+{
+    const tinygltf::Primitive* primitive;
+    uint32_t meshIndex; // Index in appManager.meshes, which receives the bounds and has the place of the indices.
+    uint32_t firstVertex;
+    uint32_t vertexCount;
+    bool doubleSided; // The material of the primitive shows its back faces.
+    VEC3 boundsMin, boundsMax; // Bounding box of the decoded vertices.
+    std::vector<GeneratedLod> lods; // Levels of detail after the full mesh, added to the index buffer once all the primitives are decoded.
+    std::vector<Meshlet> meshlets; // Meshlets of the full mesh, with firstIndex relative to the mesh.
+};
+
+/// <summary>Returns the accessor of a primitive attribute, or nullptr if the primitive does not have it</summary>
+static const tinygltf::Accessor* getAttributeAccessor(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const char* name)
+{
+    std::map<std::string, int>::const_iterator attribute = primitive.attributes.find(name);
+    if (attribute == primitive.attributes.end() || attribute->second < 0) return nullptr;
+    return &model.accessors[attribute->second];
+}
+
+/// <summary>Returns the view of a primitive attribute. Returns false if the primitive does not have it.</summary>
+static bool getAttributeView(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const char* name, AccessorView& view)
+{
+    std::map<std::string, int>::const_iterator attribute = primitive.attributes.find(name);
+    if (attribute == primitive.attributes.end()) return false;
+    return _getAccessorView(model, attribute->second, view);
+}
+
+/// <summary>Interleaves the attributes of a primitive into outVertices, writes its indices to outIndices and computes its bounds</summary>
+/// <remarks>The attributes are read in place from the glTF buffers, with their stride and component type, and written straight
+/// to the shared buffers. A primitive without indices gets the sequential indices of its vertices.</remarks>
+/// <param name="indexType">Type of the indices written to outIndices</param>
+/// <returns>False if the indices of the primitive cannot be read or are outside its vertices</returns>
+static bool decodePrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive, VkIndexType indexType, Vertex* outVertices,
+                            uint8_t* outIndices, VEC3& boundsMin, VEC3& boundsMax)
+{
+    AccessorView view_pos, view_nor, view_tex;
+    if (!getAttributeView(model, primitive, "POSITION", view_pos))
+    {
+        // The reserved ranges stay zeroed, which draws nothing.
+        boundsMin = boundsMax = VEC3();
+        return true;
+    }
+    const bool has_nor = getAttributeView(model, primitive, "NORMAL", view_nor) && view_nor.count == view_pos.count;
+    const bool has_tex = getAttributeView(model, primitive, "TEXCOORD_0", view_tex) && view_tex.count == view_pos.count;
+    const size_t numVertices = view_pos.count;
+
+    AccessorView view_indices;
+    bool validIndices = true;
+    if (primitive.indices < 0)
+    {
+        const size_t indexSize = _getIndexSize(indexType);
+        for (uint32_t i = 0; i < static_cast<uint32_t>(numVertices); i++) memcpy(outIndices + i * indexSize, &i, indexSize); // Little endian.
+    }
+    else if (!_getAccessorView(model, primitive.indices, view_indices))
+    {
+        // A sparse accessor, for example. The reserved range stays zeroed.
+        Log(true, "GLTF - the index accessor %d of a primitive cannot be read", primitive.indices);
+        validIndices = false;
+    }
+    else if (!_readAccessorIndices(view_indices, indexType, static_cast<uint32_t>(numVertices), outIndices))
+    {
+        Log(true, "GLTF - a primitive has indices outside its vertices");
+        validIndices = false;
+    }
+
+    uint8_t* out = reinterpret_cast<uint8_t*>(outVertices);
+    if (has_nor && has_tex && _isVertexLayout(view_pos, view_nor, view_tex))
+    {
+        // The file already stores Vertex.
+        memcpy(out, view_pos.data, sizeof(Vertex) * numVertices);
+    }
+    else
+    {
+        _readAccessorFloats(view_pos, 3, out + offsetof(Vertex, pos), sizeof(Vertex));
+
+        if (has_nor) _readAccessorFloats(view_nor, 3, out + offsetof(Vertex, nor), sizeof(Vertex));
+        else for (size_t i = 0; i < numVertices; i++) outVertices[i].nor = VEC3(0.0f, 0.0f, 1.0f);
+
+        if (has_tex) _readAccessorFloats(view_tex, 2, out + offsetof(Vertex, tex), sizeof(Vertex));
+        else for (size_t i = 0; i < numVertices; i++) { outVertices[i].tex.u = 0.0f; outVertices[i].tex.v = 0.0f; }
+    }
+
+    // The POSITION accessor carries the bounding box of the primitive, but it is optional.
+    // It is simply recomputed from the decoded vertices.
+    boundsMin = VEC3(FLT_MAX, FLT_MAX, FLT_MAX);
+    boundsMax = VEC3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (size_t i = 0; i < numVertices; i++)
+    {
+        const VEC3& pos = outVertices[i].pos;
+        boundsMin.x = std::min(boundsMin.x, pos.x); boundsMax.x = std::max(boundsMax.x, pos.x);
+        boundsMin.y = std::min(boundsMin.y, pos.y); boundsMax.y = std::max(boundsMax.y, pos.y);
+        boundsMin.z = std::min(boundsMin.z, pos.z); boundsMax.z = std::max(boundsMax.z, pos.z);
+    }
+    return validIndices;
+}
+
+/// <summary>Appends the levels of detail generated by the decoding jobs to the sections of the index buffer of their meshes</summary>
+/// <remarks>The sections grow, so they are laid out again and the indices already decoded are moved to their new offsets.</remarks>
+/// <param name="indices">Index buffer data, with the sections of appManager.indexSections</param>
+static void addLodIndices(AppManager& appManager, const std::vector<PrimitiveDecodeJob>& decodeJobs, std::vector<uint8_t>& indices)
+{
+    IndexSection previousSections[INDEX_SECTION_COUNT];
+    memcpy(previousSections, appManager.indexSections, sizeof(previousSections));
+
+    bool hasLods = false;
+    for (const PrimitiveDecodeJob& job : decodeJobs)
+    {
+        Mesh& mesh = appManager.meshes[job.meshIndex];
+        IndexSection& section = appManager.indexSections[_getIndexSection(mesh.indexType)];
+        for (const GeneratedLod& lod : job.lods)
+        {
+            MeshLod& meshLod = mesh.lods[mesh.lodCount++];
+            meshLod.firstIndex = section.count;
+            meshLod.indexCount = static_cast<uint32_t>(lod.indices.size());
+            meshLod.error = mesh.boundsRadius > 0.0f ? lod.error / mesh.boundsRadius : 0.0f;
+            section.count += meshLod.indexCount;
+            hasLods = true;
+        }
+    }
+    if (!hasLods) return;
+
+    std::vector<uint8_t> previousIndices(static_cast<size_t>(_layoutIndexSections(appManager)));
+    previousIndices.swap(indices);
+    for (uint32_t s = 0; s < INDEX_SECTION_COUNT; s++)
+    {
+        const size_t size = static_cast<size_t>(previousSections[s].count) * _getIndexSize(previousSections[s].type);
+        if (size > 0) memcpy(&indices[static_cast<size_t>(appManager.indexSections[s].offset)], &previousIndices[static_cast<size_t>(previousSections[s].offset)], size);
+    }
+
+    for (const PrimitiveDecodeJob& job : decodeJobs)
+    {
+        const Mesh& mesh = appManager.meshes[job.meshIndex];
+        const IndexSection& section = appManager.indexSections[_getIndexSection(mesh.indexType)];
+        const uint32_t indexSize = _getIndexSize(mesh.indexType);
+        for (size_t l = 0; l < job.lods.size(); l++)
+        {
+            const MeshLod& meshLod = mesh.lods[mesh.lodCount - job.lods.size() + l];
+            _writeIndices(job.lods[l].indices.data(), meshLod.indexCount, mesh.indexType,
+                          &indices[static_cast<size_t>(section.offset) + static_cast<size_t>(meshLod.firstIndex) * indexSize]);
+        }
+    }
+}
+
+/// <summary>Appends the meshlets built by the decoding jobs to appManager.meshlets and links them to their meshes</summary>
+static void addMeshlets(AppManager& appManager, const std::vector<PrimitiveDecodeJob>& decodeJobs)
+{
+    for (const PrimitiveDecodeJob& job : decodeJobs)
+    {
+        Mesh& mesh = appManager.meshes[job.meshIndex];
+        mesh.firstMeshlet = static_cast<uint32_t>(appManager.meshlets.size());
+        mesh.meshletCount = static_cast<uint32_t>(job.meshlets.size());
+        for (Meshlet meshlet : job.meshlets)
+        {
+            meshlet.firstIndex += mesh.firstIndex;
+            appManager.meshlets.push_back(meshlet);
+        }
+    }
+}
 
 /// <summary>Defines the vertices of a simple triangle which can be passed to the vertex shader to be rendered on screen</summary>
 inline void _loadGLTF(AppManager& appManager, const char* fileName)
@@ -57,25 +237,67 @@ inline void _loadGLTF(AppManager& appManager, const char* fileName)
     tinygltf::TinyGLTF gltf_ctx;
     std::string err;
     std::string warn;
-    unsigned int textureID = 0;
+
+    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+    uint32_t firstSubmit = appManager.staging.submitCount;
+    _initIndexSections(appManager);
 
     std::string fn(fileName);
     appManager.gltfPath = fn.substr(0, fn.rfind('\\'));
 
+    // The file is mapped, hashed to validate its cache, and parsed from memory if the cache cannot be used.
+    MappedFile sourceFile;
+    if (!_mapFile(fileName, sourceFile))
+    {
+        Log(true, "GLTF - could not open %s", fileName);
+        exit(1);
+    }
+
+    const uint64_t sourceHash = _hashData(sourceFile.data, sourceFile.size);
+    const uint64_t sourceSize = sourceFile.size;
+    const std::string cacheFileName = _getMeshCacheFileName(fileName);
+
+    if (_loadMeshCache(appManager, cacheFileName, sourceHash, sourceSize))
+    {
+        _unmapFile(sourceFile);
+        _flushStagingBuffer(appManager);
+
+        double loadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+        Log(false, "GLTF - %u objects, %u submeshes, %u textures in %u staging submits, loaded from the cache in %.1f ms",
+            (unsigned int)appManager.objectTransforms.size(), (unsigned int)appManager.meshes.size(),
+            (unsigned int)appManager.textures.size(), appManager.staging.submitCount - firstSubmit, loadTime);
+        _logIndexSections(appManager);
+        _logMeshLods(appManager);
+        _logMeshlets(appManager);
+        return;
+    }
+
     gltf_ctx.SetImageLoader(myTextureLoadingFunction, (void *)&appManager);
 
     gltf_ctx.SetStoreOriginalJSONForExtrasAndExtensions(false);
 
     bool ret = false;
-    ret = gltf_ctx.LoadBinaryFromFile(&model, &err, &warn, fileName);
+    ret = gltf_ctx.LoadBinaryFromMemory(&model, &err, &warn, sourceFile.data, static_cast<unsigned int>(sourceFile.size), appManager.gltfPath);
+    _unmapFile(sourceFile);
 
     if(!ret){
         Log(true, ("GLTF - "+err).c_str());
         exit(1);
     }
 
+    // All the meshes are packed in one vertex buffer and one index buffer. The indices of each mesh stay relative to
+    // its first vertex, vertexOffset is added by the draw call. The index buffer has a section for each index type.
+    std::vector<Vertex> vertices;
+    std::vector<uint8_t> indices;
+    std::vector<PrimitiveDecodeJob> decodeJobs;
+    uint32_t vertexCount = 0;
+
+    // Nodes that reference the same glTF mesh are instances of it: its primitives are decoded and uploaded once.
+    std::vector<std::vector<const tinygltf::Node*>> meshInstances(model.meshes.size());
+    std::vector<int> meshOrder; // glTF meshes in the order of their first node.
+
     const tinygltf::Scene &scene = model.scenes[model.defaultScene];
-    for(tinygltf::Node node : model.nodes)
+    for(const tinygltf::Node& node : model.nodes)
     {
         Log(false, ("NODE NAME "+node.name).c_str());
 
@@ -104,77 +326,220 @@ inline void _loadGLTF(AppManager& appManager, const char* fileName)
 
         if (node.mesh > -1)
         {
+            if (meshInstances[node.mesh].empty()) meshOrder.push_back(node.mesh);
+            meshInstances[node.mesh].push_back(&node);
+        }
+    }
 
-            tinygltf::Mesh mesh = model.meshes[node.mesh];
-            Log(false, ("MESH NAME "+mesh.name).c_str());
+    for (int meshIndex : meshOrder)
+    {
+        const tinygltf::Mesh& mesh = model.meshes[meshIndex];
+        const std::vector<const tinygltf::Node*>& instances = meshInstances[meshIndex];
+        Log(false, "MESH NAME %s, %u instances", mesh.name.c_str(), (unsigned int)instances.size());
+
+        // Each node is an object: its transform is shared by the submeshes of all its primitives. The objects of the nodes
+        // that share the mesh are consecutive, so the submeshes are drawn once for all of them.
+        const uint32_t objectIndex = static_cast<uint32_t>(appManager.objectTransforms.size());
+        for (const tinygltf::Node* node : instances)
+        {
+            appManager.objectTransforms.emplace_back();
+            getTransform(appManager.objectTransforms.back(), *node);
+        }
 
-            Vertex *Geometry;
-            uint16_t* bufferIndices;
-            unsigned int numIndices = 0;
-            unsigned int numVertices = 0;
+        for (const tinygltf::Primitive& primitive : mesh.primitives)
+        {
+            const tinygltf::Accessor* accessor_pos = getAttributeAccessor(model, primitive, "POSITION");
+            if (!accessor_pos) continue;
 
-            for (tinygltf::Primitive primitive : mesh.primitives)
+            // Each primitive is drawn as its own submesh, with the base colour texture of its material.
+            appManager.meshes.emplace_back();
+            Mesh& newMesh = appManager.meshes.back();
+            newMesh.objectIndex = objectIndex;
+            newMesh.instanceCount = static_cast<uint32_t>(instances.size());
+            newMesh.textureID = 0;
+            if (primitive.material != -1)
             {
-                const tinygltf::Accessor accessor_indices = model.accessors[primitive.indices];
-                const tinygltf::BufferView bufferView_indices = model.bufferViews[accessor_indices.bufferView];
-                bufferIndices = reinterpret_cast<uint16_t*>(&model.buffers[bufferView_indices.buffer].data[0] + bufferView_indices.byteOffset);
-
-                Geometry = (Vertex *)malloc(sizeof(Vertex)*accessor_indices.count);
-                numIndices = accessor_indices.count;
-
-                const tinygltf::Accessor accessor_pos = model.accessors[primitive.attributes["POSITION"]];
-                const tinygltf::Accessor accessor_nor = model.accessors[primitive.attributes["NORMAL"]];
-                const tinygltf::Accessor accessor_tex = model.accessors[primitive.attributes["TEXCOORD_0"]];
+                int textureIndex = model.materials[primitive.material].pbrMetallicRoughness.baseColorTexture.index;
+                if (textureIndex != -1) newMesh.textureID = static_cast<uint32_t>(textureIndex);
+            }
 
-                const tinygltf::BufferView bufferView_pos = model.bufferViews[accessor_pos.bufferView];
-                const tinygltf::BufferView bufferView_nor = model.bufferViews[accessor_nor.bufferView];
-                const tinygltf::BufferView bufferView_tex = model.bufferViews[accessor_tex.bufferView];
+            // Reserve the place of the submesh in the shared buffers. It is filled by the decoding threads.
+            PrimitiveDecodeJob job;
+            job.primitive = &primitive;
+            job.meshIndex = static_cast<uint32_t>(appManager.meshes.size() - 1);
+            job.firstVertex = vertexCount;
+            job.vertexCount = static_cast<uint32_t>(accessor_pos->count);
+            job.doubleSided = primitive.material != -1 && model.materials[primitive.material].doubleSided;
+            decodeJobs.push_back(job);
+
+            // The indices use the narrowest type for the vertices of the submesh, and go to the section of that type.
+            const uint32_t primitiveVertices = static_cast<uint32_t>(accessor_pos->count);
+            const uint32_t primitiveIndices = primitive.indices < 0 ? primitiveVertices : static_cast<uint32_t>(model.accessors[primitive.indices].count);
+            newMesh.indexType = _selectIndexType(appManager, primitiveVertices);
+            IndexSection& section = appManager.indexSections[_getIndexSection(newMesh.indexType)];
+            newMesh.firstIndex = section.count;
+            newMesh.vertexOffset = static_cast<int32_t>(vertexCount);
+            newMesh.vertexCount = primitiveIndices;
+            newMesh.lodCount = 1;
+            newMesh.lods[0].firstIndex = newMesh.firstIndex;
+            newMesh.lods[0].indexCount = primitiveIndices;
+            newMesh.lods[0].error = 0.0f;
+            newMesh.firstMeshlet = 0;
+            newMesh.meshletCount = 0;
+
+            vertexCount += primitiveVertices;
+            section.count += primitiveIndices;
+        }
+    }
 
-                const float* buffer_pos = reinterpret_cast<const float*>(&model.buffers[bufferView_pos.buffer].data[0] + bufferView_pos.byteOffset);
-                const float* buffer_nor = reinterpret_cast<const float*>(&model.buffers[bufferView_nor.buffer].data[0] + bufferView_nor.byteOffset);
-                const float* buffer_tex = reinterpret_cast<const float*>(&model.buffers[bufferView_tex.buffer].data[0] + bufferView_tex.byteOffset);
+    // Decode the primitives on the worker threads. They take the next primitive from a shared counter, so a thread that gets
+    // small primitives decodes more of them. Each primitive is optimized by the thread that decodes it.
+    std::chrono::high_resolution_clock::time_point decodeStartTime = std::chrono::high_resolution_clock::now();
 
-                numVertices = accessor_pos.count;
+    vertices.resize(vertexCount);
+    indices.resize(static_cast<size_t>(_layoutIndexSections(appManager)));
+    std::atomic<uint32_t> nextJob(0);
+    std::vector<MeshOptimizeStats> optimizeStats(appManager.workers.threadCount);
 
-                //for (unsigned int i=0; i<accessor_indices.count; i++)
-                for (unsigned int i=0; i<numVertices; i++)
+    _runOnWorkerThreads(appManager, [&](uint32_t threadIndex)
+    {
+        for (uint32_t j = nextJob++; j < decodeJobs.size(); j = nextJob++)
+        {
+            PrimitiveDecodeJob& job = decodeJobs[j];
+            const Mesh& mesh = appManager.meshes[job.meshIndex];
+            uint8_t* meshIndices = _getMeshIndices(appManager, mesh, indices.data());
+            bool validIndices = decodePrimitive(model, *job.primitive, mesh.indexType, &vertices[job.firstVertex], meshIndices, job.boundsMin, job.boundsMax);
+
+            // The bounding sphere encloses the bounding box of the vertices.
+            VEC3 boundsSize = job.boundsMax - job.boundsMin;
+            const float boundsRadius = boundsSize.lenght() * 0.5f;
+            appManager.meshes[job.meshIndex].boundsCenter = (job.boundsMin + job.boundsMax) * 0.5f;
+            appManager.meshes[job.meshIndex].boundsRadius = boundsRadius;
+
+#if OPTIMIZE_MESHES || GENERATE_MESH_LODS || USE_MESHLETS
+            // The optimization, the simplification and the meshlets work on 32-bit indices. The reordering does not change the bounds.
+            if (validIndices && job.primitive->mode == TINYGLTF_MODE_TRIANGLES)
+            {
+                std::vector<uint32_t> triangleIndices(mesh.vertexCount);
+                _readIndices(meshIndices, mesh.indexType, mesh.vertexCount, triangleIndices.data());
+#if OPTIMIZE_MESHES
+                _optimizeMesh(triangleIndices.data(), mesh.vertexCount, &vertices[job.firstVertex], job.vertexCount, optimizeStats[threadIndex]);
+                _writeIndices(triangleIndices.data(), mesh.vertexCount, mesh.indexType, meshIndices);
+#endif
+#if GENERATE_MESH_LODS
+                // The levels are simplified from the optimized mesh, as its vertices are in their final order.
+                _generateMeshLods(triangleIndices.data(), mesh.vertexCount, &vertices[job.firstVertex], job.vertexCount, boundsRadius, job.lods);
+#endif
+#if USE_MESHLETS
+                // The meshlets are runs of the optimized triangles, which already share their vertices.
+                if (mesh.vertexCount / 3 >= MESHLET_MIN_MESH_TRIANGLES)
                 {
-                    Geometry[i].pos.x = buffer_pos[i * 3 + 0]; // VEC3
-                    Geometry[i].pos.y = buffer_pos[i * 3 + 1];
-                    Geometry[i].pos.z = buffer_pos[i * 3 + 2];
-                    Geometry[i].nor.x = buffer_nor[i * 3 + 0]; // VEC3
-                    Geometry[i].nor.y = buffer_nor[i * 3 + 1];
-                    Geometry[i].nor.z = buffer_nor[i * 3 + 2];
-                    Geometry[i].tex.u = buffer_tex[i * 2 + 0]; // VEC2
-                    Geometry[i].tex.v = buffer_tex[i * 2 + 1];
-                }
+                    _buildMeshlets(triangleIndices.data(), mesh.vertexCount, &vertices[job.firstVertex], job.vertexCount, job.meshlets);
 
-                if(primitive.material != -1)
-                {
-                    textureID = model.materials[primitive.material].pbrMetallicRoughness.baseColorTexture.index;
-                    if(textureID == -1) textureID = 0;
+                    // The back faces of a double sided material are visible, so its meshlets are not backface culled.
+                    if (job.doubleSided) for (Meshlet& meshlet : job.meshlets) meshlet.coneCutoff = 1.0f;
                 }
+#endif
             }
+#endif
+        }
+    });
 
-            appManager.meshes.emplace_back();
-            int index = appManager.meshes.size() - 1;
+    double decodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - decodeStartTime).count();
+    Log(false, "GLTF - %u primitives decoded in %.1f ms on %u threads", (unsigned int)decodeJobs.size(), decodeTime, appManager.workers.threadCount);
+
+#if OPTIMIZE_MESHES
+    MeshOptimizeStats totalStats;
+    for (const MeshOptimizeStats& stats : optimizeStats)
+    {
+        totalStats.triangles += stats.triangles;
+        totalStats.vertices += stats.vertices;
+        totalStats.missesBefore += stats.missesBefore;
+        totalStats.missesAfter += stats.missesAfter;
+    }
+    _logMeshOptimizeStats(totalStats);
+#endif
+
+#if GENERATE_MESH_LODS
+    addLodIndices(appManager, decodeJobs, indices);
+#endif
+#if USE_MESHLETS
+    addMeshlets(appManager, decodeJobs);
+#endif
+
+    // The vertices are quantized once the optimization has put them in their final order. The positions of an object are quantized
+    // inside the bounding box of all its submeshes, so they share the dequantization in the per-object data.
+    const size_t objectCount = appManager.objectTransforms.size();
+    PositionQuantization identity;
+    identity.scale = VEC3(1.0f, 1.0f, 1.0f);
+    appManager.objectQuantization.assign(objectCount, identity);
+
+#if USE_COMPACT_VERTEX
+    std::vector<VEC3> objectMin(objectCount, VEC3(FLT_MAX, FLT_MAX, FLT_MAX));
+    std::vector<VEC3> objectMax(objectCount, VEC3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+    for (const PrimitiveDecodeJob& job : decodeJobs)
+    {
+        if (job.vertexCount == 0) continue;
 
-            appManager.meshes[index].textureID = textureID;
+        // The instances of the submesh draw the same vertices, so they get the same quantization.
+        const Mesh& mesh = appManager.meshes[job.meshIndex];
+        for (uint32_t object = mesh.objectIndex; object < mesh.objectIndex + mesh.instanceCount; object++)
+        {
+            objectMin[object] = VEC3(std::min(objectMin[object].x, job.boundsMin.x), std::min(objectMin[object].y, job.boundsMin.y), std::min(objectMin[object].z, job.boundsMin.z));
+            objectMax[object] = VEC3(std::max(objectMax[object].x, job.boundsMax.x), std::max(objectMax[object].y, job.boundsMax.y), std::max(objectMax[object].z, job.boundsMax.z));
+        }
+    }
+    for (size_t i = 0; i < objectCount; i++)
+    {
+        if (objectMin[i].x <= objectMax[i].x) appManager.objectQuantization[i] = _getPositionQuantization(objectMin[i], objectMax[i]);
+    }
 
-            getTransform(appManager.meshes[index].transform, node);
+    std::vector<CompactVertex> drawVertices(vertices.size());
+    nextJob = 0;
+    _runOnWorkerThreads(appManager, [&](uint32_t)
+    {
+        for (uint32_t j = nextJob++; j < decodeJobs.size(); j = nextJob++)
+        {
+            const PrimitiveDecodeJob& job = decodeJobs[j];
+            const PositionQuantization& quantization = appManager.objectQuantization[appManager.meshes[job.meshIndex].objectIndex];
+            _encodeCompactVertices(&vertices[job.firstVertex], job.vertexCount, quantization, &drawVertices[job.firstVertex]);
+        }
+    });
 
-            appManager.meshes[index].indexBuffer.size = sizeof(uint16_t) * numIndices;
-            _createBuffer(appManager, appManager.meshes[index].indexBuffer, reinterpret_cast<uint8_t*>(bufferIndices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    Log(false, "GLTF - %u vertices quantized to %u bytes instead of %u", (unsigned int)vertices.size(),
+        (unsigned int)(sizeof(CompactVertex) * drawVertices.size()), (unsigned int)(sizeof(Vertex) * vertices.size()));
+#else
+    const std::vector<Vertex>& drawVertices = vertices;
+#endif
 
-            appManager.meshes[index].vertexBuffer.size = sizeof(Vertex) * numVertices;
-            _createBuffer(appManager, appManager.meshes[index].vertexBuffer, reinterpret_cast<uint8_t*>(Geometry), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    // The submeshes of all the objects are sorted by what their draws bind, so the direct draws change textures as few times as possible.
+    _sortMeshesByState(appManager);
 
-            appManager.meshes[index].vertexCount = numIndices;
+    if (!vertices.empty())
+    {
+        appManager.indexBuffer.size = indices.size();
+        _createDeviceLocalBuffer(appManager, appManager.indexBuffer, indices.data(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
 
-            free(Geometry);
-        }
+        appManager.vertexBuffer.size = sizeof(DrawVertex) * drawVertices.size();
+        _createDeviceLocalBuffer(appManager, appManager.vertexBuffer, reinterpret_cast<const uint8_t*>(drawVertices.data()), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
     }
 
+    // Cook the scene, so the next runs can skip the parsing and the decoding.
+    _saveMeshCache(appManager, cacheFileName, sourceHash, sourceSize, drawVertices, indices);
+
+    // Submit all the textures and geometry that are still waiting in the staging ring. The upload continues on the GPU while
+    // the application starts rendering, the load time measures the CPU side.
+    _flushStagingBuffer(appManager);
+
+    uint32_t indexCount = 0;
+    for (const IndexSection& section : appManager.indexSections) indexCount += section.count;
+
+    double loadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    Log(false, "GLTF - %u objects, %u submeshes, %u vertices, %u indices, %u textures in %u staging submits, loaded in %.1f ms",
+        (unsigned int)appManager.objectTransforms.size(), (unsigned int)appManager.meshes.size(), (unsigned int)vertices.size(), indexCount, (unsigned int)appManager.textures.size(), appManager.staging.submitCount - firstSubmit, loadTime);
+    _logIndexSections(appManager);
+    _logMeshLods(appManager);
+    _logMeshlets(appManager);
 }
 
 #endif // VKGLTF_H
@@ -0,0 +1,125 @@
+#ifndef VKINDICES_H
+#define VKINDICES_H
+
+#include <cstring>
+#include "vkStructs.h"
+
+// Concept: Index Width
+// The indices of a mesh only have to address its own vertices, because the draw adds vertexOffset to them. A mesh with at most
+// 256 vertices can use 8-bit indices (VK_EXT_index_type_uint8), one with at most 65536 vertices 16-bit indices, and only bigger
+// meshes (scanned or CAD models) need 32 bits. Narrower indices use less memory and less bandwidth in the input assembler.
+// A bound index buffer has a single index type, so the shared index buffer is split in one section per type. The meshes of a
+// section are drawn with the index buffer bound at the offset of the section, and their firstIndex is relative to it.
+
+/// <summary>Returns the size in bytes of an index type</summary>
+inline uint32_t _getIndexSize(VkIndexType indexType)
+{
+    switch (indexType)
+    {
+    case VK_INDEX_TYPE_UINT8_EXT: return 1;
+    case VK_INDEX_TYPE_UINT32:    return 4;
+    default:                      return 2;
+    }
+}
+
+/// <summary>Returns the section of the index buffer (in appManager.indexSections) that holds the indices of a type</summary>
+inline uint32_t _getIndexSection(VkIndexType indexType)
+{
+    switch (indexType)
+    {
+    case VK_INDEX_TYPE_UINT8_EXT: return 0;
+    case VK_INDEX_TYPE_UINT32:    return 2;
+    default:                      return 1;
+    }
+}
+
+/// <summary>Returns the narrowest index type that can address the vertices of a mesh</summary>
+inline VkIndexType _selectIndexType(AppManager& appManager, uint32_t vertexCount)
+{
+    if (vertexCount <= 0x100 && appManager.supportsIndexTypeUint8) return VK_INDEX_TYPE_UINT8_EXT;
+    if (vertexCount <= 0x10000) return VK_INDEX_TYPE_UINT16;
+    return VK_INDEX_TYPE_UINT32;
+}
+
+/// <summary>Resets the sections of the index buffer before the meshes are added to them</summary>
+inline void _initIndexSections(AppManager& appManager)
+{
+    const VkIndexType types[INDEX_SECTION_COUNT] = { VK_INDEX_TYPE_UINT8_EXT, VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32 };
+    for (uint32_t s = 0; s < INDEX_SECTION_COUNT; s++)
+    {
+        appManager.indexSections[s].type = types[s];
+        appManager.indexSections[s].offset = 0;
+        appManager.indexSections[s].count = 0;
+    }
+}
+
+/// <summary>Places the sections one after the other, once the number of indices of each one is known</summary>
+/// <returns>Size of the index buffer in bytes</returns>
+inline VkDeviceSize _layoutIndexSections(AppManager& appManager)
+{
+    // The offset of vkCmdBindIndexBuffer must be a multiple of the index size. Aligning every section to 4 bytes covers all the types.
+    VkDeviceSize size = 0;
+    for (uint32_t s = 0; s < INDEX_SECTION_COUNT; s++)
+    {
+        IndexSection& section = appManager.indexSections[s];
+        section.offset = _getAlignedDataSize(static_cast<size_t>(size), 4);
+        size = section.offset + static_cast<VkDeviceSize>(section.count) * _getIndexSize(section.type);
+    }
+    return size;
+}
+
+/// <summary>Returns where the indices of a mesh start in the index buffer data</summary>
+inline uint8_t* _getMeshIndices(AppManager& appManager, const Mesh& mesh, uint8_t* indexData)
+{
+    const IndexSection& section = appManager.indexSections[_getIndexSection(mesh.indexType)];
+    return indexData + section.offset + static_cast<size_t>(mesh.firstIndex) * _getIndexSize(mesh.indexType);
+}
+
+/// <summary>Reads count indices of a type and writes them to out as 32-bit indices</summary>
+inline void _readIndices(const uint8_t* data, VkIndexType indexType, size_t count, uint32_t* out)
+{
+    const size_t indexSize = _getIndexSize(indexType);
+    if (indexSize == sizeof(uint32_t)) { memcpy(out, data, sizeof(uint32_t) * count); return; }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = 0;
+        memcpy(out + i, data + i * indexSize, indexSize); // Little endian.
+    }
+}
+
+/// <summary>Writes count 32-bit indices to out as indices of a type. The values have to fit in the type.</summary>
+inline void _writeIndices(const uint32_t* indices, size_t count, VkIndexType indexType, uint8_t* out)
+{
+    const size_t indexSize = _getIndexSize(indexType);
+    if (indexSize == sizeof(uint32_t)) { memcpy(out, indices, sizeof(uint32_t) * count); return; }
+
+    for (size_t i = 0; i < count; i++) memcpy(out + i * indexSize, indices + i, indexSize); // Little endian.
+}
+
+/// <summary>Binds the section of the index buffer of an index type</summary>
+inline void _bindIndexBuffer(AppManager& appManager, VkCommandBuffer cmdBuffer, VkIndexType indexType)
+{
+    const IndexSection& section = appManager.indexSections[_getIndexSection(indexType)];
+    vk::CmdBindIndexBuffer(cmdBuffer, appManager.indexBuffer.buffer, section.offset, section.type);
+}
+
+/// <summary>Logs how many meshes and indices use each index type, and the memory saved compared to 32-bit indices</summary>
+inline void _logIndexSections(AppManager& appManager)
+{
+    uint32_t meshCount[INDEX_SECTION_COUNT] = {};
+    for (const Mesh& mesh : appManager.meshes) meshCount[_getIndexSection(mesh.indexType)]++;
+
+    uint64_t size = 0, size32 = 0;
+    for (uint32_t s = 0; s < INDEX_SECTION_COUNT; s++)
+    {
+        size += static_cast<uint64_t>(appManager.indexSections[s].count) * _getIndexSize(appManager.indexSections[s].type);
+        size32 += static_cast<uint64_t>(appManager.indexSections[s].count) * 4;
+    }
+
+    Log(false, "Indices: %u meshes with 8 bits%s, %u with 16 bits, %u with 32 bits; %llu bytes instead of %llu", meshCount[0],
+        appManager.supportsIndexTypeUint8 ? "" : " (VK_EXT_index_type_uint8 not supported)", meshCount[1], meshCount[2],
+        (unsigned long long)size, (unsigned long long)size32);
+}
+
+#endif // VKINDICES_H
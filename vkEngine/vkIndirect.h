@@ -0,0 +1,242 @@
+#ifndef VKINDIRECT_H
+#define VKINDIRECT_H
+
+#include <algorithm>
+#include "vkStructs.h"
+#include "vkMemory.h"
+#include "vkStaging.h"
+#include "vkIndices.h"
+
+// Concept: Indirect Drawing
+// With indirect drawing the parameters of the draw calls (index count, first index, vertex offset...) are not passed by the CPU
+// while recording, but read by the GPU from a buffer of VkDrawIndexedIndirectCommand records. A single vkCmdDrawIndexedIndirect
+// can issue many draws (multiDrawIndirect feature), so recording cost no longer depends on the number of meshes.
+// Since the draws cannot change the bound descriptor sets between them, the per-object data (matrix, light) is fetched in the vertex shader
+// from a storage buffer indexed by gl_InstanceIndex, which is the firstInstance of each draw. The draws are grouped by index type and
+// texture, and each group binds its section of the index buffer (when it changes) and its texture before being drawn.
+// Instancing: the objects of the nodes that share a glTF mesh are consecutive, so a single draw with an instance count covers them
+// all. The vertex shader finds the object of each instance in the instance buffer, at gl_InstanceIndex. Without GPU culling that
+// buffer maps every object to itself, and the draws start at the object of their first instance. With GPU culling each draw has
+// a range of the buffer where the culling writes the objects of its visible instances every frame, and every level of detail of
+// a mesh is a draw of its own, so each instance is drawn at its own level (see vkCulling.h).
+
+/// <summary>Returns true if mesh a is drawn before mesh b: the meshes are sorted by index type, then by texture</summary>
+inline bool _isMeshDrawnBefore(const Mesh& a, const Mesh& b)
+{
+    uint32_t sectionA = _getIndexSection(a.indexType), sectionB = _getIndexSection(b.indexType);
+    return sectionA != sectionB ? sectionA < sectionB : a.textureID < b.textureID;
+}
+
+/// <summary>Sorts the meshes in draw order, so the direct draws bind each section of the index buffer and each texture once</summary>
+inline void _sortMeshesByState(AppManager& appManager)
+{
+    std::stable_sort(appManager.meshes.begin(), appManager.meshes.end(), _isMeshDrawnBefore);
+}
+
+/// <summary>Returns true if the indirect draws can be culled by the compute shader of vkCulling.h</summary>
+inline bool _canUseGpuCulling(AppManager& appManager)
+{
+    // The compute pass is recorded in the graphics command buffers, so the graphics queue has to support compute.
+    bool queueSupportsCompute = (appManager.queueFamilyProperties[appManager.graphicsQueueFamilyIndex].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+    return USE_GPU_CULLING && appManager.useIndirectDraw && queueSupportsCompute;
+}
+
+/// <summary>Creates the instance buffer of the draws that are not culled: every instance draws its own object</summary>
+inline void _createStaticInstanceBuffer(AppManager& appManager)
+{
+    std::vector<uint32_t> instanceObjects(std::max(appManager.objectTransforms.size(), size_t(1)), 0);
+    for (uint32_t i = 0; i < appManager.objectTransforms.size(); i++) instanceObjects[i] = i;
+
+    appManager.instanceSliceSize = 0;
+    appManager.instanceBuffer.size = sizeof(uint32_t) * instanceObjects.size();
+    _createDeviceLocalBuffer(appManager, appManager.instanceBuffer, reinterpret_cast<uint8_t*>(instanceObjects.data()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    appManager.instanceBuffer.bufferInfo.range = appManager.instanceBuffer.size;
+}
+
+/// <summary>Builds the indirect draw buffer, one command per mesh sorted by index type and texture, and uploads it to device local memory.
+/// With GPU culling a mesh has one command per level of detail, followed by one per meshlet. Also creates the instance buffer.</summary>
+inline void _initIndirectDraws(AppManager& appManager)
+{
+    // gl_InstanceIndex only carries the mesh index if the device accepts a non-zero firstInstance in indirect commands.
+    appManager.useIndirectDraw = USE_INDIRECT_DRAW && appManager.deviceFeatures.drawIndirectFirstInstance && !appManager.meshes.empty();
+
+    if (!appManager.useIndirectDraw)
+    {
+        // The meshes with several instances are drawn with the indirect pipeline too, by one vkCmdDrawIndexed whose firstInstance is
+        // their first object (a non-zero firstInstance is always allowed in direct draws).
+        uint32_t instancedMeshes = 0;
+        for (const Mesh& mesh : appManager.meshes) instancedMeshes += mesh.instanceCount > 1 ? 1 : 0;
+
+        appManager.useIndirectPipeline = instancedMeshes > 0;
+        if (appManager.useIndirectPipeline)
+        {
+            _createStaticInstanceBuffer(appManager);
+            _flushStagingBuffer(appManager);
+        }
+
+        Log(false, "Draw path: direct, one vkCmdDrawIndexed per mesh, %u meshes with several instances drawn instanced", instancedMeshes);
+        return;
+    }
+    appManager.useIndirectPipeline = true;
+
+    // Sort the mesh indices by index type and texture so each section of the index buffer and each texture is bound once.
+    std::vector<uint32_t> order(appManager.meshes.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&appManager](uint32_t a, uint32_t b) {
+        return _isMeshDrawnBefore(appManager.meshes[a], appManager.meshes[b]);
+    });
+
+    // Only the culling pass knows which level of detail each instance needs, and when to draw the meshlets instead of their mesh,
+    // so without it the meshes are drawn whole at full detail.
+    const bool culled = _canUseGpuCulling(appManager);
+    appManager.useMeshletDraws = USE_MESHLETS && culled && !appManager.meshlets.empty();
+
+    std::vector<VkDrawIndexedIndirectCommand>& commands = appManager.drawCommands;
+    commands.clear();
+    appManager.drawMeshes.clear();
+    appManager.drawMeshlets.clear();
+    appManager.drawLods.clear();
+    appManager.drawGroups.clear();
+
+    uint32_t instanceCount = 0;
+    for (uint32_t i = 0; i < order.size(); i++)
+    {
+        const Mesh& mesh = appManager.meshes[order[i]];
+
+        if (appManager.drawGroups.empty() || appManager.drawGroups.back().textureID != mesh.textureID ||
+            appManager.drawGroups.back().indexType != mesh.indexType)
+        {
+            appManager.drawGroups.push_back({ mesh.indexType, mesh.textureID, static_cast<uint32_t>(commands.size()), 0 });
+        }
+        const size_t firstCommand = commands.size();
+
+        VkDrawIndexedIndirectCommand command;
+        command.instanceCount = mesh.instanceCount;
+        command.vertexOffset = mesh.vertexOffset;
+        command.firstInstance = mesh.objectIndex; // Index of the first instance in the instance buffer.
+
+        // The full detail level is drawn by the meshlets, if the mesh has them.
+        const uint32_t meshletCount = appManager.useMeshletDraws ? mesh.meshletCount : 0;
+        const uint32_t lodCount = culled ? mesh.lodCount : 1;
+        for (uint32_t l = meshletCount > 0 ? 1 : 0; l < lodCount; l++)
+        {
+            command.indexCount = mesh.lods[l].indexCount;
+            command.firstIndex = mesh.lods[l].firstIndex;
+
+            commands.push_back(command);
+            appManager.drawMeshes.push_back(order[i]);
+            appManager.drawMeshlets.push_back(NO_MESHLET);
+            appManager.drawLods.push_back(l);
+        }
+
+        // The meshlets draw the same vertices and objects as the mesh, with a part of its indices.
+        for (uint32_t m = mesh.firstMeshlet; m < mesh.firstMeshlet + meshletCount; m++)
+        {
+            command.indexCount = appManager.meshlets[m].indexCount;
+            command.firstIndex = appManager.meshlets[m].firstIndex;
+
+            commands.push_back(command);
+            appManager.drawMeshes.push_back(order[i]);
+            appManager.drawMeshlets.push_back(m);
+            appManager.drawLods.push_back(0);
+        }
+
+        appManager.drawGroups.back().drawCount += static_cast<uint32_t>(commands.size() - firstCommand);
+        instanceCount += mesh.instanceCount;
+    }
+
+    if (culled)
+    {
+        // Each draw has a range of the slice as long as its instance count, so all its instances fit even if they are all visible.
+        uint32_t instanceSlots = 0;
+        for (const VkDrawIndexedIndirectCommand& command : commands) instanceSlots += command.instanceCount;
+
+        const size_t storageAlignment = static_cast<size_t>(appManager.deviceProperties.limits.minStorageBufferOffsetAlignment);
+        appManager.instanceSliceSize = _getAlignedDataSize(sizeof(uint32_t) * std::max(instanceSlots, 1u), storageAlignment);
+        appManager.instanceBuffer.size = static_cast<size_t>(appManager.instanceSliceSize * MAX_FRAMES_IN_FLIGHT);
+        _createBuffer(appManager, appManager.instanceBuffer, nullptr, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        appManager.instanceBuffer.bufferInfo.range = appManager.instanceSliceSize;
+    }
+    else
+    {
+        _createStaticInstanceBuffer(appManager);
+    }
+
+    appManager.indirectBuffer.size = sizeof(VkDrawIndexedIndirectCommand) * commands.size();
+    // The buffer is also the input of the culling compute shader.
+    _createDeviceLocalBuffer(appManager, appManager.indirectBuffer, reinterpret_cast<uint8_t*>(commands.data()), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    _flushStagingBuffer(appManager);
+
+    Log(false, "Draw path: indirect, %u draws for %u submeshes and %u instances in %u index type and texture groups, %s", (unsigned int)commands.size(),
+        (unsigned int)order.size(), instanceCount, (unsigned int)appManager.drawGroups.size(),
+        appManager.deviceFeatures.multiDrawIndirect ? "one vkCmdDrawIndexedIndirect per group" : "no multiDrawIndirect, one vkCmdDrawIndexedIndirect per draw");
+}
+
+/// <summary>Records the draws of a range of texture groups using the indirect buffer</summary>
+/// <param name="cmdBuffer">Command buffer to record to, inside the render pass</param>
+/// <param name="frameIndex">Frame in flight being recorded, selects the per-object data and culling slices</param>
+/// <param name="firstGroup">First draw group to record</param>
+/// <param name="groupCount">Number of draw groups to record</param>
+inline void _recordIndirectDraws(AppManager& appManager, VkCommandBuffer cmdBuffer, uint32_t frameIndex, uint32_t firstGroup, uint32_t groupCount)
+{
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    const uint32_t dynamicOffsets[3] = {
+        static_cast<uint32_t>(appManager.dynamicUniformBufferData.bufferInfo.range * frameIndex),
+        static_cast<uint32_t>(appManager.frameUniformBufferData.bufferInfo.range * frameIndex),
+        static_cast<uint32_t>(appManager.instanceSliceSize * frameIndex),
+    };
+
+    // With GPU culling the draws come from the output of the compute shader.
+    VkBuffer drawBuffer = appManager.indirectBuffer.buffer;
+    VkDeviceSize drawBufferOffset = 0;
+    if (appManager.useGpuCulling)
+    {
+        drawBuffer = appManager.culling.drawBuffer.buffer;
+        drawBufferOffset = appManager.culling.drawSliceSize * frameIndex;
+    }
+
+    vk::CmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.indirectPipeline);
+
+    // The per-object storage buffer, the per-frame uniform buffer and the instance buffer are the same for all the draws.
+    vk::CmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.indirectPipelineLayout, 1, 1, &appManager.indirectDescSet, 3, dynamicOffsets);
+
+    VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    for (uint32_t g = firstGroup; g < firstGroup + groupCount; g++)
+    {
+        const DrawGroup& group = appManager.drawGroups[g];
+
+        // The groups are split by texture, a group waits for its texture to be uploaded.
+        if (!_isTextureResident(appManager, group.textureID)) continue;
+
+        if (group.indexType != boundIndexType)
+        {
+            _bindIndexBuffer(appManager, cmdBuffer, group.indexType);
+            boundIndexType = group.indexType;
+        }
+
+        vk::CmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, appManager.indirectPipelineLayout, 0, 1, &appManager.staticDescSet[group.textureID], 0, nullptr);
+
+        VkDeviceSize offset = drawBufferOffset + static_cast<VkDeviceSize>(group.firstDraw) * stride;
+
+        if (appManager.useGpuCulling && appManager.culling.compact)
+        {
+            // The number of visible draws of the group is read from the counter written by the culling pass.
+            VkDeviceSize countOffset = appManager.culling.countSliceSize * frameIndex + g * sizeof(uint32_t);
+            vk::CmdDrawIndexedIndirectCountKHR(cmdBuffer, drawBuffer, offset, appManager.culling.countBuffer.buffer, countOffset, group.drawCount, stride);
+        }
+        else if (appManager.deviceFeatures.multiDrawIndirect)
+        {
+            vk::CmdDrawIndexedIndirect(cmdBuffer, drawBuffer, offset, group.drawCount, stride);
+        }
+        else
+        {
+            // Without multiDrawIndirect, drawCount must be 0 or 1.
+            for (uint32_t i = 0; i < group.drawCount; i++)
+            {
+                vk::CmdDrawIndexedIndirect(cmdBuffer, drawBuffer, offset + i * stride, 1, stride);
+            }
+        }
+    }
+}
+
+#endif // VKINDIRECT_H
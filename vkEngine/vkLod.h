@@ -0,0 +1,77 @@
+#ifndef VKLOD_H
+#define VKLOD_H
+
+#include <algorithm>
+#include <cmath>
+#include "vkStructs.h"
+
+// Concept: Level of Detail Selection
+// Each mesh has up to MAX_MESH_LODS index ranges (see vkSimplify.h), each one with the error of its simplification relative to the
+// radius of the mesh. Every frame the bounding sphere of the mesh is projected on the screen: its radius in pixels multiplied by
+// the relative error of a level is the error of that level in pixels. The coarsest level with at most LOD_PIXEL_ERROR pixels
+// of error is drawn, so the triangles drawn fall with the distance while the image stays the same.
+// The direct draws select the level on the CPU while recording. The indirect draws select it in the culling compute shader, for
+// each instance, which has the same data: the model matrix of the object and the camera in the per-frame uniform buffer.
+
+/// <summary>Sets the camera used to select the levels of detail of the next frames</summary>
+/// <param name="position">Camera in world space</param>
+/// <param name="yfov">Vertical field of view, in radians</param>
+/// <param name="viewportHeight">Height of the viewport, in pixels</param>
+inline void _setLodCamera(AppManager& appManager, const VEC3& position, float yfov, float viewportHeight)
+{
+    appManager.lodCamera.position = position;
+    appManager.lodCamera.pixelsPerUnit = viewportHeight / (2.0f * std::tan(yfov * 0.5f));
+}
+
+/// <summary>Returns the level of detail to draw a mesh with, from the projected size of its bounding sphere</summary>
+/// <param name="modelMatrix">Model matrix of the object of the mesh</param>
+inline uint32_t _selectMeshLod(const LodCamera& camera, const Mesh& mesh, const MATRIX& modelMatrix)
+{
+    if (mesh.lodCount <= 1 || camera.pixelsPerUnit <= 0.0f) return 0;
+
+    // The rows of the model matrix are the scaled axes of the object (row vector convention), and the last one its translation.
+    const float* m = modelMatrix.f;
+    const VEC3& c = mesh.boundsCenter;
+    VEC3 center(c.x * m[0] + c.y * m[4] + c.z * m[8] + m[12],
+                c.x * m[1] + c.y * m[5] + c.z * m[9] + m[13],
+                c.x * m[2] + c.y * m[6] + c.z * m[10] + m[14]);
+
+    float scale = 0.0f;
+    for (int row = 0; row < 3; row++) scale = std::max(scale, m[row * 4] * m[row * 4] + m[row * 4 + 1] * m[row * 4 + 1] + m[row * 4 + 2] * m[row * 4 + 2]);
+    const float radius = mesh.boundsRadius * std::sqrt(scale);
+
+    // Radius of the sphere on the screen, in pixels. Inside the sphere the mesh is drawn at full detail.
+    VEC3 toCamera = center - camera.position;
+    const float distance = toCamera.lenght() - radius;
+    if (distance <= 0.0f) return 0;
+    const float projectedRadius = radius * camera.pixelsPerUnit / distance;
+
+    uint32_t lod = 0;
+    while (lod + 1 < mesh.lodCount && mesh.lods[lod + 1].error * projectedRadius <= LOD_PIXEL_ERROR) lod++;
+    return lod;
+}
+
+/// <summary>Logs the number of triangles of each level of detail of all the meshes</summary>
+inline void _logMeshLods(AppManager& appManager)
+{
+    uint64_t triangles[MAX_MESH_LODS] = {}, fullTriangles[MAX_MESH_LODS] = {};
+    uint32_t meshCount[MAX_MESH_LODS] = {};
+    for (const Mesh& mesh : appManager.meshes)
+    {
+        for (uint32_t l = 0; l < mesh.lodCount; l++)
+        {
+            triangles[l] += mesh.lods[l].indexCount / 3;
+            fullTriangles[l] += mesh.lods[0].indexCount / 3;
+            meshCount[l]++;
+        }
+    }
+
+    for (uint32_t l = 1; l < MAX_MESH_LODS; l++)
+    {
+        if (meshCount[l] == 0) break;
+        Log(false, "LOD %u: %u meshes, %llu triangles (%llu at full detail)", l, meshCount[l], (unsigned long long)triangles[l], (unsigned long long)fullTriangles[l]);
+    }
+    if (meshCount[1] == 0) Log(false, "LOD: no mesh has levels of detail");
+}
+
+#endif // VKLOD_H
@@ -4,9 +4,104 @@
 #include <math.h>
 #include <string.h>
 #include <assert.h>
+#include <float.h>
+
+// SIMD implementations of the MATRIX kernels, chosen at compile time. Define VKMATH_NO_SIMD to force the scalar code.
+// AVX is used if the compiler targets it (/arch:AVX, -mavx), SSE is always available on x64. NEON is used on ARM.
+#if defined(VKMATH_NO_SIMD)
+#elif defined(__AVX__)
+#define VKMATH_AVX 1
+#define VKMATH_SSE 1
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define VKMATH_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VKMATH_NEON 1
+#include <arm_neon.h>
+#endif
 
 const float PI = 3.14159265359f;
 
+#if defined(VKMATH_SSE)
+// Cross product of the xyz components, w is 0.
+inline __m128 _crossSSE(__m128 a, __m128 b)
+{
+    __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// Dot product of the four components, broadcast to all of them.
+inline __m128 _dotSSE(__m128 a, __m128 b)
+{
+    __m128 m = _mm_mul_ps(a, b);
+    __m128 s = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+#endif
+
+// FLOAT4: four floats processed together, used by the structure of arrays kernels (see vkTransforms.h).
+// Each lane usually belongs to a different object, so the same code runs four objects at a time.
+#if defined(VKMATH_SSE)
+typedef __m128 FLOAT4;
+inline FLOAT4 f4Load(const float* p) { return _mm_loadu_ps(p); }
+inline void f4Store(float* p, FLOAT4 a) { _mm_storeu_ps(p, a); }
+inline FLOAT4 f4Set(float f) { return _mm_set1_ps(f); }
+inline FLOAT4 f4Add(FLOAT4 a, FLOAT4 b) { return _mm_add_ps(a, b); }
+inline FLOAT4 f4Sub(FLOAT4 a, FLOAT4 b) { return _mm_sub_ps(a, b); }
+inline FLOAT4 f4Mul(FLOAT4 a, FLOAT4 b) { return _mm_mul_ps(a, b); }
+inline FLOAT4 f4Div(FLOAT4 a, FLOAT4 b) { return _mm_div_ps(a, b); }
+inline FLOAT4 f4Max(FLOAT4 a, FLOAT4 b) { return _mm_max_ps(a, b); }
+inline void f4Transpose(FLOAT4& r0, FLOAT4& r1, FLOAT4& r2, FLOAT4& r3) { _MM_TRANSPOSE4_PS(r0, r1, r2, r3); }
+#elif defined(VKMATH_NEON)
+typedef float32x4_t FLOAT4;
+inline FLOAT4 f4Load(const float* p) { return vld1q_f32(p); }
+inline void f4Store(float* p, FLOAT4 a) { vst1q_f32(p, a); }
+inline FLOAT4 f4Set(float f) { return vdupq_n_f32(f); }
+inline FLOAT4 f4Add(FLOAT4 a, FLOAT4 b) { return vaddq_f32(a, b); }
+inline FLOAT4 f4Sub(FLOAT4 a, FLOAT4 b) { return vsubq_f32(a, b); }
+inline FLOAT4 f4Mul(FLOAT4 a, FLOAT4 b) { return vmulq_f32(a, b); }
+inline FLOAT4 f4Max(FLOAT4 a, FLOAT4 b) { return vmaxq_f32(a, b); }
+#if defined(__aarch64__)
+inline FLOAT4 f4Div(FLOAT4 a, FLOAT4 b) { return vdivq_f32(a, b); }
+#else
+// ARMv7 has no vector division: reciprocal estimate refined with two Newton-Raphson steps.
+inline FLOAT4 f4Div(FLOAT4 a, FLOAT4 b)
+{
+    FLOAT4 r = vrecpeq_f32(b);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    return vmulq_f32(a, r);
+}
+#endif
+inline void f4Transpose(FLOAT4& r0, FLOAT4& r1, FLOAT4& r2, FLOAT4& r3)
+{
+    float32x4x2_t t01 = vtrnq_f32(r0, r1);
+    float32x4x2_t t23 = vtrnq_f32(r2, r3);
+    r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+#else
+struct FLOAT4 { float v[4]; };
+inline FLOAT4 f4Load(const float* p) { FLOAT4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+inline void f4Store(float* p, FLOAT4 a) { memcpy(p, a.v, sizeof(a.v)); }
+inline FLOAT4 f4Set(float f) { FLOAT4 r = { { f, f, f, f } }; return r; }
+inline FLOAT4 f4Add(FLOAT4 a, FLOAT4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+inline FLOAT4 f4Sub(FLOAT4 a, FLOAT4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+inline FLOAT4 f4Mul(FLOAT4 a, FLOAT4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+inline FLOAT4 f4Div(FLOAT4 a, FLOAT4 b) { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+inline FLOAT4 f4Max(FLOAT4 a, FLOAT4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+inline void f4Transpose(FLOAT4& r0, FLOAT4& r1, FLOAT4& r2, FLOAT4& r3)
+{
+    FLOAT4 t[4] = { r0, r1, r2, r3 };
+    for (int i = 0; i < 4; i++) { r0.v[i] = t[i].v[0]; r1.v[i] = t[i].v[1]; r2.v[i] = t[i].v[2]; r3.v[i] = t[i].v[3]; }
+}
+#endif
+
 static const float fIdentity[16] = {
     1.0f, 0.0f, 0.0f, 0.0f,
     0.0f, 1.0f, 0.0f, 0.0f,
@@ -141,32 +236,96 @@ void identity()
     this->f[ 3]=0.0f;	this->f[ 7]=0.0f;	this->f[11]=0.0f;	this->f[15]=1.0f;
 };
 
+// this = this * m. Row i of the result is the sum of the rows of m weighted by row i of this.
 void multiply(const MATRIX &m)
 {
-    MATRIX mOut;
+#if defined(VKMATH_AVX)
+    // Two rows per register. The rows of m are duplicated in both halves and each element of this is broadcast within its half.
+    __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.f[ 0]));
+    __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.f[ 4]));
+    __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.f[ 8]));
+    __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.f[12]));
+    __m256 a01 = _mm256_loadu_ps(&this->f[0]);
+    __m256 a23 = _mm256_loadu_ps(&this->f[8]);
+
+    __m256 o01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+    o01 = _mm256_add_ps(o01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1));
+    o01 = _mm256_add_ps(o01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xAA), b2));
+    o01 = _mm256_add_ps(o01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xFF), b3));
+
+    __m256 o23 = _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x00), b0);
+    o23 = _mm256_add_ps(o23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x55), b1));
+    o23 = _mm256_add_ps(o23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xAA), b2));
+    o23 = _mm256_add_ps(o23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xFF), b3));
+
+    _mm256_storeu_ps(&this->f[0], o01);
+    _mm256_storeu_ps(&this->f[8], o23);
+#elif defined(VKMATH_SSE)
+    __m128 b0 = _mm_loadu_ps(&m.f[ 0]);
+    __m128 b1 = _mm_loadu_ps(&m.f[ 4]);
+    __m128 b2 = _mm_loadu_ps(&m.f[ 8]);
+    __m128 b3 = _mm_loadu_ps(&m.f[12]);
+
+    // All the rows are computed before storing, m can be this.
+    __m128 o[4];
+    for (int i = 0; i < 4; i++)
+    {
+        __m128 a = _mm_loadu_ps(&this->f[i * 4]);
+        o[i] = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+        o[i] = _mm_add_ps(o[i], _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+        o[i] = _mm_add_ps(o[i], _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+        o[i] = _mm_add_ps(o[i], _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+    }
+    for (int i = 0; i < 4; i++) _mm_storeu_ps(&this->f[i * 4], o[i]);
+#elif defined(VKMATH_NEON)
+    float32x4_t b0 = vld1q_f32(&m.f[ 0]);
+    float32x4_t b1 = vld1q_f32(&m.f[ 4]);
+    float32x4_t b2 = vld1q_f32(&m.f[ 8]);
+    float32x4_t b3 = vld1q_f32(&m.f[12]);
+
+    // All the rows are computed before storing, m can be this.
+    float32x4_t o[4];
+    for (int i = 0; i < 4; i++)
+    {
+        o[i] = vmulq_n_f32(b0, this->f[i * 4 + 0]);
+        o[i] = vmlaq_n_f32(o[i], b1, this->f[i * 4 + 1]);
+        o[i] = vmlaq_n_f32(o[i], b2, this->f[i * 4 + 2]);
+        o[i] = vmlaq_n_f32(o[i], b3, this->f[i * 4 + 3]);
+    }
+    for (int i = 0; i < 4; i++) vst1q_f32(&this->f[i * 4], o[i]);
+#else
+    multiplyScalar(m);
+#endif
+};
 
-    /* Perform calculation on a dummy  (mRet) */
-    mOut.f[ 0] = this->f[ 0]*m.f[ 0] + this->f[ 1]*m.f[ 4] + this->f[ 2]*m.f[ 8] + this->f[ 3]*m.f[12];
-    mOut.f[ 1] = this->f[ 0]*m.f[ 1] + this->f[ 1]*m.f[ 5] + this->f[ 2]*m.f[ 9] + this->f[ 3]*m.f[13];
-    mOut.f[ 2] = this->f[ 0]*m.f[ 2] + this->f[ 1]*m.f[ 6] + this->f[ 2]*m.f[10] + this->f[ 3]*m.f[14];
-    mOut.f[ 3] = this->f[ 0]*m.f[ 3] + this->f[ 1]*m.f[ 7] + this->f[ 2]*m.f[11] + this->f[ 3]*m.f[15];
-
-    mOut.f[ 4] = this->f[ 4]*m.f[ 0] + this->f[ 5]*m.f[ 4] + this->f[ 6]*m.f[ 8] + this->f[ 7]*m.f[12];
-    mOut.f[ 5] = this->f[ 4]*m.f[ 1] + this->f[ 5]*m.f[ 5] + this->f[ 6]*m.f[ 9] + this->f[ 7]*m.f[13];
-    mOut.f[ 6] = this->f[ 4]*m.f[ 2] + this->f[ 5]*m.f[ 6] + this->f[ 6]*m.f[10] + this->f[ 7]*m.f[14];
-    mOut.f[ 7] = this->f[ 4]*m.f[ 3] + this->f[ 5]*m.f[ 7] + this->f[ 6]*m.f[11] + this->f[ 7]*m.f[15];
-
-    mOut.f[ 8] = this->f[ 8]*m.f[ 0] + this->f[ 9]*m.f[ 4] + this->f[10]*m.f[ 8] + this->f[11]*m.f[12];
-    mOut.f[ 9] = this->f[ 8]*m.f[ 1] + this->f[ 9]*m.f[ 5] + this->f[10]*m.f[ 9] + this->f[11]*m.f[13];
-    mOut.f[10] = this->f[ 8]*m.f[ 2] + this->f[ 9]*m.f[ 6] + this->f[10]*m.f[10] + this->f[11]*m.f[14];
-    mOut.f[11] = this->f[ 8]*m.f[ 3] + this->f[ 9]*m.f[ 7] + this->f[10]*m.f[11] + this->f[11]*m.f[15];
-
-    mOut.f[12] = this->f[12]*m.f[ 0] + this->f[13]*m.f[ 4] + this->f[14]*m.f[ 8] + this->f[15]*m.f[12];
-    mOut.f[13] = this->f[12]*m.f[ 1] + this->f[13]*m.f[ 5] + this->f[14]*m.f[ 9] + this->f[15]*m.f[13];
-    mOut.f[14] = this->f[12]*m.f[ 2] + this->f[13]*m.f[ 6] + this->f[14]*m.f[10] + this->f[15]*m.f[14];
-    mOut.f[15] = this->f[12]*m.f[ 3] + this->f[13]*m.f[ 7] + this->f[14]*m.f[11] + this->f[15]*m.f[15];
+// Reference implementation of multiply, always scalar.
+void multiplyScalar(const MATRIX &m)
+{
+    // A plain array, a MATRIX would be set to identity first.
+    float mOut[16];
 
-    memcpy(this->f, mOut.f, sizeof(mOut.f));
+    /* Perform calculation on a dummy  (mRet) */
+    mOut[ 0] = this->f[ 0]*m.f[ 0] + this->f[ 1]*m.f[ 4] + this->f[ 2]*m.f[ 8] + this->f[ 3]*m.f[12];
+    mOut[ 1] = this->f[ 0]*m.f[ 1] + this->f[ 1]*m.f[ 5] + this->f[ 2]*m.f[ 9] + this->f[ 3]*m.f[13];
+    mOut[ 2] = this->f[ 0]*m.f[ 2] + this->f[ 1]*m.f[ 6] + this->f[ 2]*m.f[10] + this->f[ 3]*m.f[14];
+    mOut[ 3] = this->f[ 0]*m.f[ 3] + this->f[ 1]*m.f[ 7] + this->f[ 2]*m.f[11] + this->f[ 3]*m.f[15];
+
+    mOut[ 4] = this->f[ 4]*m.f[ 0] + this->f[ 5]*m.f[ 4] + this->f[ 6]*m.f[ 8] + this->f[ 7]*m.f[12];
+    mOut[ 5] = this->f[ 4]*m.f[ 1] + this->f[ 5]*m.f[ 5] + this->f[ 6]*m.f[ 9] + this->f[ 7]*m.f[13];
+    mOut[ 6] = this->f[ 4]*m.f[ 2] + this->f[ 5]*m.f[ 6] + this->f[ 6]*m.f[10] + this->f[ 7]*m.f[14];
+    mOut[ 7] = this->f[ 4]*m.f[ 3] + this->f[ 5]*m.f[ 7] + this->f[ 6]*m.f[11] + this->f[ 7]*m.f[15];
+
+    mOut[ 8] = this->f[ 8]*m.f[ 0] + this->f[ 9]*m.f[ 4] + this->f[10]*m.f[ 8] + this->f[11]*m.f[12];
+    mOut[ 9] = this->f[ 8]*m.f[ 1] + this->f[ 9]*m.f[ 5] + this->f[10]*m.f[ 9] + this->f[11]*m.f[13];
+    mOut[10] = this->f[ 8]*m.f[ 2] + this->f[ 9]*m.f[ 6] + this->f[10]*m.f[10] + this->f[11]*m.f[14];
+    mOut[11] = this->f[ 8]*m.f[ 3] + this->f[ 9]*m.f[ 7] + this->f[10]*m.f[11] + this->f[11]*m.f[15];
+
+    mOut[12] = this->f[12]*m.f[ 0] + this->f[13]*m.f[ 4] + this->f[14]*m.f[ 8] + this->f[15]*m.f[12];
+    mOut[13] = this->f[12]*m.f[ 1] + this->f[13]*m.f[ 5] + this->f[14]*m.f[ 9] + this->f[15]*m.f[13];
+    mOut[14] = this->f[12]*m.f[ 2] + this->f[13]*m.f[ 6] + this->f[14]*m.f[10] + this->f[15]*m.f[14];
+    mOut[15] = this->f[12]*m.f[ 3] + this->f[13]*m.f[ 7] + this->f[14]*m.f[11] + this->f[15]*m.f[15];
+
+    memcpy(this->f, mOut, sizeof(mOut));
 };
 
 QUATERNION quaternionMultiply(const QUATERNION &q)
@@ -181,7 +340,32 @@ QUATERNION quaternionMultiply(const QUATERNION &q)
     return vRet;
 };
 
+// Transforms a direction (w = 0) by the matrix.
 VEC3 vectorMultiply(const VEC3 &m)
+{
+#if defined(VKMATH_SSE)
+    __m128 r = _mm_mul_ps(_mm_set1_ps(m.x), _mm_loadu_ps(&this->f[0]));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m.y), _mm_loadu_ps(&this->f[4])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m.z), _mm_loadu_ps(&this->f[8])));
+
+    float fOut[4];
+    _mm_storeu_ps(fOut, r);
+    return VEC3(fOut[0], fOut[1], fOut[2]);
+#elif defined(VKMATH_NEON)
+    float32x4_t r = vmulq_n_f32(vld1q_f32(&this->f[0]), m.x);
+    r = vmlaq_n_f32(r, vld1q_f32(&this->f[4]), m.y);
+    r = vmlaq_n_f32(r, vld1q_f32(&this->f[8]), m.z);
+
+    float fOut[4];
+    vst1q_f32(fOut, r);
+    return VEC3(fOut[0], fOut[1], fOut[2]);
+#else
+    return vectorMultiplyScalar(m);
+#endif
+};
+
+// Reference implementation of vectorMultiply, always scalar.
+VEC3 vectorMultiplyScalar(const VEC3 &m)
 {
     VEC3 vRet;
 
@@ -331,7 +515,89 @@ void transpose()
     memcpy(this->f, mOut.f, sizeof(mOut.f));
 };
 
+#if defined(VKMATH_SSE)
+// Inverts an affine matrix whose upper 3x3 part has already been inverted into the columns c0, c1, c2 (divided by the determinant).
+void affineInverseSSE(__m128 c0, __m128 c1, __m128 c2)
+{
+    // The columns of the inverse become its rows. The fourth row of the transposed block is zero.
+    __m128 c3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+    // Translation: -T * inverse(A).
+    __m128 t = _mm_mul_ps(_mm_set1_ps(this->f[12]), c0);
+    t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(this->f[13]), c1));
+    t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(this->f[14]), c2));
+    t = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), t);
+
+    _mm_storeu_ps(&this->f[ 0], c0);
+    _mm_storeu_ps(&this->f[ 4], c1);
+    _mm_storeu_ps(&this->f[ 8], c2);
+    _mm_storeu_ps(&this->f[12], t);
+}
+#endif
+
+// Inverts an affine matrix (the last column is 0, 0, 0, 1). Use inverseEx for any other matrix.
+// The matrix is not modified if it is singular.
 void inverse()
+{
+#if defined(VKMATH_SSE)
+    const __m128 xyz = _mm_setr_ps(1.0f, 1.0f, 1.0f, 0.0f);
+    __m128 r0 = _mm_mul_ps(_mm_loadu_ps(&this->f[0]), xyz);
+    __m128 r1 = _mm_mul_ps(_mm_loadu_ps(&this->f[4]), xyz);
+    __m128 r2 = _mm_mul_ps(_mm_loadu_ps(&this->f[8]), xyz);
+
+    // The cofactors of the rows are the cross products of the other two rows.
+    __m128 c0 = _crossSSE(r1, r2);
+    __m128 c1 = _crossSSE(r2, r0);
+    __m128 c2 = _crossSSE(r0, r1);
+
+    __m128 det = _dotSSE(r0, c0);
+    if (fabsf(_mm_cvtss_f32(det)) <= FLT_MIN) return;
+
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    affineInverseSSE(_mm_mul_ps(c0, invDet), _mm_mul_ps(c1, invDet), _mm_mul_ps(c2, invDet));
+#else
+    inverseScalar();
+#endif
+};
+
+// Fast inverse of a translation * rotation * scale matrix, with no shear (the rows of the upper 3x3 part are orthogonal).
+// This is the case of the node transforms of a glTF scene. The inverse of the 3x3 part is its transpose divided by the squared scale,
+// so it needs no determinant.
+void inverseTRS()
+{
+#if defined(VKMATH_SSE)
+    const __m128 xyz = _mm_setr_ps(1.0f, 1.0f, 1.0f, 0.0f);
+    __m128 r0 = _mm_mul_ps(_mm_loadu_ps(&this->f[0]), xyz);
+    __m128 r1 = _mm_mul_ps(_mm_loadu_ps(&this->f[4]), xyz);
+    __m128 r2 = _mm_mul_ps(_mm_loadu_ps(&this->f[8]), xyz);
+
+    affineInverseSSE(_mm_div_ps(r0, _dotSSE(r0, r0)), _mm_div_ps(r1, _dotSSE(r1, r1)), _mm_div_ps(r2, _dotSSE(r2, r2)));
+#else
+    float mOut[16];
+    for (int i = 0; i < 3; i++)
+    {
+        const float* r = &this->f[i * 4];
+        float s = 1.0f / (r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+
+        // Column i of the inverse is row i of the matrix divided by its squared length.
+        mOut[ 0 + i] = r[0] * s;
+        mOut[ 4 + i] = r[1] * s;
+        mOut[ 8 + i] = r[2] * s;
+    }
+
+    mOut[ 3] = mOut[ 7] = mOut[11] = 0.0f;
+    mOut[12] = - ( this->f[12] * mOut[ 0] + this->f[13] * mOut[ 4] + this->f[14] * mOut[ 8] );
+    mOut[13] = - ( this->f[12] * mOut[ 1] + this->f[13] * mOut[ 5] + this->f[14] * mOut[ 9] );
+    mOut[14] = - ( this->f[12] * mOut[ 2] + this->f[13] * mOut[ 6] + this->f[14] * mOut[10] );
+    mOut[15] = 1.0f;
+
+    memcpy(this->f, mOut, sizeof(mOut));
+#endif
+};
+
+// Reference implementation of inverse, always scalar and with a double precision singularity test.
+void inverseScalar()
 {
     MATRIX mOut;
     double det_1;
@@ -24,11 +24,293 @@ inline bool _getMemoryTypeFromProperties(const VkPhysicalDeviceMemoryProperties&
     return false;
 }
 
+// Concept: Memory Sub-allocation
+// Every call to vkAllocateMemory is a round-trip to the driver (and often to the kernel), and the number of live allocations is
+// limited by maxMemoryAllocationCount (it can be as low as 4096). Instead of one allocation per resource, the engine allocates large
+// pages of VkDeviceMemory per memory type and hands out aligned ranges of them. Each page keeps a list of blocks sorted by offset;
+// allocation is first-fit and freeing merges the block with its free neighbours.
+
+/// <summary>Finds a free range inside a page that can hold the requested size with the requested alignment</summary>
+/// <param name="page">Page to allocate from</param>
+/// <param name="size">Number of bytes needed</param>
+/// <param name="alignment">Required alignment of the range offset</param>
+/// <param name="outOffset">Returns the offset of the range inside the page</param>
+/// <returns>True if the page had enough contiguous free space</returns>
+inline bool _allocateFromPage(MemoryPage& page, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset)
+{
+    for (size_t i = 0; i < page.blocks.size(); i++)
+    {
+        const MemoryBlock block = page.blocks[i];
+        if (!block.free) continue;
+
+        VkDeviceSize alignedOffset = ((block.offset + alignment - 1) / alignment) * alignment;
+        VkDeviceSize padding = alignedOffset - block.offset;
+        if (padding + size > block.size) continue;
+
+        // Split the free block into [padding][used][remainder]. The padding and the remainder stay in the free list.
+        std::vector<MemoryBlock> split;
+        if (padding > 0) split.push_back({ block.offset, padding, true });
+        split.push_back({ alignedOffset, size, false });
+        if (padding + size < block.size) split.push_back({ alignedOffset + size, block.size - padding - size, true });
+
+        page.blocks.erase(page.blocks.begin() + i);
+        page.blocks.insert(page.blocks.begin() + i, split.begin(), split.end());
+
+        page.used += size;
+        outOffset = alignedOffset;
+        return true;
+    }
+    return false;
+}
+
+/// <summary>Allocates a new VkDeviceMemory page and maps it if it is host visible</summary>
+/// <param name="memoryTypeIndex">Memory type of the page</param>
+/// <param name="size">Size of the page in bytes</param>
+/// <param name="linear">True if the page holds buffers, false if it holds optimal tiled images</param>
+/// <param name="dedicated">True if the page is for a single resource bigger than the default page size</param>
+/// <returns>The index of the page in the allocator</returns>
+inline uint32_t _createMemoryPage(AppManager& appManager, uint32_t memoryTypeIndex, VkDeviceSize size, bool linear, bool dedicated)
+{
+    MemoryPage page;
+    page.size = size;
+    page.used = 0;
+    page.memoryTypeIndex = memoryTypeIndex;
+    page.linear = linear;
+    page.dedicated = dedicated;
+    page.mappedData = nullptr;
+    page.blocks.push_back({ 0, size, true });
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.pNext = nullptr;
+    allocateInfo.allocationSize = size;
+    allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+    debugAssertFunctionResult(vk::AllocateMemory(appManager.device, &allocateInfo, nullptr, &page.memory), "Allocate Memory Page");
+
+    // A VkDeviceMemory object can only be mapped once, so host visible pages are mapped for their whole lifetime
+    // and every sub-allocation gets a pointer into that mapping.
+    if (appManager.deviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        debugAssertFunctionResult(vk::MapMemory(appManager.device, page.memory, 0, size, 0, &page.mappedData), "Map Memory Page");
+    }
+
+    // Reuse the slot of a released page if there is one so the page indices held by live allocations stay valid.
+    for (uint32_t i = 0; i < appManager.allocator.pages.size(); i++)
+    {
+        if (appManager.allocator.pages[i].memory == VK_NULL_HANDLE)
+        {
+            appManager.allocator.pages[i] = page;
+            return i;
+        }
+    }
+
+    appManager.allocator.pages.push_back(page);
+    return static_cast<uint32_t>(appManager.allocator.pages.size() - 1);
+}
+
+/// <summary>Sub-allocates device memory for a resource</summary>
+/// <param name="memoryRequirements">Size, alignment and memory type bits returned by vkGet*MemoryRequirements</param>
+/// <param name="properties">Memory property flags the memory type must have</param>
+/// <param name="linear">True for buffers and linear images, false for optimal tiled images</param>
+/// <param name="outAllocation">Returns the page memory, the offset to bind at and the mapped pointer (if host visible)</param>
+/// <returns>False if no memory type matches the requirements</returns>
+inline bool _allocateMemory(AppManager& appManager, const VkMemoryRequirements& memoryRequirements, VkMemoryPropertyFlags properties, bool linear, MemoryAllocation& outAllocation)
+{
+    uint32_t memoryTypeIndex = 0;
+    if (!_getMemoryTypeFromProperties(appManager.deviceMemoryProperties, memoryRequirements.memoryTypeBits, properties, &memoryTypeIndex))
+    {
+        Log(true, "Allocator - No memory type matches the requested properties");
+        return false;
+    }
+
+    MemoryAllocator& allocator = appManager.allocator;
+
+    // Mapped ranges of memory that is not host coherent are flushed and invalidated in whole nonCoherentAtomSize units. Aligning
+    // the allocations to that size keeps the widened ranges inside the allocation, so they never touch a neighbour.
+    VkDeviceSize size = memoryRequirements.size;
+    VkDeviceSize alignment = memoryRequirements.alignment;
+    VkMemoryPropertyFlags typeFlags = appManager.deviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    if ((typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+    {
+        VkDeviceSize atomSize = std::max<VkDeviceSize>(appManager.deviceProperties.limits.nonCoherentAtomSize, 1);
+        alignment = ((std::max(alignment, atomSize) + atomSize - 1) / atomSize) * atomSize;
+        size = ((size + atomSize - 1) / atomSize) * atomSize;
+    }
+
+    // Small heaps (some integrated GPUs expose tiny device local heaps) get smaller pages.
+    uint32_t heapIndex = appManager.deviceMemoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    VkDeviceSize pageSize = std::min(allocator.pageSize, appManager.deviceMemoryProperties.memoryHeaps[heapIndex].size / 8);
+
+    VkDeviceSize offset = 0;
+    uint32_t pageIndex = 0;
+    bool found = false;
+
+    // First fit over the existing pages of the same type and tiling.
+    for (uint32_t i = 0; i < allocator.pages.size() && !found; i++)
+    {
+        MemoryPage& page = allocator.pages[i];
+        if (page.memory == VK_NULL_HANDLE || page.dedicated || page.memoryTypeIndex != memoryTypeIndex || page.linear != linear) continue;
+        if (page.size - page.used < size) continue;
+
+        if (_allocateFromPage(page, size, alignment, offset))
+        {
+            pageIndex = i;
+            found = true;
+        }
+    }
+
+    // No room left, open a new page. Resources bigger than a page get a page of their own.
+    if (!found)
+    {
+        bool dedicated = size > pageSize;
+        pageIndex = _createMemoryPage(appManager, memoryTypeIndex, dedicated ? size : pageSize, linear, dedicated);
+        _allocateFromPage(allocator.pages[pageIndex], size, alignment, offset);
+    }
+
+    const MemoryPage& page = allocator.pages[pageIndex];
+    outAllocation.memory = page.memory;
+    outAllocation.offset = offset;
+    outAllocation.size = size;
+    outAllocation.memoryTypeIndex = memoryTypeIndex;
+    outAllocation.pageIndex = pageIndex;
+    outAllocation.mappedData = page.mappedData ? static_cast<uint8_t*>(page.mappedData) + offset : nullptr;
+
+    allocator.allocationCount++;
+
+    return true;
+}
+
+/// <summary>Returns the range to flush or invalidate for the bytes [offset, offset + size) of a mapped allocation</summary>
+/// <param name="offset">Offset of the bytes inside the allocation</param>
+/// <returns>The range widened to whole nonCoherentAtomSize units, and clamped to the end of the memory page</returns>
+inline VkMappedMemoryRange _getMappedMemoryRange(const AppManager& appManager, const MemoryAllocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+    VkDeviceSize atomSize = std::max<VkDeviceSize>(appManager.deviceProperties.limits.nonCoherentAtomSize, 1);
+    VkDeviceSize pageSize = appManager.allocator.pages[allocation.pageIndex].size;
+
+    VkDeviceSize begin = ((allocation.offset + offset) / atomSize) * atomSize;
+    VkDeviceSize end = std::min(((allocation.offset + offset + size + atomSize - 1) / atomSize) * atomSize, pageSize);
+
+    VkMappedMemoryRange mapMemRange = {
+        VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        nullptr,
+        allocation.memory,
+        begin,
+        end - begin,
+    };
+    return mapMemRange;
+}
+
+/// <summary>Returns a sub-allocation to its page and merges it with the neighbouring free blocks</summary>
+/// <param name="allocation">Allocation returned by _allocateMemory. It is reset on return.</param>
+inline void _freeMemory(AppManager& appManager, MemoryAllocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE) return;
+
+    MemoryPage& page = appManager.allocator.pages[allocation.pageIndex];
+
+    for (size_t i = 0; i < page.blocks.size(); i++)
+    {
+        if (page.blocks[i].offset != allocation.offset || page.blocks[i].free) continue;
+
+        page.blocks[i].free = true;
+        page.used -= page.blocks[i].size;
+
+        // Merge with the next block, then with the previous one.
+        if (i + 1 < page.blocks.size() && page.blocks[i + 1].free)
+        {
+            page.blocks[i].size += page.blocks[i + 1].size;
+            page.blocks.erase(page.blocks.begin() + i + 1);
+        }
+        if (i > 0 && page.blocks[i - 1].free)
+        {
+            page.blocks[i - 1].size += page.blocks[i].size;
+            page.blocks.erase(page.blocks.begin() + i);
+        }
+        break;
+    }
+
+    appManager.allocator.allocationCount--;
+
+    // Dedicated pages are not reused, so give them back to the driver straight away.
+    if (page.dedicated && page.used == 0)
+    {
+        if (page.mappedData) vk::UnmapMemory(appManager.device, page.memory);
+        vk::FreeMemory(appManager.device, page.memory, nullptr);
+        page.memory = VK_NULL_HANDLE;
+        page.mappedData = nullptr;
+        page.blocks.clear();
+    }
+
+    allocation = MemoryAllocation();
+}
+
+/// <summary>Logs the number of pages, the bytes in use and how fragmented the free space is</summary>
+inline void _logMemoryStats(AppManager& appManager)
+{
+    const MemoryAllocator& allocator = appManager.allocator;
+
+    uint32_t pageCount = 0;
+    VkDeviceSize reserved = 0, used = 0, totalFree = 0, largestFree = 0;
+
+    for (const MemoryPage& page : allocator.pages)
+    {
+        if (page.memory == VK_NULL_HANDLE) continue;
+
+        VkDeviceSize pageLargestFree = 0;
+        uint32_t freeBlocks = 0;
+        for (const MemoryBlock& block : page.blocks)
+        {
+            if (!block.free) continue;
+            freeBlocks++;
+            pageLargestFree = std::max(pageLargestFree, block.size);
+        }
+
+        Log(false, "Memory page %u: type %u, %s, %llu KB used of %llu KB, %u free blocks", pageCount, page.memoryTypeIndex,
+            page.dedicated ? "dedicated" : (page.linear ? "buffers" : "images"),
+            (unsigned long long)(page.used / 1024), (unsigned long long)(page.size / 1024), freeBlocks);
+
+        pageCount++;
+        reserved += page.size;
+        used += page.used;
+        totalFree += page.size - page.used;
+        largestFree = std::max(largestFree, pageLargestFree);
+    }
+
+    // Fragmentation: how much of the free space cannot be used for one allocation of the same total size.
+    float fragmentation = (totalFree > 0) ? 100.0f * (1.0f - float(largestFree) / float(totalFree)) : 0.0f;
+
+    Log(false, "Memory: %u allocations in %u pages (device limit %u), %llu KB used of %llu KB reserved, fragmentation %.1f%%",
+        allocator.allocationCount, pageCount, appManager.deviceProperties.limits.maxMemoryAllocationCount,
+        (unsigned long long)(used / 1024), (unsigned long long)(reserved / 1024), fragmentation);
+}
+
+/// <summary>Releases all the memory pages. Every resource must have been destroyed before calling this.</summary>
+inline void _destroyAllocator(AppManager& appManager)
+{
+    if (appManager.allocator.allocationCount > 0)
+    {
+        Log(true, "Allocator - %u allocations were not freed", appManager.allocator.allocationCount);
+    }
+
+    for (MemoryPage& page : appManager.allocator.pages)
+    {
+        if (page.memory == VK_NULL_HANDLE) continue;
+        if (page.mappedData) vk::UnmapMemory(appManager.device, page.memory);
+        vk::FreeMemory(appManager.device, page.memory, nullptr);
+    }
+    appManager.allocator.pages.clear();
+    appManager.allocator.allocationCount = 0;
+}
+
 /// <summary>Creates a buffer, allocates it memory, maps the memory and copies the data into the buffer</summary>
 /// <param name="inBuffer">Vkbuffer handle in which the newly-created buffer object is returned</param>
 /// <param name="inData">Data to be copied into the buffer</param>
 /// <param name="inUsage">Usage flag which determines what type of buffer will be created</param>
-inline void _createBuffer(AppManager& appManager, BufferData& inBuffer, const uint8_t* inData, const VkBufferUsageFlags& inUsage)
+/// <param name="inMemoryFlags">Memory properties of the buffer. Data is only copied when the memory is host visible.</param>
+inline void _createBuffer(AppManager& appManager, BufferData& inBuffer, const uint8_t* inData, const VkBufferUsageFlags& inUsage,
+                          VkMemoryPropertyFlags inMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
 {
     // This is a generic function which is used to create buffers.
     // It is responsible for creating a buffer object, allocating the memory, mapping this memory, and
@@ -57,62 +339,47 @@ inline void _createBuffer(AppManager& appManager, BufferData& inBuffer, const ui
     // Extract the memory requirements for the buffer.
     vk::GetBufferMemoryRequirements(appManager.device, inBuffer.buffer, &memoryRequirments);
 
-    // Populate an allocation info struct with the memory requirement size.
-    VkMemoryAllocateInfo allocateInfo = {};
-    allocateInfo.pNext = nullptr;
-    allocateInfo.memoryTypeIndex = 0;
-    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateInfo.allocationSize = memoryRequirments.size;
-
-    // Check if the memory that is going to be used supports the necessary flags for the usage of the buffer.
-    // In this case it needs to be "Host Coherent" in order to be able to map it. If it is not, find a compatible one.
-    bool pass = _getMemoryTypeFromProperties(appManager.deviceMemoryProperties, memoryRequirments.memoryTypeBits,
-                                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &(allocateInfo.memoryTypeIndex));
+    // Get a range of a memory page that supports the necessary flags for the usage of the buffer.
+    // By default it needs to be "Host Coherent" in order to be able to map it.
+    bool pass = _allocateMemory(appManager, memoryRequirments, inMemoryFlags, true, inBuffer.memory);
     if (pass)
     {
-        // This pointer will be used to pass the data into the buffer.
-        uint8_t* pData;
-
-        // Allocate the memory necessary for the data.
-        debugAssertFunctionResult(vk::AllocateMemory(appManager.device, &allocateInfo, nullptr, &(inBuffer.memory)), "Allocate Buffer Memory");
-
         // Save the data in the buffer struct.
         inBuffer.bufferInfo.range = memoryRequirments.size;
         inBuffer.bufferInfo.offset = 0;
         inBuffer.bufferInfo.buffer = inBuffer.buffer;
 
-        VkMemoryPropertyFlags flags = appManager.deviceMemoryProperties.memoryTypes[allocateInfo.memoryTypeIndex].propertyFlags;
+        VkMemoryPropertyFlags flags = appManager.deviceMemoryProperties.memoryTypes[inBuffer.memory.memoryTypeIndex].propertyFlags;
         inBuffer.memPropFlags = flags;
 
-        if (inData != nullptr)
-        {
-            // Map data to the memory.
-            // inBuffer.memory is the device memory handle.
-            // memoryRequirments.size is the size of the memory to be mapped, in this case it is the entire buffer.
-            // &pData is an output variable and will contain a pointer to the mapped data.
-            debugAssertFunctionResult(vk::MapMemory(appManager.device, inBuffer.memory, 0, inBuffer.size, 0, reinterpret_cast<void**>(&pData)), "Map Buffer Memory");
+        // The page the buffer lives in is persistently mapped, so there is no need to map it again.
+        inBuffer.mappedData = inBuffer.memory.mappedData;
 
+        if (inData != nullptr && inBuffer.mappedData != nullptr)
+        {
             // Copy the data into the pointer mapped to the memory.
-            memcpy(pData, inData, inBuffer.size);
+            memcpy(inBuffer.mappedData, inData, inBuffer.size);
 
-            VkMappedMemoryRange mapMemRange = {
-                VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
-                nullptr,
-                inBuffer.memory,
-                0,
-                inBuffer.size,
-            };
+            VkMappedMemoryRange mapMemRange = _getMappedMemoryRange(appManager, inBuffer.memory, 0, inBuffer.size);
 
             // ONLY flush the memory if it does not support VK_MEMORY_PROPERTY_HOST_COHERENT_BIT.
             if (!(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) { vk::FlushMappedMemoryRanges(appManager.device, 1, &mapMemRange); }
         }
 
         // Associate the allocated memory with the previously created buffer.
-        // Mapping and binding do not need to occur in a particular order. This step could just as well be performed before mapping
-        // and populating.
-        debugAssertFunctionResult(vk::BindBufferMemory(appManager.device, inBuffer.buffer, inBuffer.memory, 0), "Bind Buffer Memory");
+        // The buffer is bound at the offset of its range inside the memory page.
+        debugAssertFunctionResult(vk::BindBufferMemory(appManager.device, inBuffer.buffer, inBuffer.memory.memory, inBuffer.memory.offset), "Bind Buffer Memory");
     }
 }
 
+/// <summary>Destroys a buffer created with _createBuffer and gives its memory back to the allocator</summary>
+inline void _destroyBuffer(AppManager& appManager, BufferData& inBuffer)
+{
+    vk::DestroyBuffer(appManager.device, inBuffer.buffer, nullptr);
+    _freeMemory(appManager, inBuffer.memory);
+    inBuffer.buffer = VK_NULL_HANDLE;
+    inBuffer.mappedData = nullptr;
+}
+
 
 #endif // VKMEMORY_H
@@ -0,0 +1,335 @@
+#ifndef VKMESHCACHE_H
+#define VKMESHCACHE_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "vkStructs.h"
+#include "vkStaging.h"
+#include "vkTextures.h"
+#include "vkIndices.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Concept: Mesh Cache
+// Parsing the JSON of a glTF file, decoding its accessors and interleaving the vertices is done on every launch, although the result
+// is always the same. The first run "cooks" the scene: the meshes and their meshlets, object transforms, cameras, lights, texture names and the GPU-ready vertex and index
+// data are written to a binary file next to the .glb. Later runs map that file into memory and copy the vertex and index data straight
+// into the staging ring, without parsing or touching the vertices.
+// The header holds a hash of the .glb, so a cache written for a previous version of the file is ignored and cooked again. It also
+// holds the size of the structures it contains, as they are written as they are in memory.
+
+#define MESH_CACHE_MAGIC 0x434D4B56 // "VKMC"
+#define MESH_CACHE_VERSION 9
+#define MESH_CACHE_EXTENSION ".vkmesh"
+#define MESH_CACHE_NAME_SIZE 256 // Size of a texture name in the cache.
+
+// Header at the beginning of the cache. The offsets are from the beginning of the file, each section is 16 byte aligned.
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint32_t options; // Load options that change the cooked data (see _getMeshCacheOptions).
+    uint32_t vertexSize, meshSize, meshletSize, transformSize, cameraSize, lightSize;
+    uint32_t meshCount, meshletCount, objectCount, cameraCount, lightCount, textureCount;
+    uint32_t vertexCount;
+    uint32_t indexCounts[INDEX_SECTION_COUNT]; // Indices of each section of the index buffer (see vkIndices.h).
+    uint64_t indexSize; // Bytes of the index buffer.
+    uint64_t meshOffset, meshletOffset, objectOffset, quantizationOffset, cameraOffset, lightOffset, textureOffset, vertexOffset, indexOffset;
+};
+
+// A file mapped into memory for reading.
+struct MappedFile
+{
+    const uint8_t* data;
+    size_t size;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int file;
+#endif
+};
+
+/// <summary>Maps a whole file into memory, read only</summary>
+inline bool _mapFile(const char* fileName, MappedFile& mappedFile)
+{
+    mappedFile.data = nullptr;
+    mappedFile.size = 0;
+
+#if defined(_WIN32)
+    mappedFile.mapping = NULL;
+    mappedFile.file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mappedFile.file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(mappedFile.file, &fileSize) && fileSize.QuadPart > 0)
+    {
+        mappedFile.mapping = CreateFileMappingA(mappedFile.file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mappedFile.mapping) mappedFile.data = static_cast<const uint8_t*>(MapViewOfFile(mappedFile.mapping, FILE_MAP_READ, 0, 0, 0));
+        mappedFile.size = static_cast<size_t>(fileSize.QuadPart);
+    }
+
+    if (!mappedFile.data)
+    {
+        if (mappedFile.mapping) CloseHandle(mappedFile.mapping);
+        CloseHandle(mappedFile.file);
+        return false;
+    }
+#else
+    mappedFile.file = open(fileName, O_RDONLY);
+    if (mappedFile.file < 0) return false;
+
+    struct stat fileStat;
+    if (fstat(mappedFile.file, &fileStat) == 0 && fileStat.st_size > 0)
+    {
+        void* data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, mappedFile.file, 0);
+        if (data != MAP_FAILED) mappedFile.data = static_cast<const uint8_t*>(data);
+        mappedFile.size = static_cast<size_t>(fileStat.st_size);
+    }
+
+    if (!mappedFile.data)
+    {
+        close(mappedFile.file);
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+/// <summary>Unmaps a file mapped with _mapFile</summary>
+inline void _unmapFile(MappedFile& mappedFile)
+{
+    if (!mappedFile.data) return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(mappedFile.data);
+    CloseHandle(mappedFile.mapping);
+    CloseHandle(mappedFile.file);
+#else
+    munmap(const_cast<uint8_t*>(mappedFile.data), mappedFile.size);
+    close(mappedFile.file);
+#endif
+
+    mappedFile.data = nullptr;
+    mappedFile.size = 0;
+}
+
+/// <summary>Returns a 64-bit FNV-1a hash of the data, computed 8 bytes at a time</summary>
+inline uint64_t _hashData(const uint8_t* data, size_t size)
+{
+    const uint64_t prime = 0x100000001B3ull;
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; i++) hash = (hash ^ data[i]) * prime;
+
+    return hash;
+}
+
+/// <summary>Returns the name of the cache of a glTF file: the same name with the MESH_CACHE_EXTENSION extension</summary>
+inline std::string _getMeshCacheFileName(const char* fileName)
+{
+    std::string cacheFileName(fileName);
+    size_t extension = cacheFileName.rfind('.');
+    if (extension != std::string::npos && cacheFileName.find_first_of("\\/", extension) == std::string::npos) cacheFileName.resize(extension);
+    return cacheFileName + MESH_CACHE_EXTENSION;
+}
+
+/// <summary>Returns a hash of the load options the cooked data depends on: the mesh optimizations, the vertex format, the levels of
+/// detail and the meshlets</summary>
+inline uint32_t _getMeshCacheOptions()
+{
+    const uint32_t options[] = {
+        OPTIMIZE_MESHES ? 1u : 0u, OPTIMIZE_MESHES && OPTIMIZE_OVERDRAW ? 1u : 0u, USE_COMPACT_VERTEX ? 1u : 0u, VERTEX_CACHE_SIZE,
+        GENERATE_MESH_LODS ? 1u : 0u, MAX_MESH_LODS, static_cast<uint32_t>(LOD_MAX_ERROR * 1000.0f), LOD_MIN_TRIANGLES,
+        USE_MESHLETS ? 1u : 0u, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, MESHLET_MIN_MESH_TRIANGLES,
+    };
+
+    uint64_t hash = _hashData(reinterpret_cast<const uint8_t*>(options), sizeof(options));
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+/// <summary>Returns true if a section of count elements of elementSize bytes at offset is inside the file</summary>
+static bool isMeshCacheSectionValid(const MappedFile& cacheFile, uint64_t offset, uint64_t count, uint64_t elementSize)
+{
+    return offset <= cacheFile.size && count * elementSize <= cacheFile.size - offset;
+}
+
+/// <summary>Loads the scene from its cache, if the cache exists and was cooked from the same source file</summary>
+/// <param name="cacheFileName">Name of the cache file</param>
+/// <param name="sourceHash">Hash of the .glb file</param>
+/// <param name="sourceSize">Size of the .glb file</param>
+/// <returns>False if there is no valid cache, nothing is loaded then</returns>
+inline bool _loadMeshCache(AppManager& appManager, const std::string& cacheFileName, uint64_t sourceHash, uint64_t sourceSize)
+{
+    MappedFile cacheFile;
+    if (!_mapFile(cacheFileName.c_str(), cacheFile)) return false;
+
+    MeshCacheHeader header;
+    bool valid = cacheFile.size >= sizeof(MeshCacheHeader);
+    if (valid)
+    {
+        memcpy(&header, cacheFile.data, sizeof(MeshCacheHeader));
+        valid = header.magic == MESH_CACHE_MAGIC && header.version == MESH_CACHE_VERSION &&
+                header.sourceHash == sourceHash && header.sourceSize == sourceSize && header.options == _getMeshCacheOptions() &&
+                header.vertexSize == sizeof(DrawVertex) && header.meshSize == sizeof(Mesh) && header.meshletSize == sizeof(Meshlet) && header.transformSize == sizeof(Transform) &&
+                header.cameraSize == sizeof(Camera) && header.lightSize == sizeof(Light) &&
+                isMeshCacheSectionValid(cacheFile, header.meshOffset, header.meshCount, sizeof(Mesh)) &&
+                isMeshCacheSectionValid(cacheFile, header.meshletOffset, header.meshletCount, sizeof(Meshlet)) &&
+                isMeshCacheSectionValid(cacheFile, header.objectOffset, header.objectCount, sizeof(Transform)) &&
+                isMeshCacheSectionValid(cacheFile, header.quantizationOffset, header.objectCount, sizeof(PositionQuantization)) &&
+                isMeshCacheSectionValid(cacheFile, header.cameraOffset, header.cameraCount, sizeof(Camera)) &&
+                isMeshCacheSectionValid(cacheFile, header.lightOffset, header.lightCount, sizeof(Light)) &&
+                isMeshCacheSectionValid(cacheFile, header.textureOffset, header.textureCount, MESH_CACHE_NAME_SIZE) &&
+                isMeshCacheSectionValid(cacheFile, header.vertexOffset, header.vertexCount, sizeof(DrawVertex)) &&
+                isMeshCacheSectionValid(cacheFile, header.indexOffset, header.indexSize, 1);
+    }
+
+    // The 8-bit indices need the extension, which may not be supported if the cache was cooked with another GPU.
+    if (valid && header.indexCounts[_getIndexSection(VK_INDEX_TYPE_UINT8_EXT)] > 0 && !appManager.supportsIndexTypeUint8) valid = false;
+
+    if (valid)
+    {
+        for (uint32_t s = 0; s < INDEX_SECTION_COUNT; s++) appManager.indexSections[s].count = header.indexCounts[s];
+        valid = _layoutIndexSections(appManager) == header.indexSize;
+    }
+
+    if (!valid)
+    {
+        Log(false, "Mesh cache: %s is missing or out of date, the scene is cooked again", cacheFileName.c_str());
+        _unmapFile(cacheFile);
+        return false;
+    }
+
+    // The tables are small, they are copied to the application structures.
+    const Mesh* meshes = reinterpret_cast<const Mesh*>(cacheFile.data + header.meshOffset);
+    const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(cacheFile.data + header.meshletOffset);
+    const Transform* objectTransforms = reinterpret_cast<const Transform*>(cacheFile.data + header.objectOffset);
+    const PositionQuantization* objectQuantization = reinterpret_cast<const PositionQuantization*>(cacheFile.data + header.quantizationOffset);
+    const Camera* cameras = reinterpret_cast<const Camera*>(cacheFile.data + header.cameraOffset);
+    const Light* lights = reinterpret_cast<const Light*>(cacheFile.data + header.lightOffset);
+    appManager.meshes.assign(meshes, meshes + header.meshCount);
+    appManager.meshlets.assign(meshlets, meshlets + header.meshletCount);
+    appManager.objectTransforms.assign(objectTransforms, objectTransforms + header.objectCount);
+    appManager.objectQuantization.assign(objectQuantization, objectQuantization + header.objectCount);
+    appManager.cameras.assign(cameras, cameras + header.cameraCount);
+    appManager.lights.assign(lights, lights + header.lightCount);
+
+    // The textures are already in their GPU format (DDS), only their names are cached.
+    const char* textureNames = reinterpret_cast<const char*>(cacheFile.data + header.textureOffset);
+    for (uint32_t i = 0; i < header.textureCount; i++)
+    {
+        std::string name(textureNames + i * MESH_CACHE_NAME_SIZE, strnlen(textureNames + i * MESH_CACHE_NAME_SIZE, MESH_CACHE_NAME_SIZE));
+
+        appManager.textures.emplace_back();
+        appManager.textures.back().uri = name;
+        _loadTexture(appManager, appManager.textures.back(), (appManager.gltfPath + "\\" + name).c_str());
+    }
+
+    // The vertices and indices are copied from the mapped file straight into the staging ring.
+    if (header.vertexCount > 0)
+    {
+        appManager.indexBuffer.size = static_cast<size_t>(header.indexSize);
+        _createDeviceLocalBuffer(appManager, appManager.indexBuffer, cacheFile.data + header.indexOffset, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+        appManager.vertexBuffer.size = sizeof(DrawVertex) * header.vertexCount;
+        _createDeviceLocalBuffer(appManager, appManager.vertexBuffer, cacheFile.data + header.vertexOffset, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    }
+
+    Log(false, "Mesh cache: %u meshes, %u vertices, %u bytes of indices and %u textures loaded from %s", header.meshCount, header.vertexCount,
+        (unsigned int)header.indexSize, header.textureCount, cacheFileName.c_str());
+
+    _unmapFile(cacheFile);
+    return true;
+}
+
+/// <summary>Writes a section at the end of the cache, aligned to 16 bytes, and returns its offset</summary>
+static uint64_t writeMeshCacheSection(FILE* cacheFile, const void* data, size_t size)
+{
+    static const uint8_t padding[16] = {};
+
+    long position = ftell(cacheFile);
+    size_t paddingSize = _getAlignedDataSize(static_cast<size_t>(position), 16) - static_cast<size_t>(position);
+    fwrite(padding, 1, paddingSize, cacheFile);
+
+    if (size > 0) fwrite(data, 1, size, cacheFile);
+    return static_cast<uint64_t>(position) + paddingSize;
+}
+
+/// <summary>Cooks the scene loaded from a glTF file into its cache</summary>
+/// <param name="vertices">Vertices of all the meshes, as uploaded to the vertex buffer (quantized if USE_COMPACT_VERTEX)</param>
+/// <param name="indices">Index buffer data, with the sections of appManager.indexSections</param>
+inline void _saveMeshCache(AppManager& appManager, const std::string& cacheFileName, uint64_t sourceHash, uint64_t sourceSize,
+                           const std::vector<DrawVertex>& vertices, const std::vector<uint8_t>& indices)
+{
+    FILE* cacheFile = fopen(cacheFileName.c_str(), "wb");
+    if (!cacheFile)
+    {
+        Log(true, "Mesh cache: could not write %s", cacheFileName.c_str());
+        return;
+    }
+
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    header.options = _getMeshCacheOptions();
+    header.vertexSize = sizeof(DrawVertex);
+    header.meshSize = sizeof(Mesh);
+    header.meshletSize = sizeof(Meshlet);
+    header.transformSize = sizeof(Transform);
+    header.cameraSize = sizeof(Camera);
+    header.lightSize = sizeof(Light);
+    header.meshCount = static_cast<uint32_t>(appManager.meshes.size());
+    header.meshletCount = static_cast<uint32_t>(appManager.meshlets.size());
+    header.objectCount = static_cast<uint32_t>(appManager.objectTransforms.size());
+    header.cameraCount = static_cast<uint32_t>(appManager.cameras.size());
+    header.lightCount = static_cast<uint32_t>(appManager.lights.size());
+    header.textureCount = static_cast<uint32_t>(appManager.textures.size());
+    header.vertexCount = static_cast<uint32_t>(vertices.size());
+    for (uint32_t s = 0; s < INDEX_SECTION_COUNT; s++) header.indexCounts[s] = appManager.indexSections[s].count;
+    header.indexSize = indices.size();
+
+    std::vector<char> textureNames(appManager.textures.size() * MESH_CACHE_NAME_SIZE, 0);
+    for (size_t i = 0; i < appManager.textures.size(); i++)
+    {
+        strncpy(&textureNames[i * MESH_CACHE_NAME_SIZE], appManager.textures[i].uri.c_str(), MESH_CACHE_NAME_SIZE - 1);
+    }
+
+    // The header is written first with no offsets, and again at the end when they are known.
+    fwrite(&header, sizeof(MeshCacheHeader), 1, cacheFile);
+    header.meshOffset = writeMeshCacheSection(cacheFile, appManager.meshes.data(), sizeof(Mesh) * appManager.meshes.size());
+    header.meshletOffset = writeMeshCacheSection(cacheFile, appManager.meshlets.data(), sizeof(Meshlet) * appManager.meshlets.size());
+    header.objectOffset = writeMeshCacheSection(cacheFile, appManager.objectTransforms.data(), sizeof(Transform) * appManager.objectTransforms.size());
+    header.quantizationOffset = writeMeshCacheSection(cacheFile, appManager.objectQuantization.data(), sizeof(PositionQuantization) * appManager.objectQuantization.size());
+    header.cameraOffset = writeMeshCacheSection(cacheFile, appManager.cameras.data(), sizeof(Camera) * appManager.cameras.size());
+    header.lightOffset = writeMeshCacheSection(cacheFile, appManager.lights.data(), sizeof(Light) * appManager.lights.size());
+    header.textureOffset = writeMeshCacheSection(cacheFile, textureNames.data(), textureNames.size());
+    header.vertexOffset = writeMeshCacheSection(cacheFile, vertices.data(), sizeof(DrawVertex) * vertices.size());
+    header.indexOffset = writeMeshCacheSection(cacheFile, indices.data(), indices.size());
+
+    fseek(cacheFile, 0L, SEEK_SET);
+    fwrite(&header, sizeof(MeshCacheHeader), 1, cacheFile);
+    fclose(cacheFile);
+
+    Log(false, "Mesh cache: scene cooked into %s", cacheFileName.c_str());
+}
+
+#endif // VKMESHCACHE_H
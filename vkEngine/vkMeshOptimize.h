@@ -0,0 +1,286 @@
+#ifndef VKMESHOPTIMIZE_H
+#define VKMESHOPTIMIZE_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "vkStructs.h"
+
+// Concept: Mesh Optimization
+// The GPU keeps the last transformed vertices in a small post-transform cache, so a vertex shared by consecutive triangles is only
+// shaded once. Exporters write the triangles in any order, and the same vertex is often shaded several times. Three passes improve that:
+// - Triangle order (Tipsify, Sander et al. 2007): the triangles are emitted as fans around a vertex, and the next fan is chosen among the
+//   vertices of the last triangles that are still in the cache.
+// - Overdraw: the triangles are split into clusters where the cache is cold anyway, and the clusters that face out of the mesh are drawn
+//   first, as they are more likely to hide the others. The order of the triangles inside each cluster is kept.
+// - Vertex order: the vertices are renumbered in the order the triangles use them, so the vertex fetch reads memory sequentially.
+// The cache is simulated on the CPU to measure the result: ACMR is the number of vertices shaded per triangle (0.5 is the best case
+// for a regular grid, 3 the worst), ATVR the number of times each vertex is shaded (1 is the best case).
+
+// Totals of the vertex cache simulation of a group of meshes.
+struct MeshOptimizeStats
+{
+    uint64_t triangles;
+    uint64_t vertices;
+    uint64_t missesBefore; // Vertices shaded with the original order.
+    uint64_t missesAfter;  // Vertices shaded with the optimized order.
+
+    MeshOptimizeStats() : triangles(0), vertices(0), missesBefore(0), missesAfter(0) {}
+};
+
+/// <summary>Simulates a FIFO post-transform cache of cacheSize entries and returns the number of vertices shaded (cache misses)</summary>
+inline uint64_t _simulateVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize)
+{
+    // A vertex is in the cache if fewer than cacheSize vertices have been shaded since it was shaded itself.
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    uint32_t time = cacheSize;
+    uint64_t misses = 0;
+
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        uint32_t v = indices[i];
+        if (time - cacheTime[v] >= cacheSize)
+        {
+            cacheTime[v] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+/// <summary>Reorders the triangles for the post-transform cache with Tipsify</summary>
+/// <param name="outClusterStarts">Receives the first triangle of each cluster, where the algorithm had to jump to an unconnected vertex</param>
+inline void _optimizeVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize,
+                                 uint32_t* outIndices, std::vector<uint32_t>& outClusterStarts)
+{
+    const uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+
+    // Triangles of each vertex (adjacency) and number of them not emitted yet (live triangles).
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) liveTriangles[indices[i]]++;
+
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t v = 0; v < vertexCount; v++) adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        for (uint32_t c = 0; c < 3; c++) adjacency[fill[indices[t * 3 + c]]++] = t;
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnds; // Vertices of the emitted triangles, most recent last.
+    std::vector<uint32_t> candidates;
+    uint32_t time = cacheSize + 1;
+    uint32_t scan = 0; // Next vertex to check when there are no candidates or dead ends.
+    size_t outCount = 0;
+
+    outClusterStarts.clear();
+    int64_t fan = triangleCount > 0 ? 0 : -1;
+    bool jumped = true;
+
+    while (fan >= 0)
+    {
+        const uint32_t firstTriangle = static_cast<uint32_t>(outCount / 3);
+        if (jumped && (outClusterStarts.empty() || outClusterStarts.back() != firstTriangle)) outClusterStarts.push_back(firstTriangle);
+
+        // Emit all the live triangles around the fanning vertex.
+        candidates.clear();
+        for (uint32_t a = adjacencyOffsets[fan]; a < adjacencyOffsets[fan + 1]; a++)
+        {
+            uint32_t t = adjacency[a];
+            if (emitted[t]) continue;
+
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                uint32_t v = indices[t * 3 + c];
+                outIndices[outCount++] = v;
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize) cacheTime[v] = time++;
+            }
+            emitted[t] = 1;
+        }
+
+        // The next fan is the candidate that stays longest in the cache after its own triangles are emitted.
+        int64_t best = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates)
+        {
+            if (liveTriangles[v] == 0) continue;
+
+            int64_t priority = 0;
+            if (static_cast<int64_t>(time - cacheTime[v]) + 2 * static_cast<int64_t>(liveTriangles[v]) <= cacheSize) priority = time - cacheTime[v];
+            if (priority > bestPriority) { bestPriority = priority; best = v; }
+        }
+
+        jumped = best < 0;
+        if (jumped)
+        {
+            // Dead end: go back to a recent vertex with live triangles, or to the next unused vertex.
+            while (best < 0 && !deadEnds.empty())
+            {
+                uint32_t v = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[v] > 0) best = v;
+            }
+            while (best < 0 && scan < vertexCount)
+            {
+                if (liveTriangles[scan] > 0) best = scan;
+                scan++;
+            }
+        }
+        fan = best;
+    }
+
+    // The indices of an incomplete last triangle are kept at the end.
+    for (size_t i = triangleCount * 3; i < indexCount; i++) outIndices[outCount++] = indices[i];
+}
+
+/// <summary>Splits the clusters of _optimizeVertexCache further where the cache misses of the cluster drop low enough, and sorts
+/// them so the clusters that face out of the mesh are drawn first</summary>
+/// <param name="clusterStarts">First triangle of each cluster of _optimizeVertexCache</param>
+inline void _optimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices, uint32_t vertexCount, uint32_t cacheSize,
+                              std::vector<uint32_t> clusterStarts)
+{
+    const uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+    if (triangleCount == 0 || clusterStarts.empty()) return;
+
+    // A cluster can end where its ACMR, with a cold cache at its start, is below the ACMR of the whole mesh times a threshold.
+    // The reordered clusters then cost at most that much more than the cache optimized order.
+    const float threshold = 1.05f;
+    const float meshAcmr = static_cast<float>(_simulateVertexCache(indices, triangleCount * 3, vertexCount, cacheSize)) / triangleCount;
+
+    std::vector<uint32_t> splitStarts;
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    uint32_t time = cacheSize;
+    uint32_t clusterMisses = 0, clusterTriangles = 0;
+    size_t nextHardStart = 0;
+
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        bool hardStart = nextHardStart < clusterStarts.size() && clusterStarts[nextHardStart] == t;
+        if (hardStart) nextHardStart++;
+
+        bool softStart = clusterTriangles > 0 && static_cast<float>(clusterMisses) / clusterTriangles <= meshAcmr * threshold;
+        if (t == 0 || hardStart || softStart)
+        {
+            splitStarts.push_back(t);
+            time += cacheSize; // Cold cache.
+            clusterMisses = clusterTriangles = 0;
+        }
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            uint32_t v = indices[t * 3 + c];
+            if (time - cacheTime[v] >= cacheSize) { cacheTime[v] = time++; clusterMisses++; }
+        }
+        clusterTriangles++;
+    }
+    splitStarts.push_back(triangleCount);
+
+    // The centroid of the mesh and, for each cluster, its centroid and its area weighted normal.
+    VEC3 meshCentroid;
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        for (uint32_t c = 0; c < 3; c++) meshCentroid = meshCentroid + vertices[indices[t * 3 + c]].pos;
+    }
+    meshCentroid = meshCentroid * (1.0f / (triangleCount * 3));
+
+    const size_t clusterCount = splitStarts.size() - 1;
+    std::vector<float> sortKeys(clusterCount);
+    for (size_t k = 0; k < clusterCount; k++)
+    {
+        VEC3 centroid, normal;
+        for (uint32_t t = splitStarts[k]; t < splitStarts[k + 1]; t++)
+        {
+            const VEC3& p0 = vertices[indices[t * 3 + 0]].pos;
+            const VEC3& p1 = vertices[indices[t * 3 + 1]].pos;
+            const VEC3& p2 = vertices[indices[t * 3 + 2]].pos;
+            VEC3 edge1 = p1 - p0, edge2 = p2 - p0;
+            centroid = centroid + p0 + p1 + p2;
+            normal = normal + edge1.crossProduct(edge2);
+        }
+        centroid = centroid * (1.0f / ((splitStarts[k + 1] - splitStarts[k]) * 3));
+
+        // How much the cluster faces away from the centre of the mesh.
+        float length = normal.lenght();
+        VEC3 toCluster = centroid - meshCentroid;
+        sortKeys[k] = length > 0.0f ? toCluster.dotProduct(normal) / length : 0.0f;
+    }
+
+    std::vector<uint32_t> order(clusterCount);
+    for (uint32_t k = 0; k < clusterCount; k++) order[k] = k;
+    std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indexCount);
+    for (uint32_t k : order) sorted.insert(sorted.end(), indices + splitStarts[k] * 3, indices + splitStarts[k + 1] * 3);
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+/// <summary>Renumbers the vertices in the order the indices use them first. Vertices not used by any index are moved to the end.</summary>
+inline void _optimizeVertexFetch(uint32_t* indices, size_t indexCount, Vertex* vertices, uint32_t vertexCount)
+{
+    const uint32_t unassigned = 0xFFFFFFFF;
+    std::vector<uint32_t> remap(vertexCount, unassigned);
+    std::vector<Vertex> sourceVertices(vertices, vertices + vertexCount);
+
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        uint32_t& newIndex = remap[indices[i]];
+        if (newIndex == unassigned)
+        {
+            newIndex = next++;
+            vertices[newIndex] = sourceVertices[indices[i]];
+        }
+        indices[i] = newIndex;
+    }
+
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        if (remap[v] == unassigned) vertices[next++] = sourceVertices[v];
+    }
+}
+
+/// <summary>Reorders the triangles and the vertices of a mesh for the post-transform cache, the overdraw (if OPTIMIZE_OVERDRAW)
+/// and the vertex fetch, and adds the cache misses before and after to stats</summary>
+/// <param name="indices">Triangle list indices of the mesh, relative to vertices</param>
+inline void _optimizeMesh(uint32_t* indices, size_t indexCount, Vertex* vertices, uint32_t vertexCount, MeshOptimizeStats& stats)
+{
+    const uint32_t cacheSize = VERTEX_CACHE_SIZE;
+
+    stats.triangles += indexCount / 3;
+    stats.vertices += vertexCount;
+    stats.missesBefore += _simulateVertexCache(indices, indexCount, vertexCount, cacheSize);
+
+    std::vector<uint32_t> optimized(indexCount);
+    std::vector<uint32_t> clusterStarts;
+    _optimizeVertexCache(indices, indexCount, vertexCount, cacheSize, optimized.data(), clusterStarts);
+    std::copy(optimized.begin(), optimized.end(), indices);
+
+#if OPTIMIZE_OVERDRAW
+    _optimizeOverdraw(indices, indexCount, vertices, vertexCount, cacheSize, clusterStarts);
+#endif
+
+    _optimizeVertexFetch(indices, indexCount, vertices, vertexCount);
+
+    stats.missesAfter += _simulateVertexCache(indices, indexCount, vertexCount, cacheSize);
+}
+
+/// <summary>Logs the ACMR and ATVR of a group of meshes before and after the optimization</summary>
+inline void _logMeshOptimizeStats(const MeshOptimizeStats& stats)
+{
+    if (stats.triangles == 0 || stats.vertices == 0) return;
+
+    const double triangles = static_cast<double>(stats.triangles), vertices = static_cast<double>(stats.vertices);
+    Log(false, "Mesh optimization (%u entry FIFO cache%s): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", VERTEX_CACHE_SIZE,
+        OPTIMIZE_OVERDRAW ? ", overdraw clusters" : "", stats.missesBefore / triangles, stats.missesAfter / triangles,
+        stats.missesBefore / vertices, stats.missesAfter / vertices);
+}
+
+#endif // VKMESHOPTIMIZE_H
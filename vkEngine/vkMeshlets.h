@@ -0,0 +1,145 @@
+#ifndef VKMESHLETS_H
+#define VKMESHLETS_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "vkStructs.h"
+
+// Concept: Meshlets
+// The culling tests the bounding sphere of a whole mesh, so a large mesh is drawn whole as soon as any part of it is in view, and
+// its back half is always processed. The big meshes are split into meshlets: small clusters of at most MESHLET_MAX_VERTICES vertices
+// and MESHLET_MAX_TRIANGLES triangles, each with its own bounding sphere and normal cone (the cone that contains the normals of its
+// triangles). A meshlet is culled when its sphere is out of the frustum, or when the camera is behind all its triangles: the camera
+// is outside of the cone opened around the back of the triangles, which the cone axis and the cone cutoff (sine of its half angle)
+// describe.
+// Without mesh shaders a meshlet is drawn as an indirect draw of its range of indices. The triangles of the mesh are already in
+// cache order, so the meshlets are taken as consecutive runs of triangles and the index buffer stays as it is. The culling compute
+// shader tests the meshlets and compacts the visible ones with the other draws (see vkCulling.h).
+
+/// <summary>Computes the bounding sphere and the normal cone of the triangles of a meshlet</summary>
+/// <param name="indices">Triangle list indices of the meshlet, relative to vertices</param>
+inline void _computeMeshletBounds(const uint32_t* indices, size_t indexCount, const Vertex* vertices, Meshlet& meshlet)
+{
+    // Sphere around the bounding box.
+    VEC3 boundsMin = vertices[indices[0]].pos, boundsMax = boundsMin;
+    for (size_t i = 1; i < indexCount; i++)
+    {
+        const VEC3& p = vertices[indices[i]].pos;
+        boundsMin = VEC3(std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z));
+        boundsMax = VEC3(std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z));
+    }
+    meshlet.center = (boundsMin + boundsMax) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        VEC3 offset = vertices[indices[i]].pos - meshlet.center;
+        meshlet.radius = std::max(meshlet.radius, offset.lenght());
+    }
+
+    // The cone axis is the average of the triangle normals, and its half angle the largest angle between a normal and the axis.
+    std::vector<VEC3> normals;
+    normals.reserve(indexCount / 3);
+    VEC3 axis;
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        const VEC3& p0 = vertices[indices[i]].pos;
+        VEC3 e1 = vertices[indices[i + 1]].pos - p0;
+        VEC3 e2 = vertices[indices[i + 2]].pos - p0;
+        VEC3 normal = e1.crossProduct(e2);
+        if (normal.lenght() == 0.0f) continue;
+
+        normals.push_back(normal.normalize());
+        axis = axis + normals.back();
+    }
+
+    // A cutoff of 1 never culls: the cone is open to more than a half space, or the meshlet has no area.
+    meshlet.coneAxis = VEC3(0.0f, 0.0f, 1.0f);
+    meshlet.coneCutoff = 1.0f;
+    if (normals.empty() || axis.lenght() == 0.0f) return;
+
+    axis = axis.normalize();
+    float minDot = 1.0f;
+    for (VEC3& normal : normals) minDot = std::min(minDot, normal.dotProduct(axis));
+
+    meshlet.coneAxis = axis;
+    if (minDot > 0.0f) meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+/// <summary>Splits a triangle list into meshlets of consecutive triangles, with at most MESHLET_MAX_VERTICES vertices and
+/// MESHLET_MAX_TRIANGLES triangles each</summary>
+/// <param name="indices">Triangle list indices, relative to vertices, in the order they are drawn</param>
+/// <param name="outMeshlets">Receives the meshlets, with firstIndex relative to indices</param>
+inline void _buildMeshlets(const uint32_t* indices, size_t indexCount, const Vertex* vertices, uint32_t vertexCount, std::vector<Meshlet>& outMeshlets)
+{
+    outMeshlets.clear();
+
+    // The meshlet that last used each vertex, to count the vertices of the current one.
+    std::vector<uint32_t> usedBy(vertexCount, 0xFFFFFFFF);
+    uint32_t meshletIndex = 0;
+    size_t firstIndex = 0;
+    uint32_t meshletVertices = 0;
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        uint32_t newVertices = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            bool repeated = (k > 0 && indices[i + k] == indices[i]) || (k > 1 && indices[i + k] == indices[i + 1]);
+            if (usedBy[indices[i + k]] != meshletIndex && !repeated) newVertices++;
+        }
+
+        if (meshletVertices + newVertices > MESHLET_MAX_VERTICES || (i - firstIndex) / 3 + 1 > MESHLET_MAX_TRIANGLES)
+        {
+            Meshlet meshlet;
+            meshlet.firstIndex = static_cast<uint32_t>(firstIndex);
+            meshlet.indexCount = static_cast<uint32_t>(i - firstIndex);
+            _computeMeshletBounds(indices + firstIndex, meshlet.indexCount, vertices, meshlet);
+            outMeshlets.push_back(meshlet);
+
+            meshletIndex++;
+            firstIndex = i;
+            meshletVertices = 0;
+            newVertices = 3 - (indices[i + 1] == indices[i] ? 1 : 0) - (indices[i + 2] == indices[i] || indices[i + 2] == indices[i + 1] ? 1 : 0);
+        }
+
+        for (int k = 0; k < 3; k++) usedBy[indices[i + k]] = meshletIndex;
+        meshletVertices += newVertices;
+    }
+
+    const size_t lastIndex = indexCount - indexCount % 3;
+    if (lastIndex > firstIndex)
+    {
+        Meshlet meshlet;
+        meshlet.firstIndex = static_cast<uint32_t>(firstIndex);
+        meshlet.indexCount = static_cast<uint32_t>(lastIndex - firstIndex);
+        _computeMeshletBounds(indices + firstIndex, meshlet.indexCount, vertices, meshlet);
+        outMeshlets.push_back(meshlet);
+    }
+}
+
+/// <summary>Logs how many meshes are split into meshlets, and the average size of the meshlets</summary>
+inline void _logMeshlets(AppManager& appManager)
+{
+    uint32_t meshCount = 0;
+    for (const Mesh& mesh : appManager.meshes) meshCount += mesh.meshletCount > 0 ? 1 : 0;
+
+    if (appManager.meshlets.empty())
+    {
+        Log(false, "Meshlets: no mesh has %u triangles or more", MESHLET_MIN_MESH_TRIANGLES);
+        return;
+    }
+
+    uint64_t triangles = 0;
+    uint32_t backfaceCullable = 0;
+    for (const Meshlet& meshlet : appManager.meshlets)
+    {
+        triangles += meshlet.indexCount / 3;
+        backfaceCullable += meshlet.coneCutoff < 1.0f ? 1 : 0;
+    }
+
+    Log(false, "Meshlets: %u meshes split into %u meshlets of %.1f triangles on average, %u with a normal cone narrow enough to be backface culled",
+        meshCount, (unsigned int)appManager.meshlets.size(), double(triangles) / appManager.meshlets.size(), backfaceCullable);
+}
+
+#endif // VKMESHLETS_H
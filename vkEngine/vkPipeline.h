@@ -1,7 +1,10 @@
 #ifndef VKPIPELINE_H
 #define VKPIPELINE_H
 
+#include <chrono>
+#include <cstddef>
 #include "vkStructs.h"
+#include "vkShaders.h"
 
 /// <summary>Creates the graphics pipeline</summary>
 inline void _initPipeline(AppManager& appManager)
@@ -22,28 +25,30 @@ inline void _initPipeline(AppManager& appManager)
     VkVertexInputBindingDescription vertexInputBindingDescription = {};
     vertexInputBindingDescription.binding = 0;
     vertexInputBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-    vertexInputBindingDescription.stride = sizeof(Vertex);
+    vertexInputBindingDescription.stride = sizeof(DrawVertex);
 
     // This is the description of the vertex attributes for the vertex input.
-    // The location variable sets which vertex attribute to use. In this case there are two attributes: one for
-    // position co-ordinates and one for the texture co-ordinates.
+    // The location variable sets which vertex attribute to use. In this case there are three attributes: the
+    // position co-ordinates, the normal and the texture co-ordinates.
     // The offset variable specifies at what memory location within each vertex the attribute is found, and the format
     // parameter describes how the data is stored in each attribute.
+    // CompactVertex uses normalized integers and half floats, which the vertex fetch converts to floats for the shader.
+    // R16G16B16A16 is used for the position because R16G16B16 formats are not required to be supported as vertex input.
     VkVertexInputAttributeDescription vertexInputAttributeDescription[3];
     vertexInputAttributeDescription[0].binding = 0;
-    vertexInputAttributeDescription[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    vertexInputAttributeDescription[0].format = USE_COMPACT_VERTEX ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
     vertexInputAttributeDescription[0].location = 0;
-    vertexInputAttributeDescription[0].offset = 0;
+    vertexInputAttributeDescription[0].offset = offsetof(DrawVertex, pos);
 
     vertexInputAttributeDescription[1].binding = 0;
-    vertexInputAttributeDescription[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+    vertexInputAttributeDescription[1].format = USE_COMPACT_VERTEX ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R32G32B32_SFLOAT;
     vertexInputAttributeDescription[1].location = 1;
-    vertexInputAttributeDescription[1].offset = 3 * sizeof(float);
+    vertexInputAttributeDescription[1].offset = offsetof(DrawVertex, nor);
 
     vertexInputAttributeDescription[2].binding = 0;
-    vertexInputAttributeDescription[2].format = VK_FORMAT_R32G32_SFLOAT;
+    vertexInputAttributeDescription[2].format = USE_COMPACT_VERTEX ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R32G32_SFLOAT;
     vertexInputAttributeDescription[2].location = 2;
-    vertexInputAttributeDescription[2].offset = 6 * sizeof(float);
+    vertexInputAttributeDescription[2].offset = offsetof(DrawVertex, tex);
 
     // Combine the vertex bindings and the vertex attributes into the vertex input. This sums up all of the information about the vertices.
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
@@ -192,12 +197,88 @@ inline void _initPipeline(AppManager& appManager)
     pipelineInfo.pDynamicState = &dynamicStateInfo;
     pipelineInfo.pViewportState = &viewportInfo;
     pipelineInfo.pDepthStencilState = &depthBufferInfo;
-    pipelineInfo.pStages = appManager.shaderStages;
+    // The vertex shaders decode the normals of CompactVertex when the specialization constant 1 is set.
+    uint32_t compactVertex = USE_COMPACT_VERTEX;
+    VkSpecializationMapEntry vertexSpecializationEntry = { 1, 0, sizeof(uint32_t) };
+    VkSpecializationInfo vertexSpecializationInfo = {};
+    vertexSpecializationInfo.mapEntryCount = 1;
+    vertexSpecializationInfo.pMapEntries = &vertexSpecializationEntry;
+    vertexSpecializationInfo.dataSize = sizeof(uint32_t);
+    vertexSpecializationInfo.pData = &compactVertex;
+
+    VkPipelineShaderStageCreateInfo stages[] = { appManager.shaderStages[SHADER_VERTEX], appManager.shaderStages[SHADER_FRAGMENT] };
+    stages[0].pSpecializationInfo = &vertexSpecializationInfo;
+
+    pipelineInfo.pStages = stages;
     pipelineInfo.stageCount = 2;
     pipelineInfo.renderPass = appManager.renderPass;
     pipelineInfo.subpass = 0;
 
-    debugAssertFunctionResult(vk::CreateGraphicsPipelines(appManager.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &appManager.pipeline), "Pipeline Creation");
+    // The pipeline cache skips the shader compilation if the pipeline was already created in a previous run.
+    std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+    debugAssertFunctionResult(vk::CreateGraphicsPipelines(appManager.device, appManager.pipelineCache, 1, &pipelineInfo, nullptr, &appManager.pipeline), "Pipeline Creation");
+
+    // Concept: Push Constants
+    // Push constants are a small block of data (at least 128 bytes) written directly in the command buffer with vkCmdPushConstants.
+    // They need no buffer and no descriptor, and no padding to minUniformBufferOffsetAlignment, which makes them the cheapest way to
+    // change a few bytes of data between draws. The pipeline layout declares the range of push constants each stage reads.
+    // The push constant pipeline is the same as the main one, with the per-object data (UBO) moved to the push constants.
+    appManager.pushPipeline = VK_NULL_HANDLE;
+    appManager.pushPipelineLayout = VK_NULL_HANDLE;
+    if (sizeof(UBO) <= appManager.deviceProperties.limits.maxPushConstantsSize)
+    {
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(UBO);
+
+        VkPipelineLayoutCreateInfo pushLayoutInfo = pipelineLayoutInfo;
+        pushLayoutInfo.pushConstantRangeCount = 1;
+        pushLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        debugAssertFunctionResult(vk::CreatePipelineLayout(appManager.device, &pushLayoutInfo, nullptr, &appManager.pushPipelineLayout), "Push Constant Pipeline Layout Creation");
+
+        VkPipelineShaderStageCreateInfo pushStages[] = { appManager.shaderStages[SHADER_VERTEX_PUSH], appManager.shaderStages[SHADER_FRAGMENT] };
+        pushStages[0].pSpecializationInfo = &vertexSpecializationInfo;
+
+        VkGraphicsPipelineCreateInfo pushPipelineInfo = pipelineInfo;
+        pushPipelineInfo.layout = appManager.pushPipelineLayout;
+        pushPipelineInfo.pStages = pushStages;
+
+        debugAssertFunctionResult(vk::CreateGraphicsPipelines(appManager.device, appManager.pipelineCache, 1, &pushPipelineInfo, nullptr, &appManager.pushPipeline), "Push Constant Pipeline Creation");
+    }
+    appManager.usePushConstants = USE_PUSH_CONSTANTS && appManager.pushPipeline != VK_NULL_HANDLE;
+
+    if (appManager.useIndirectPipeline)
+    {
+        // The indirect pipeline only differs in the vertex shader and the layout of set 1 (a storage buffer instead of a uniform buffer).
+        VkDescriptorSetLayout indirectSetLayout[] = { appManager.staticDescriptorSetLayout, appManager.indirectDescriptorSetLayout };
+        pipelineLayoutInfo.pSetLayouts = indirectSetLayout;
+
+        debugAssertFunctionResult(vk::CreatePipelineLayout(appManager.device, &pipelineLayoutInfo, nullptr, &appManager.indirectPipelineLayout), "Indirect Pipeline Layout Creation");
+
+        // The shader reads the per-object data as an array of vec4. The stride between objects (in vec4s) is a specialization constant.
+        uint32_t indirectConstants[] = { _getUniformDataStride(appManager) / 16, compactVertex };
+
+        VkSpecializationMapEntry specializationEntries[] = { { 0, 0, sizeof(uint32_t) }, { 1, sizeof(uint32_t), sizeof(uint32_t) } };
+        VkSpecializationInfo specializationInfo = {};
+        specializationInfo.mapEntryCount = 2;
+        specializationInfo.pMapEntries = specializationEntries;
+        specializationInfo.dataSize = sizeof(indirectConstants);
+        specializationInfo.pData = indirectConstants;
+
+        VkPipelineShaderStageCreateInfo indirectStages[] = { appManager.shaderStages[SHADER_VERTEX_INDIRECT], appManager.shaderStages[SHADER_FRAGMENT] };
+        indirectStages[0].pSpecializationInfo = &specializationInfo;
+
+        pipelineInfo.layout = appManager.indirectPipelineLayout;
+        pipelineInfo.pStages = indirectStages;
+
+        debugAssertFunctionResult(vk::CreateGraphicsPipelines(appManager.device, appManager.pipelineCache, 1, &pipelineInfo, nullptr, &appManager.indirectPipeline), "Indirect Pipeline Creation");
+    }
+
+    double creationTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    Log(false, "Pipeline creation: %.3f ms with a %s cache", creationTime, appManager.pipelineCacheWarm ? "warm" : "cold");
 }
 
 
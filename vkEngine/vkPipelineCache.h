@@ -0,0 +1,102 @@
+#ifndef VKPIPELINECACHE_H
+#define VKPIPELINECACHE_H
+
+#include <cstdio>
+#include <cstring>
+#include "vkStructs.h"
+
+// Concept: Pipeline Cache
+// Creating a pipeline compiles its SPIR-V shaders into GPU code, which is the slowest part of the initialisation. A VkPipelineCache keeps
+// the compiled code, and its contents can be retrieved with vkGetPipelineCacheData, saved to a file and given back to the driver
+// the next time the application runs, so the same pipelines are created without compiling them again.
+// The data is only valid for the same driver and GPU. It starts with a header (VkPipelineCacheHeaderVersionOne) that identifies them,
+// and a file written by a different device or driver version is discarded.
+
+// Header at the beginning of the pipeline cache data, as described by the Vulkan specification.
+struct PipelineCacheHeader
+{
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+/// <summary>Checks that the data of a pipeline cache was created by this device and driver</summary>
+inline bool _isPipelineCacheValid(AppManager& appManager, const std::vector<uint8_t>& cacheData)
+{
+    if (cacheData.size() < sizeof(PipelineCacheHeader)) return false;
+
+    PipelineCacheHeader header;
+    memcpy(&header, cacheData.data(), sizeof(PipelineCacheHeader));
+
+    return header.headerSize >= sizeof(PipelineCacheHeader) &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == appManager.deviceProperties.vendorID &&
+           header.deviceID == appManager.deviceProperties.deviceID &&
+           memcmp(header.pipelineCacheUUID, appManager.deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+/// <summary>Creates the pipeline cache with the data saved by a previous run, if there is one for this device</summary>
+inline void _initPipelineCache(AppManager& appManager)
+{
+    std::vector<uint8_t> cacheData;
+
+    FILE* cacheFile = fopen(PIPELINE_CACHE_FILE, "rb");
+    if (cacheFile)
+    {
+        fseek(cacheFile, 0L, SEEK_END);
+        long fileSize = ftell(cacheFile);
+        fseek(cacheFile, 0L, SEEK_SET);
+
+        if (fileSize > 0)
+        {
+            cacheData.resize(static_cast<size_t>(fileSize));
+            if (fread(cacheData.data(), 1, cacheData.size(), cacheFile) != cacheData.size()) cacheData.clear();
+        }
+        fclose(cacheFile);
+    }
+
+    appManager.pipelineCacheWarm = _isPipelineCacheValid(appManager, cacheData);
+    if (!appManager.pipelineCacheWarm) cacheData.clear();
+
+    VkPipelineCacheCreateInfo pipelineCacheInfo = {};
+    pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheInfo.pNext = nullptr;
+    pipelineCacheInfo.flags = 0;
+    pipelineCacheInfo.initialDataSize = cacheData.size();
+    pipelineCacheInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+    debugAssertFunctionResult(vk::CreatePipelineCache(appManager.device, &pipelineCacheInfo, nullptr, &appManager.pipelineCache), "Pipeline Cache Creation");
+
+    if (appManager.pipelineCacheWarm) Log(false, "Pipeline cache: warm, %u bytes loaded from %s", (unsigned int)cacheData.size(), PIPELINE_CACHE_FILE);
+    else Log(false, "Pipeline cache: cold, %s is missing or was written by another device or driver", PIPELINE_CACHE_FILE);
+}
+
+/// <summary>Writes the contents of the pipeline cache to disk and destroys it</summary>
+inline void _savePipelineCache(AppManager& appManager)
+{
+    size_t dataSize = 0;
+    debugAssertFunctionResult(vk::GetPipelineCacheData(appManager.device, appManager.pipelineCache, &dataSize, nullptr), "Pipeline Cache Size");
+
+    std::vector<uint8_t> cacheData(dataSize);
+    if (dataSize > 0)
+    {
+        debugAssertFunctionResult(vk::GetPipelineCacheData(appManager.device, appManager.pipelineCache, &dataSize, cacheData.data()), "Pipeline Cache Data");
+    }
+
+    FILE* cacheFile = fopen(PIPELINE_CACHE_FILE, "wb");
+    if (cacheFile)
+    {
+        fwrite(cacheData.data(), 1, dataSize, cacheFile);
+        fclose(cacheFile);
+    }
+    else
+    {
+        Log(true, "Pipeline cache: could not write %s", PIPELINE_CACHE_FILE);
+    }
+
+    vk::DestroyPipelineCache(appManager.device, appManager.pipelineCache, nullptr);
+}
+
+#endif // VKPIPELINECACHE_H
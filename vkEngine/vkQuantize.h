@@ -0,0 +1,146 @@
+#ifndef VKQUANTIZE_H
+#define VKQUANTIZE_H
+
+#include <cmath>
+#include <cstring>
+#include "vkStructs.h"
+
+// Concept: Vertex Quantization
+// Dense meshes are limited by the memory bandwidth of the vertex fetch, and 32-bit floats have more precision than a vertex needs.
+// CompactVertex stores the same data in 16 bytes instead of 32:
+// - The position as 16-bit unsigned normalized integers inside the bounding box of its object. The vertex fetch returns values in
+//   [0, 1], and the vertex shader moves them back to object space with the offset (box minimum) and scale (box size) of the object,
+//   which are part of its per-object uniform data. The error is at most 1/131070 of the box size.
+// - The normal in octahedral encoding: the unit sphere is projected on an octahedron, and the octahedron unfolded on a square,
+//   so two 16-bit signed normalized values are enough. The vertex shader decodes it.
+// - The texture coordinates as half floats, which keep the repeating UVs outside [0, 1] that normalized integers could not.
+
+/// <summary>Converts a float to a half float, rounding to the nearest value</summary>
+inline uint16_t _floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (((bits >> 23) & 0xFF) == 0xFF) return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0)); // Infinity or NaN.
+    if (exponent >= 31) return static_cast<uint16_t>(sign | 0x7C00); // Too big: infinity.
+
+    if (exponent <= 0)
+    {
+        // Denormal half, or zero if too small.
+        if (exponent < -10) return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000;
+        const uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        return static_cast<uint16_t>(sign | ((mantissa + (1u << (shift - 1))) >> shift));
+    }
+
+    // Rounding can carry into the exponent, which is still the correct result.
+    return static_cast<uint16_t>((sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+}
+
+/// <summary>Converts a half float to a float</summary>
+inline float _halfToFloat(uint16_t half)
+{
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1F;
+    const uint32_t mantissa = half & 0x3FF;
+
+    float value;
+    if (exponent == 0) value = std::ldexp(static_cast<float>(mantissa), -24); // Zero or denormal.
+    else if (exponent == 31) value = mantissa ? NAN : INFINITY;
+    else value = std::ldexp(static_cast<float>(mantissa | 0x400), static_cast<int>(exponent) - 25);
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+    bits |= sign;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+/// <summary>Returns a value in [-1, 1] as a 16-bit signed normalized integer</summary>
+inline int16_t _toSnorm16(float value)
+{
+    value = std::max(-1.0f, std::min(1.0f, value));
+    return static_cast<int16_t>(std::lround(value * 32767.0f));
+}
+
+/// <summary>Encodes a normal in octahedral form, as two 16-bit signed normalized values</summary>
+inline void _encodeOctahedral(const VEC3& normal, int16_t* outEncoded)
+{
+    // Project on the octahedron |x| + |y| + |z| = 1. The lower half (z < 0) is folded over the diagonals onto the outer triangles.
+    float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    float x = length > 0.0f ? normal.x / length : 0.0f;
+    float y = length > 0.0f ? normal.y / length : 0.0f;
+
+    if (normal.z < 0.0f)
+    {
+        float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    outEncoded[0] = _toSnorm16(x);
+    outEncoded[1] = _toSnorm16(y);
+}
+
+/// <summary>Decodes an octahedral normal (the same decoding as decodeNormal in DecodeNormal.glsl)</summary>
+inline VEC3 _decodeOctahedral(const int16_t* encoded)
+{
+    float x = std::max(encoded[0] / 32767.0f, -1.0f);
+    float y = std::max(encoded[1] / 32767.0f, -1.0f);
+    float z = 1.0f - std::fabs(x) - std::fabs(y);
+
+    if (z < 0.0f)
+    {
+        float unfoldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float unfoldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = unfoldedX;
+        y = unfoldedY;
+    }
+
+    VEC3 normal(x, y, z);
+    return normal.normalize();
+}
+
+/// <summary>Returns the quantization of the positions inside a bounding box</summary>
+inline PositionQuantization _getPositionQuantization(const VEC3& boundsMin, const VEC3& boundsMax)
+{
+    PositionQuantization quantization;
+    quantization.offset = boundsMin;
+    quantization.scale = boundsMax - boundsMin;
+    return quantization;
+}
+
+/// <summary>Encodes vertices to CompactVertex</summary>
+/// <param name="quantization">Bounding box of the positions, from _getPositionQuantization</param>
+inline void _encodeCompactVertices(const Vertex* vertices, size_t count, const PositionQuantization& quantization, CompactVertex* outVertices)
+{
+    const float* offset = &quantization.offset.x;
+    const float* scale = &quantization.scale.x;
+    float inverseScale[3];
+    for (int c = 0; c < 3; c++) inverseScale[c] = scale[c] > 0.0f ? 65535.0f / scale[c] : 0.0f;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Vertex& vertex = vertices[i];
+        CompactVertex& compact = outVertices[i];
+
+        const float* position = &vertex.pos.x;
+        for (int c = 0; c < 3; c++)
+        {
+            float quantized = (position[c] - offset[c]) * inverseScale[c];
+            compact.pos[c] = static_cast<uint16_t>(std::lround(std::max(0.0f, std::min(65535.0f, quantized))));
+        }
+        compact.pos[3] = 0;
+
+        _encodeOctahedral(vertex.nor, compact.nor);
+        compact.tex[0] = _floatToHalf(vertex.tex.u);
+        compact.tex[1] = _floatToHalf(vertex.tex.v);
+    }
+}
+
+#endif // VKQUANTIZE_H
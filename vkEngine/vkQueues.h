@@ -36,6 +36,25 @@ static void _getCompatibleQueueFamilies(AppManager& appManager, uint32_t& graphi
     }
 }
 
+/// <summary>Finds the queue family used for the uploads: a transfer-only family if there is one, the graphics family otherwise</summary>
+static uint32_t _getTransferQueueFamily(AppManager& appManager)
+{
+    // Concept: Transfer Queues
+    // Discrete GPUs usually expose a family with only VK_QUEUE_TRANSFER_BIT, backed by DMA engines that copy data in parallel with
+    // the graphics and compute work. Uploads submitted there do not delay the rendering, but the resources they write belong to the
+    // transfer family and their ownership has to be transferred to the graphics family (see vkStaging.h).
+    // A family with transfer and compute but no graphics (async compute) is the second choice.
+    uint32_t computeFamily = appManager.graphicsQueueFamilyIndex;
+    for (uint32_t i = 0; i < appManager.queueFamilyProperties.size(); i++)
+    {
+        const VkQueueFlags flags = appManager.queueFamilyProperties[i].queueFlags;
+        if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) continue;
+
+        if (!(flags & VK_QUEUE_COMPUTE_BIT)) return i;
+        if (computeFamily == appManager.graphicsQueueFamilyIndex) computeFamily = i;
+    }
+    return computeFamily;
+}
 
 /// <summary>Queries the physical device for supported queue families</summary>
 inline void _initQueuesFamilies(AppManager& appManager)
@@ -62,10 +81,20 @@ inline void _initQueuesFamilies(AppManager& appManager)
 
     // Get the indices of compatible queue families.
     _getCompatibleQueueFamilies(appManager, appManager.graphicsQueueFamilyIndex, appManager.presentQueueFamilyIndex);
+    appManager.transferQueueFamilyIndex = _getTransferQueueFamily(appManager);
+
+    if (appManager.transferQueueFamilyIndex != appManager.graphicsQueueFamilyIndex)
+    {
+        Log(false, "Transfer queue: family %u, the uploads run in parallel with the rendering", appManager.transferQueueFamilyIndex);
+    }
+    else
+    {
+        Log(false, "Transfer queue: none, the uploads are submitted to the graphics queue");
+    }
 }
 
 
-/// <summary>Creates a rendering and a present queue for executing commands</summary>
+/// <summary>Gets the rendering, present and transfer queues for executing commands</summary>
 inline void _initQueues(AppManager& appManager)
 {
     // The queues that will be used for executing commands on needs to be retrieved.
@@ -82,6 +111,13 @@ inline void _initQueues(AppManager& appManager)
     {
         vk::GetDeviceQueue(appManager.device, appManager.presentQueueFamilyIndex, 0, &appManager.presentQueue);
     }
+
+    // The uploads use the graphics queue when there is no transfer family.
+    if (appManager.transferQueueFamilyIndex == appManager.graphicsQueueFamilyIndex) { appManager.transferQueue = appManager.graphicQueue; }
+    else
+    {
+        vk::GetDeviceQueue(appManager.device, appManager.transferQueueFamilyIndex, 0, &appManager.transferQueue);
+    }
 }
 
 
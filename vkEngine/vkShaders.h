@@ -65,44 +65,71 @@ inline void _initShaders(AppManager& appManager)
     // This function loads the compiled source code (see vertshader.h and fragshader.h) and creates shader modules that are going
     // to be used by the pipeline later on.
 
-    _createShaderModule(appManager, "..\\..\\vert.spv", 0, VK_SHADER_STAGE_VERTEX_BIT);
-    _createShaderModule(appManager, "..\\..\\frag.spv", 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+    _createShaderModule(appManager, "..\\..\\vert.spv", SHADER_VERTEX, VK_SHADER_STAGE_VERTEX_BIT);
+    _createShaderModule(appManager, "..\\..\\frag.spv", SHADER_FRAGMENT, VK_SHADER_STAGE_FRAGMENT_BIT);
+
+    // Vertex shader variant for indirect drawing. It reads the per-object data from a storage buffer indexed by gl_InstanceIndex.
+    _createShaderModule(appManager, "..\\..\\vert_indirect.spv", SHADER_VERTEX_INDIRECT, VK_SHADER_STAGE_VERTEX_BIT);
+
+    // Vertex shader variant that receives the per-object data as push constants.
+    _createShaderModule(appManager, "..\\..\\vert_push.spv", SHADER_VERTEX_PUSH, VK_SHADER_STAGE_VERTEX_BIT);
+
+    // Compute shader that frustum culls the indirect draws.
+    _createShaderModule(appManager, "..\\..\\cull.spv", SHADER_COMPUTE_CULL, VK_SHADER_STAGE_COMPUTE_BIT);
+}
+
+/// <summary>Returns the size of a uniform block rounded up to the alignment of the offsets of the dynamic descriptors</summary>
+inline uint32_t _getUniformBlockStride(const AppManager& appManager, size_t blockSize)
+{
+    // Vulkan requires that when updating a descriptor of type VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, the offset specified is an integer
+    // multiple of the minimum required alignment in bytes for the physical device. The same buffers are also read as storage buffers
+    // (indirect drawing and culling), as arrays of vec4, so the stride has to satisfy the storage buffer alignment and be a multiple of 16 too.
+    size_t minimumAlignment = static_cast<size_t>(std::max(appManager.deviceProperties.limits.minUniformBufferOffsetAlignment,
+                                                           appManager.deviceProperties.limits.minStorageBufferOffsetAlignment));
+    return static_cast<uint32_t>(_getAlignedDataSize(blockSize, std::max<size_t>(minimumAlignment, 16)));
+}
+
+/// <summary>Returns the distance in bytes between the per-object blocks of the dynamic uniform buffer</summary>
+inline uint32_t _getUniformDataStride(const AppManager& appManager)
+{
+    return _getUniformBlockStride(appManager, sizeof(UBO));
 }
 
 /// <summary>Creates the uniform buffers used throughout the demo</summary>
 inline void _initUniformBuffers(AppManager& appManager)
 {
-    // This function creates a dynamic uniform buffer which will hold several transformation matrices. Each of these matrices is associated with a
-    // swapchain image created earlier.
-
-    // Vulkan requires that when updating a descriptor of type VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER or VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, the
-    // offset specified is an integer multiple of the minimum required alignment in bytes for the physical device. This also applied to any dynamic alignments used.
-    size_t minimumUboAlignment = static_cast<size_t>(appManager.deviceProperties.limits.minUniformBufferOffsetAlignment);
+    // This function creates the dynamic uniform buffers which will hold the transformation matrices: one block per object (model matrix)
+    // and one per frame (view projection matrix). Each buffer has a slice per frame in flight.
 
     // The dynamic buffers will be used as uniform buffers. These are later used with a descriptor of type VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC and VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER.
-    VkBufferUsageFlags usageFlags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    // The indirect drawing path reads the same data through a VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC descriptor.
+    VkBufferUsageFlags usageFlags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 
     {
         // Using the minimum uniform buffer offset alignment, the minimum buffer slice size is calculated based on the size of the intended data, or more specifically
         // the size of the smallest chunk of data which may be mapped or updated as a whole.
-        size_t bufferDataSizePerSwapchain = sizeof(UBO);
-        bufferDataSizePerSwapchain = static_cast<uint32_t>(_getAlignedDataSize(bufferDataSizePerSwapchain, minimumUboAlignment) * appManager.meshes.size());
+        size_t bufferDataSizePerFrame = _getUniformDataStride(appManager) * appManager.objectTransforms.size();
 
         // Calculate the size of the dynamic uniform buffer.
         // This buffer will be updated on each frame and must therefore be multi-buffered to avoid issues with using partially updated data, or updating data already in use.
-        // Rather than allocating multiple (swapchain) buffers, a larger buffer is allocated and a slice of this buffer will be used per swapchain. This works as
+        // Rather than allocating multiple buffers, a larger buffer is allocated and a slice of this buffer will be used per frame in flight. This works as
         // long as the buffer is created taking into account the minimum uniform buffer offset alignment.
-        appManager.dynamicUniformBufferData.size = bufferDataSizePerSwapchain * appManager.swapChainImages.size() ;
+        appManager.dynamicUniformBufferData.size = bufferDataSizePerFrame * MAX_FRAMES_IN_FLIGHT;
 
         // Create the buffer, allocate the device memory, and attach the memory to the newly created buffer object.
+        // The memory comes from a host visible page which the allocator keeps mapped, so mappedData is ready to be written.
         _createBuffer(appManager, appManager.dynamicUniformBufferData, nullptr, usageFlags);
-        appManager.dynamicUniformBufferData.bufferInfo.range = bufferDataSizePerSwapchain;
+        appManager.dynamicUniformBufferData.bufferInfo.range = bufferDataSizePerFrame;
+    }
+
+    {
+        // The per-frame data (view projection matrix) lives in its own small buffer, also with a slice per frame in flight, so a frame
+        // where only the camera moves does not touch the per-object data.
+        size_t frameDataSize = _getUniformBlockStride(appManager, sizeof(FrameUBO));
+        appManager.frameUniformBufferData.size = frameDataSize * MAX_FRAMES_IN_FLIGHT;
 
-        // Note that only memory created with the memory property flag VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT can be mapped.
-        // vkMapMemory retrieves a host virtual address pointer to a region of a mappable memory object.
-        debugAssertFunctionResult(vk::MapMemory(appManager.device, appManager.dynamicUniformBufferData.memory, 0, appManager.dynamicUniformBufferData.size, 0,
-                                                &appManager.dynamicUniformBufferData.mappedData),
-                                  "Could not map the uniform buffer.");
+        _createBuffer(appManager, appManager.frameUniformBufferData, nullptr, usageFlags);
+        appManager.frameUniformBufferData.bufferInfo.range = frameDataSize;
     }
 }
 #endif // VKSHADERS_H
@@ -0,0 +1,343 @@
+#ifndef VKSIMPLIFY_H
+#define VKSIMPLIFY_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "vkStructs.h"
+#include "vkMeshOptimize.h"
+
+// Concept: Mesh Simplification
+// A mesh far from the camera covers a few pixels, but it is still drawn with all its triangles. Simplified versions of the mesh
+// (levels of detail) are generated when it is loaded, and the draws use the one whose error is too small to be seen.
+// The simplification collapses edges: one vertex of the edge is moved onto the other and the triangles that shared the edge disappear.
+// The cost of a collapse is measured with quadric error metrics (Garland and Heckbert 1997): each vertex accumulates the planes of
+// its triangles as a quadric, which gives the squared distance from any point to those planes. Merging two vertices adds their
+// quadrics, so the error of the merged vertex keeps measuring the distance to all the original triangles.
+// A vertex is only moved onto an existing vertex, so the levels are just index lists that reuse the vertex buffer of the mesh.
+// Vertices split for their attributes (a UV seam or a normal crease) are moved together, along the edges of each side of the
+// split, so the seam stays closed. The vertices of an open border are never moved, so the silhouette of the mesh keeps its holes.
+
+// A symmetric 4x4 quadric: error(p) = p·A·p + 2·b·p + c, with the weight (area) of the planes it contains.
+struct Quadric
+{
+    double a00, a11, a22, a01, a02, a12;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+// A level of detail generated for a mesh.
+struct GeneratedLod
+{
+    std::vector<uint32_t> indices; // Triangle list, relative to the vertices of the mesh.
+    float error; // Distance from the simplified surface to the original one, in object space.
+};
+
+/// <summary>Adds the quadric of the plane n·p + d = 0, weighted by weight, to quadric</summary>
+static void addPlaneQuadric(Quadric& quadric, double nx, double ny, double nz, double d, double weight)
+{
+    quadric.a00 += weight * nx * nx; quadric.a11 += weight * ny * ny; quadric.a22 += weight * nz * nz;
+    quadric.a01 += weight * nx * ny; quadric.a02 += weight * nx * nz; quadric.a12 += weight * ny * nz;
+    quadric.b0 += weight * nx * d; quadric.b1 += weight * ny * d; quadric.b2 += weight * nz * d;
+    quadric.c += weight * d * d;
+    quadric.weight += weight;
+}
+
+/// <summary>Adds quadric b to quadric a</summary>
+static void addQuadric(Quadric& a, const Quadric& b)
+{
+    a.a00 += b.a00; a.a11 += b.a11; a.a22 += b.a22;
+    a.a01 += b.a01; a.a02 += b.a02; a.a12 += b.a12;
+    a.b0 += b.b0; a.b1 += b.b1; a.b2 += b.b2;
+    a.c += b.c;
+    a.weight += b.weight;
+}
+
+/// <summary>Returns the squared distance from p to the planes of a quadric, averaged by their weight</summary>
+static double getQuadricError(const Quadric& q, const VEC3& p)
+{
+    const double x = p.x, y = p.y, z = p.z;
+    double error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+                   2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+    return q.weight > 0.0 ? std::fabs(error) / q.weight : 0.0;
+}
+
+/// <summary>Returns the normal of a triangle (not normalized, its length is twice the area)</summary>
+static VEC3 getTriangleNormal(const VEC3& p0, const VEC3& p1, const VEC3& p2)
+{
+    VEC3 e1 = p1 - p0;
+    VEC3 e2 = p2 - p0;
+    return e1.crossProduct(e2);
+}
+
+/// <summary>Simplifies a triangle list by collapsing edges, until it has targetIndexCount indices or the error would exceed targetError</summary>
+/// <param name="indices">Triangle list indices, relative to vertices</param>
+/// <param name="targetError">Largest distance allowed between the simplified and the original surface, in object space</param>
+/// <param name="outIndices">Receives the simplified triangle list. It can hold indexCount indices.</param>
+/// <param name="outError">Receives the error of the simplified surface</param>
+/// <returns>Number of indices written to outIndices</returns>
+inline size_t _simplifyMesh(const uint32_t* indices, size_t indexCount, const Vertex* vertices, uint32_t vertexCount,
+                            size_t targetIndexCount, float targetError, uint32_t* outIndices, float& outError)
+{
+    outError = 0.0f;
+    std::copy(indices, indices + indexCount, outIndices);
+    if (indexCount <= targetIndexCount || vertexCount == 0) return indexCount;
+
+    // Vertices with the same position are one point of the surface: the edges and quadrics are those of the points.
+    std::vector<uint32_t> point(vertexCount);
+    std::vector<uint32_t> nextSibling(vertexCount); // Circular list of the vertices of each point.
+    {
+        struct PositionHash
+        {
+            size_t operator()(const VEC3& p) const
+            {
+                uint32_t h[3];
+                memcpy(h, &p.x, sizeof(h));
+                return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+            }
+        };
+        struct PositionEqual
+        {
+            bool operator()(const VEC3& a, const VEC3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+        };
+
+        std::unordered_map<VEC3, uint32_t, PositionHash, PositionEqual> points;
+        points.reserve(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            std::pair<std::unordered_map<VEC3, uint32_t, PositionHash, PositionEqual>::iterator, bool> inserted = points.insert(std::make_pair(vertices[v].pos, v));
+            uint32_t first = inserted.first->second;
+            point[v] = first;
+            nextSibling[v] = v;
+            if (first != v)
+            {
+                nextSibling[v] = nextSibling[first];
+                nextSibling[first] = v;
+            }
+        }
+    }
+
+    // The quadric of each point, from the planes of its triangles weighted by their area.
+    std::vector<Quadric> quadrics(vertexCount);
+    memset(quadrics.data(), 0, sizeof(Quadric) * vertexCount);
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        const VEC3& p0 = vertices[indices[i]].pos;
+        VEC3 normal = getTriangleNormal(p0, vertices[indices[i + 1]].pos, vertices[indices[i + 2]].pos);
+        float length = normal.lenght();
+        if (length == 0.0f) continue;
+
+        double nx = normal.x / length, ny = normal.y / length, nz = normal.z / length;
+        double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+        for (int k = 0; k < 3; k++) addPlaneQuadric(quadrics[point[indices[i + k]]], nx, ny, nz, d, length * 0.5);
+    }
+
+    // A point on an open border has an edge without the opposite edge. Those points are locked.
+    std::vector<uint8_t> locked(vertexCount, 0);
+    {
+        std::unordered_map<uint64_t, uint32_t> edges; // Directed point edge, number of times it is used.
+        edges.reserve(indexCount);
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t a = point[indices[i + k]], b = point[indices[i + (k + 1) % 3]];
+                edges[(uint64_t(a) << 32) | b]++;
+            }
+        }
+        for (const std::pair<const uint64_t, uint32_t>& edge : edges)
+        {
+            uint32_t a = static_cast<uint32_t>(edge.first >> 32), b = static_cast<uint32_t>(edge.first);
+            if (edges.find((uint64_t(b) << 32) | a) == edges.end()) locked[a] = locked[b] = 1;
+        }
+    }
+
+    struct Collapse
+    {
+        uint32_t from, to; // Points.
+        double error;
+    };
+
+    const double maxError = static_cast<double>(targetError) * targetError;
+    double resultError = 0.0;
+    size_t resultCount = indexCount;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<uint8_t> touched(vertexCount);
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1), pointTriangles;
+    std::vector<Collapse> collapses;
+
+    while (resultCount > targetIndexCount)
+    {
+        // Triangles around each point, to check the collapses.
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for (size_t i = 0; i < resultCount; i++) triangleOffsets[point[outIndices[i]] + 1]++;
+        for (uint32_t p = 0; p < vertexCount; p++) triangleOffsets[p + 1] += triangleOffsets[p];
+        pointTriangles.resize(resultCount);
+        {
+            std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+            for (size_t i = 0; i < resultCount; i++) pointTriangles[fill[point[outIndices[i]]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        // Every edge of the unlocked points is a candidate, in both directions, sorted from the cheapest.
+        collapses.clear();
+        for (size_t i = 0; i < resultCount; i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t a = point[outIndices[i + k]], b = point[outIndices[i + (k + 1) % 3]];
+                if (a == b) continue;
+
+                Quadric merged = quadrics[a];
+                addQuadric(merged, quadrics[b]);
+                if (!locked[a]) collapses.push_back({ a, b, getQuadricError(merged, vertices[b].pos) });
+                if (!locked[b]) collapses.push_back({ b, a, getQuadricError(merged, vertices[a].pos) });
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+        for (uint32_t v = 0; v < vertexCount; v++) remap[v] = v;
+        std::fill(touched.begin(), touched.end(), 0);
+
+        // Each pass collapses the cheapest edges whose neighbourhoods do not overlap, so the checks stay valid.
+        size_t removedTriangles = 0;
+        const size_t maxRemovedTriangles = (resultCount - targetIndexCount) / 3;
+        size_t applied = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (collapse.error > maxError || removedTriangles >= maxRemovedTriangles) break;
+            if (touched[collapse.from] || touched[collapse.to]) continue;
+
+            const VEC3& target = vertices[collapse.to].pos;
+
+            // Every vertex of the point moves to the vertex of the target point it has an edge with, the one on the same side of a seam.
+            bool valid = true;
+            uint32_t v = collapse.from;
+            do
+            {
+                uint32_t destination = vertexCount;
+                for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1] && destination == vertexCount; t++)
+                {
+                    const uint32_t* triangle = &outIndices[pointTriangles[t] * 3];
+                    if (triangle[0] != v && triangle[1] != v && triangle[2] != v) continue;
+                    for (int k = 0; k < 3; k++) if (point[triangle[k]] == collapse.to) destination = triangle[k];
+                }
+                if (destination == vertexCount)
+                {
+                    // The vertex is not connected to the target point: its side of the seam would be stretched.
+                    bool used = false;
+                    for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1] && !used; t++)
+                    {
+                        const uint32_t* triangle = &outIndices[pointTriangles[t] * 3];
+                        used = triangle[0] == v || triangle[1] == v || triangle[2] == v;
+                    }
+                    if (used) { valid = false; break; }
+                }
+                remap[v] = destination == vertexCount ? v : destination;
+                v = nextSibling[v];
+            } while (v != collapse.from);
+
+            // The triangles that stay must not flip.
+            size_t removed = 0;
+            for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1] && valid; t++)
+            {
+                const uint32_t* triangle = &outIndices[pointTriangles[t] * 3];
+                uint32_t p[3] = { point[triangle[0]], point[triangle[1]], point[triangle[2]] };
+                if (p[0] == collapse.to || p[1] == collapse.to || p[2] == collapse.to) { removed++; continue; }
+
+                VEC3 before = getTriangleNormal(vertices[triangle[0]].pos, vertices[triangle[1]].pos, vertices[triangle[2]].pos);
+                VEC3 after = getTriangleNormal(p[0] == collapse.from ? target : vertices[triangle[0]].pos,
+                                               p[1] == collapse.from ? target : vertices[triangle[1]].pos,
+                                               p[2] == collapse.from ? target : vertices[triangle[2]].pos);
+                // Rotating a triangle too much folds the surface over itself, even if the triangle does not flip completely.
+                if (before.dotProduct(after) <= 0.25f * before.lenght() * after.lenght()) valid = false;
+            }
+
+            if (!valid)
+            {
+                v = collapse.from;
+                do { remap[v] = v; v = nextSibling[v]; } while (v != collapse.from);
+                continue;
+            }
+
+            // Lock the neighbourhood for the rest of the pass.
+            for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1]; t++)
+            {
+                const uint32_t* triangle = &outIndices[pointTriangles[t] * 3];
+                for (int k = 0; k < 3; k++) touched[point[triangle[k]]] = 1;
+            }
+
+            addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            resultError = std::max(resultError, collapse.error);
+            removedTriangles += removed;
+            applied++;
+        }
+
+        if (applied == 0) break;
+
+        // Apply the collapses and remove the triangles that became degenerate.
+        size_t writeCount = 0;
+        for (size_t i = 0; i < resultCount; i += 3)
+        {
+            uint32_t a = remap[outIndices[i]], b = remap[outIndices[i + 1]], c = remap[outIndices[i + 2]];
+            if (point[a] == point[b] || point[b] == point[c] || point[a] == point[c]) continue;
+            outIndices[writeCount++] = a;
+            outIndices[writeCount++] = b;
+            outIndices[writeCount++] = c;
+        }
+        resultCount = writeCount;
+    }
+
+    outError = static_cast<float>(std::sqrt(resultError));
+    return resultCount;
+}
+
+/// <summary>Generates the levels of detail of a mesh, each one with about half the triangles of the previous one</summary>
+/// <param name="indices">Triangle list indices of the full mesh, relative to vertices</param>
+/// <param name="radius">Radius of the bounding sphere of the mesh, the errors are relative to it</param>
+/// <param name="outLods">Receives the levels after the full mesh, at most MAX_MESH_LODS - 1. Stops when a level does not reduce enough.</param>
+inline void _generateMeshLods(const uint32_t* indices, size_t indexCount, const Vertex* vertices, uint32_t vertexCount, float radius,
+                              std::vector<GeneratedLod>& outLods)
+{
+    outLods.clear();
+    const float maxError = LOD_MAX_ERROR * radius;
+
+    std::vector<uint32_t> source(indices, indices + indexCount);
+    float sourceError = 0.0f;
+
+    for (uint32_t level = 1; level < MAX_MESH_LODS; level++)
+    {
+        // Each level is simplified from the previous one, which is faster and keeps the levels nested.
+        size_t targetIndexCount = (source.size() / 3 / 2) * 3;
+        if (targetIndexCount < LOD_MIN_TRIANGLES * 3) break;
+
+        GeneratedLod lod;
+        lod.indices.resize(source.size());
+        float error = 0.0f;
+        size_t count = _simplifyMesh(source.data(), source.size(), vertices, vertexCount, targetIndexCount, maxError, lod.indices.data(), error);
+
+        // A level that removes few triangles costs memory for nothing.
+        if (count == 0 || count * 4 > source.size() * 3) break;
+
+        // The error is measured against the previous level, which is already off the full mesh by its own error: the bound to the
+        // full mesh is their sum.
+        lod.indices.resize(count);
+        lod.error = sourceError + error;
+
+#if OPTIMIZE_MESHES
+        // The vertices are shared with the full mesh, so only the triangle order can be optimized.
+        std::vector<uint32_t> optimized(count);
+        std::vector<uint32_t> clusterStarts;
+        _optimizeVertexCache(lod.indices.data(), count, vertexCount, VERTEX_CACHE_SIZE, optimized.data(), clusterStarts);
+        lod.indices.swap(optimized);
+#endif
+
+        source = lod.indices;
+        sourceError = lod.error;
+        outLods.push_back(lod);
+    }
+}
+
+#endif // VKSIMPLIFY_H
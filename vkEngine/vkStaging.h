@@ -0,0 +1,484 @@
+#ifndef VKSTAGING_H
+#define VKSTAGING_H
+
+#include <algorithm>
+#include "vkStructs.h"
+#include "vkMemory.h"
+
+// Concept: Staging
+// Memory that the CPU can write to is not the fastest memory for the GPU to read from. On discrete GPUs, host visible memory lives in
+// system RAM and every vertex fetch from it crosses the PCIe bus. The usual approach is to write the data into a host visible "staging"
+// buffer and let the GPU copy it into a device local buffer with vkCmdCopyBuffer.
+// On unified memory architectures (most mobile and integrated GPUs) device local memory is also host visible, so the extra copy
+// is pure overhead and buffers are written directly.
+// Textures are always staged: they use optimal tiling, an implementation-defined layout that only vkCmdCopyBufferToImage can write.
+// All the copies, and the layout transitions of the images, are batched in one command buffer, instead of a submit per texture.
+
+// Concept: Asynchronous Uploads
+// The batches are submitted to the transfer queue and the CPU does not wait for them. Every batch signals a fence, which is polled at
+// the beginning of each frame, and a semaphore. The first frame that finds the fence signalled waits on the semaphore, so the GPU
+// only waits for the uploads the frame is going to use, and the render loop keeps running while the data streams in.
+// Resources created with VK_SHARING_MODE_EXCLUSIVE belong to one queue family. When the transfer queue is a different family, each
+// batch releases its buffers and images with a barrier on the transfer queue and the frame acquires them with the same barrier on
+// the graphics queue, before the first draw that reads them.
+// Each batch has a serial, which the textures and the shared buffers it uploads keep. A texture is resident once all the batches up
+// to its serial have been acquired, so the meshes appear as their textures arrive. All the meshes read the same vertex and index
+// buffers, so the geometry becomes resident as a whole.
+
+// Alignment of the image data in the ring. A bufferOffset of vkCmdCopyBufferToImage must be a multiple of 4 and of the texel
+// (or compressed block) size: 48 is a multiple of every size used (1, 2, 3, 4, 8 and 16 bytes).
+#define STAGING_IMAGE_ALIGNMENT 48
+
+/// <summary>Checks the memory properties to find out if device local memory can be mapped by the CPU</summary>
+inline bool _isUnifiedMemory(AppManager& appManager)
+{
+    const VkPhysicalDeviceMemoryProperties& memoryProperties = appManager.deviceMemoryProperties;
+
+    // A discrete GPU has at least one heap that is not device local (system RAM). A UMA device has all of its heaps device local.
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+    {
+        if (!(memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) return false;
+    }
+
+    // It also needs a memory type that is both device local and host visible.
+    const VkMemoryPropertyFlags umaFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+    {
+        if ((memoryProperties.memoryTypes[i].propertyFlags & umaFlags) == umaFlags) return true;
+    }
+
+    return false;
+}
+
+
+/// <summary>Creates the staging ring and the command pool of the transfer queue</summary>
+inline void _initStagingBuffer(AppManager& appManager)
+{
+    appManager.unifiedMemory = _isUnifiedMemory(appManager);
+    Log(false, "Memory architecture: %s", appManager.unifiedMemory ? "unified, geometry is written directly" : "discrete, geometry is staged");
+
+    // The ring is needed on unified memory devices too, for the textures.
+    StagingBuffer& staging = appManager.staging;
+
+    // The ring is created once and reused for every upload, it is mapped for its whole lifetime.
+    staging.buffer.size = STAGING_BUFFER_SIZE;
+    _createBuffer(appManager, staging.buffer, nullptr, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    staging.head = 0;
+
+    // The copies are recorded in command buffers of the transfer queue family. Each one is submitted once.
+    VkCommandPoolCreateInfo commandPoolInfo = {};
+    commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolInfo.pNext = nullptr;
+    commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    commandPoolInfo.queueFamilyIndex = appManager.transferQueueFamilyIndex;
+
+    debugAssertFunctionResult(vk::CreateCommandPool(appManager.device, &commandPoolInfo, nullptr, &staging.commandPool), "Staging Command Pool Creation");
+}
+
+/// <summary>Waits until the GPU has finished reading the ring, so it can be written again</summary>
+inline void _waitForStagingRing(AppManager& appManager)
+{
+    StagingBuffer& staging = appManager.staging;
+    if (staging.ringFence == VK_NULL_HANDLE) return;
+
+    debugAssertFunctionResult(vk::WaitForFences(appManager.device, 1, &staging.ringFence, VK_TRUE, FENCE_TIMEOUT), "Staging Ring Fence Wait");
+    staging.ringFence = VK_NULL_HANDLE;
+}
+
+/// <summary>Allocates a primary command buffer from a pool and begins its recording</summary>
+inline VkCommandBuffer _beginStagingCommandBuffer(AppManager& appManager, VkCommandPool commandPool)
+{
+    VkCommandBuffer cmdBuffer;
+
+    VkCommandBufferAllocateInfo commandAllocateInfo = {};
+    commandAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandAllocateInfo.pNext = nullptr;
+    commandAllocateInfo.commandPool = commandPool;
+    commandAllocateInfo.commandBufferCount = 1;
+    commandAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+    debugAssertFunctionResult(vk::AllocateCommandBuffers(appManager.device, &commandAllocateInfo, &cmdBuffer), "Staging Command Buffer Allocation");
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.pNext = nullptr;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = nullptr;
+
+    debugAssertFunctionResult(vk::BeginCommandBuffer(cmdBuffer, &beginInfo), "Staging Command Buffer Begin");
+    return cmdBuffer;
+}
+
+/// <summary>Submits all the pending copies in a single command buffer to the transfer queue, without waiting for them</summary>
+inline void _flushStagingBuffer(AppManager& appManager)
+{
+    StagingBuffer& staging = appManager.staging;
+    if (staging.copies.empty() && staging.images.empty()) return;
+
+    const bool transferOwnership = appManager.transferQueueFamilyIndex != appManager.graphicsQueueFamilyIndex;
+
+    StagingBatch batch;
+    batch.frameId = -1;
+    batch.cmdBuffer = _beginStagingCommandBuffer(appManager, staging.commandPool);
+    batch.acquireCmdBuffer = VK_NULL_HANDLE;
+    batch.serial = staging.submitCount + 1;
+    VkCommandBuffer cmdBuffer = batch.cmdBuffer;
+
+    for (size_t i = 0; i < staging.copies.size(); i++)
+    {
+        vk::CmdCopyBuffer(cmdBuffer, staging.srcBuffers[i], staging.dstBuffers[i], 1, &staging.copies[i]);
+    }
+
+    // The images are moved to the transfer layout with one barrier, copied, and moved to the shader layout with a second one.
+    // Whole mip levels are copied, which is always allowed by the image transfer granularity of a transfer queue.
+    std::vector<VkImageMemoryBarrier> imageBarriers(staging.images.size());
+    for (size_t i = 0; i < staging.images.size(); i++)
+    {
+        VkImageMemoryBarrier& imageBarrier = imageBarriers[i];
+        imageBarrier = {};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.pNext = nullptr;
+        imageBarrier.srcAccessMask = 0;
+        imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = staging.images[i].image;
+        imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, staging.images[i].mipLevels, 0, 1 };
+    }
+
+    if (!imageBarriers.empty())
+    {
+        vk::CmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                               static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+    }
+
+    for (size_t i = 0; i < staging.images.size(); i++)
+    {
+        const StagingImage& image = staging.images[i];
+        vk::CmdCopyBufferToImage(cmdBuffer, image.srcBuffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 image.regionCount, &staging.imageCopies[image.firstRegion]);
+    }
+
+    // The copies are followed by a barrier that makes them visible to the vertex input, indirect, compute and fragment stages,
+    // and moves the images to the shader layout.
+    const VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    const VkAccessFlags dstAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+    for (VkImageMemoryBarrier& imageBarrier : imageBarriers)
+    {
+        imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    if (!transferOwnership)
+    {
+        // Same queue family: a single barrier, recorded after the copies.
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.pNext = nullptr;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+
+        vk::CmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStages, 0, 1, &barrier, 0, nullptr,
+                               static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+    }
+    else
+    {
+        // Different queue families: the same barrier is recorded twice, as a release on the transfer queue (which only supports the
+        // transfer stage, so the destination is bottom of pipe) and as an acquire on the graphics queue. The layout transition
+        // of the images happens once, between the two. The buffers are released and acquired whole.
+        std::vector<VkBuffer> buffers(staging.dstBuffers);
+        std::sort(buffers.begin(), buffers.end());
+        buffers.erase(std::unique(buffers.begin(), buffers.end()), buffers.end());
+
+        std::vector<VkBufferMemoryBarrier> bufferBarriers(buffers.size());
+        for (size_t i = 0; i < buffers.size(); i++)
+        {
+            VkBufferMemoryBarrier& bufferBarrier = bufferBarriers[i];
+            bufferBarrier = {};
+            bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            bufferBarrier.pNext = nullptr;
+            bufferBarrier.buffer = buffers[i];
+            bufferBarrier.offset = 0;
+            bufferBarrier.size = VK_WHOLE_SIZE;
+        }
+
+        for (int acquire = 0; acquire < 2; acquire++)
+        {
+            for (VkBufferMemoryBarrier& bufferBarrier : bufferBarriers)
+            {
+                bufferBarrier.srcAccessMask = acquire ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+                bufferBarrier.dstAccessMask = acquire ? dstAccess : 0;
+                bufferBarrier.srcQueueFamilyIndex = appManager.transferQueueFamilyIndex;
+                bufferBarrier.dstQueueFamilyIndex = appManager.graphicsQueueFamilyIndex;
+            }
+            for (VkImageMemoryBarrier& imageBarrier : imageBarriers)
+            {
+                imageBarrier.srcAccessMask = acquire ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+                imageBarrier.dstAccessMask = acquire ? VK_ACCESS_SHADER_READ_BIT : 0;
+                imageBarrier.srcQueueFamilyIndex = appManager.transferQueueFamilyIndex;
+                imageBarrier.dstQueueFamilyIndex = appManager.graphicsQueueFamilyIndex;
+            }
+
+            // The acquire waits for the semaphore of the batch, which the frame waits for at all the stages.
+            if (acquire) cmdBuffer = batch.acquireCmdBuffer = _beginStagingCommandBuffer(appManager, appManager.commandPool);
+
+            const VkPipelineStageFlags srcStageMask = acquire ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+            const VkPipelineStageFlags dstStageMask = acquire ? dstStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+            vk::CmdPipelineBarrier(cmdBuffer, srcStageMask, dstStageMask, 0, 0, nullptr,
+                                   static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+                                   static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+            if (acquire) debugAssertFunctionResult(vk::EndCommandBuffer(cmdBuffer), "Staging Acquire Command Buffer End");
+        }
+    }
+
+    debugAssertFunctionResult(vk::EndCommandBuffer(batch.cmdBuffer), "Staging Command Buffer End");
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = nullptr;
+    semaphoreInfo.flags = 0;
+
+    debugAssertFunctionResult(vk::CreateSemaphore(appManager.device, &semaphoreInfo, nullptr, &batch.semaphore), "Staging Semaphore Creation");
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.pNext = nullptr;
+    fenceInfo.flags = 0;
+
+    debugAssertFunctionResult(vk::CreateFence(appManager.device, &fenceInfo, nullptr, &batch.fence), "Staging Fence Creation");
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = nullptr;
+    submitInfo.waitSemaphoreCount = 0;
+    submitInfo.pWaitSemaphores = nullptr;
+    submitInfo.pWaitDstStageMask = nullptr;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.cmdBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &batch.semaphore;
+
+    debugAssertFunctionResult(vk::QueueSubmit(appManager.transferQueue, 1, &submitInfo, batch.fence), "Staging Submit");
+
+    // The ring is written again from the start, once the GPU has finished reading it (see _waitForStagingRing).
+    batch.largeBuffers.swap(staging.largeBuffers);
+    staging.ringFence = batch.fence;
+    staging.batches.push_back(batch);
+    staging.pendingBatches++;
+
+    staging.copies.clear();
+    staging.srcBuffers.clear();
+    staging.dstBuffers.clear();
+    staging.images.clear();
+    staging.imageCopies.clear();
+    staging.head = 0;
+    staging.submitCount++;
+}
+
+/// <summary>Destroys a batch and its staging buffers</summary>
+inline void _destroyStagingBatch(AppManager& appManager, StagingBatch& batch)
+{
+    if (appManager.staging.ringFence == batch.fence) appManager.staging.ringFence = VK_NULL_HANDLE;
+
+    for (BufferData& largeBuffer : batch.largeBuffers) _destroyBuffer(appManager, largeBuffer);
+
+    vk::FreeCommandBuffers(appManager.device, appManager.staging.commandPool, 1, &batch.cmdBuffer);
+    if (batch.acquireCmdBuffer != VK_NULL_HANDLE) vk::FreeCommandBuffers(appManager.device, appManager.commandPool, 1, &batch.acquireCmdBuffer);
+    vk::DestroySemaphore(appManager.device, batch.semaphore, nullptr);
+    vk::DestroyFence(appManager.device, batch.fence, nullptr);
+}
+
+/// <summary>Called at the beginning of a frame, after its fence has been signalled. Acquires the batches that have finished uploading.</summary>
+inline void _acquireStagingBatches(AppManager& appManager)
+{
+    StagingBuffer& staging = appManager.staging;
+    const int32_t frameId = static_cast<int32_t>(appManager.frameId);
+
+    // The batches acquired the last time this frame in flight was used are no longer in use by the GPU.
+    for (size_t i = 0; i < staging.batches.size();)
+    {
+        if (staging.batches[i].frameId == frameId)
+        {
+            _destroyStagingBatch(appManager, staging.batches[i]);
+            staging.batches.erase(staging.batches.begin() + i);
+        }
+        else i++;
+    }
+
+    staging.acquireSemaphores.clear();
+    staging.acquireCmdBuffers.clear();
+
+    // The copies still queued in the ring go in the next submit, so its serial is not resident yet.
+    staging.residentSerial = staging.submitCount + 1;
+    if (staging.pendingBatches == 0) return;
+
+    // A batch is acquired by the first frame that finds its fence signalled, so the semaphore wait does not stall the GPU.
+    // The fences may be signalled out of order: the resident serials stop at the first batch still uploading.
+    for (StagingBatch& batch : staging.batches)
+    {
+        if (batch.frameId == -1 && vk::GetFenceStatus(appManager.device, batch.fence) == VK_SUCCESS)
+        {
+            batch.frameId = frameId;
+            staging.acquireSemaphores.push_back(batch.semaphore);
+            if (batch.acquireCmdBuffer != VK_NULL_HANDLE) staging.acquireCmdBuffers.push_back(batch.acquireCmdBuffer);
+            staging.pendingBatches--;
+        }
+        if (batch.frameId == -1) staging.residentSerial = std::min(staging.residentSerial, batch.serial);
+    }
+
+    if (staging.pendingBatches == 0)
+    {
+        Log(false, "Staging - all the uploads are resident, %u frames were presented while they were running", staging.streamingFrames);
+        staging.streamingFrames = 0;
+    }
+    else
+    {
+        staging.streamingFrames++;
+    }
+}
+
+/// <summary>Returns true if the data of a staging batch can be used by the frame being recorded</summary>
+/// <param name="serial">Serial of the batch that uploads the data, 0 if it was written directly</param>
+inline bool _isUploadResident(const AppManager& appManager, uint32_t serial)
+{
+    return serial < appManager.staging.residentSerial;
+}
+
+/// <summary>Returns true if a texture exists and its upload can be used by the frame being recorded</summary>
+/// <remarks>A texture index outside appManager.textures has no descriptor set either, so the draws that use it are skipped.</remarks>
+inline bool _isTextureResident(const AppManager& appManager, uint32_t textureID)
+{
+    return textureID < appManager.textures.size() && _isUploadResident(appManager, appManager.textures[textureID].uploadSerial);
+}
+
+/// <summary>Creates a buffer in device local memory and queues the upload of its data through the staging ring</summary>
+/// <param name="inBuffer">Buffer to create. inBuffer.size must be set.</param>
+/// <param name="inData">Data to be copied into the buffer</param>
+/// <param name="inUsage">Usage flag which determines what type of buffer will be created</param>
+inline void _createDeviceLocalBuffer(AppManager& appManager, BufferData& inBuffer, const uint8_t* inData, const VkBufferUsageFlags& inUsage)
+{
+    // On UMA devices write the data straight into device local, host visible memory.
+    if (appManager.unifiedMemory)
+    {
+        _createBuffer(appManager, inBuffer, inData, inUsage,
+                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        return;
+    }
+
+    _createBuffer(appManager, inBuffer, nullptr, inUsage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    StagingBuffer& staging = appManager.staging;
+
+    // The whole buffer is copied in one batch: with different queue families, the batch releases the buffer to the graphics queue,
+    // so no later batch could write to it. A buffer bigger than the ring gets its own staging buffer, like the large images.
+    VkBufferCopy copy = {};
+    copy.dstOffset = 0;
+    copy.size = inBuffer.size;
+
+    if (inBuffer.size > staging.buffer.size)
+    {
+        BufferData largeBuffer;
+        largeBuffer.size = inBuffer.size;
+        _createBuffer(appManager, largeBuffer, inData, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+        staging.largeBuffers.push_back(largeBuffer);
+
+        copy.srcOffset = 0;
+        staging.srcBuffers.push_back(largeBuffer.buffer);
+    }
+    else
+    {
+        VkDeviceSize srcOffset = _getAlignedDataSize(static_cast<size_t>(staging.head), 16);
+        if (srcOffset + inBuffer.size > staging.buffer.size)
+        {
+            _flushStagingBuffer(appManager);
+            srcOffset = 0;
+        }
+
+        _waitForStagingRing(appManager);
+        memcpy(static_cast<uint8_t*>(staging.buffer.mappedData) + srcOffset, inData, inBuffer.size);
+        staging.head = srcOffset + inBuffer.size;
+
+        copy.srcOffset = srcOffset;
+        staging.srcBuffers.push_back(staging.buffer.buffer);
+    }
+
+    staging.copies.push_back(copy);
+    staging.dstBuffers.push_back(inBuffer.buffer);
+    staging.bufferSerial = staging.submitCount + 1;
+}
+
+/// <summary>Queues the upload of all the regions of an image. The image is in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL after the flush.</summary>
+/// <param name="inImage">Image to upload, in VK_IMAGE_LAYOUT_UNDEFINED</param>
+/// <param name="inData">Data of all the regions</param>
+/// <param name="inSize">Size of inData</param>
+/// <param name="inRegions">Regions to copy, with their bufferOffset relative to inData</param>
+/// <param name="inMipLevels">Number of mip levels of the image</param>
+/// <returns>Serial of the batch the upload is submitted with</returns>
+inline uint32_t _queueImageUpload(AppManager& appManager, VkImage inImage, const uint8_t* inData, VkDeviceSize inSize,
+                              const std::vector<VkBufferImageCopy>& inRegions, uint32_t inMipLevels)
+{
+    StagingBuffer& staging = appManager.staging;
+
+    StagingImage image;
+    image.image = inImage;
+    image.mipLevels = inMipLevels;
+    image.firstRegion = static_cast<uint32_t>(staging.imageCopies.size());
+    image.regionCount = static_cast<uint32_t>(inRegions.size());
+
+    VkDeviceSize srcOffset = 0;
+    if (inSize > staging.buffer.size)
+    {
+        // The regions of an image are copied together, so an image bigger than the ring gets its own staging buffer.
+        BufferData largeBuffer;
+        largeBuffer.size = static_cast<size_t>(inSize);
+        _createBuffer(appManager, largeBuffer, inData, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+        staging.largeBuffers.push_back(largeBuffer);
+        image.srcBuffer = largeBuffer.buffer;
+    }
+    else
+    {
+        srcOffset = _getAlignedDataSize(static_cast<size_t>(staging.head), STAGING_IMAGE_ALIGNMENT);
+        if (srcOffset + inSize > staging.buffer.size)
+        {
+            _flushStagingBuffer(appManager);
+            srcOffset = 0;
+            image.firstRegion = 0;
+        }
+
+        _waitForStagingRing(appManager);
+        memcpy(static_cast<uint8_t*>(staging.buffer.mappedData) + srcOffset, inData, static_cast<size_t>(inSize));
+        staging.head = srcOffset + inSize;
+        image.srcBuffer = staging.buffer.buffer;
+    }
+
+    for (VkBufferImageCopy region : inRegions)
+    {
+        region.bufferOffset += srcOffset;
+        staging.imageCopies.push_back(region);
+    }
+    staging.images.push_back(image);
+
+    return staging.submitCount + 1;
+}
+
+/// <summary>Destroys the staging ring, the batches and the objects used to submit them. The device must be idle.</summary>
+inline void _destroyStagingBuffer(AppManager& appManager)
+{
+    StagingBuffer& staging = appManager.staging;
+    if (staging.buffer.buffer == VK_NULL_HANDLE) return;
+
+    for (StagingBatch& batch : staging.batches) _destroyStagingBatch(appManager, batch);
+    staging.batches.clear();
+
+    vk::DestroyCommandPool(appManager.device, staging.commandPool, nullptr);
+    _destroyBuffer(appManager, staging.buffer);
+}
+
+#endif // VKSTAGING_H
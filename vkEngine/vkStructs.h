@@ -1,43 +1,209 @@
 #ifndef VKSTRUCTS_H
 #define VKSTRUCTS_H
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include "vk_getProcAddrs.h"
 #include "vkMath.h"
 
 #define FENCE_TIMEOUT 0xFFFFFFFFFFFFFFFFL
+#define MEMORY_PAGE_SIZE (64 * 1024 * 1024) // Default size of the device memory pages used by the allocator.
+#define STAGING_BUFFER_SIZE (16 * 1024 * 1024) // Size of the staging ring used to upload geometry.
+
+#ifndef USE_INDIRECT_DRAW
+#define USE_INDIRECT_DRAW 1 // Draw the meshes with vkCmdDrawIndexedIndirect when the device supports it.
+#endif
+
+#ifndef USE_GPU_CULLING
+#define USE_GPU_CULLING 1 // Frustum cull the indirect draws in a compute shader. Requires USE_INDIRECT_DRAW.
+#endif
+#define CULLING_GROUP_SIZE 64 // local_size_x of CullMeshes.comp.
+#ifndef MAX_FRAMES_IN_FLIGHT
+#define MAX_FRAMES_IN_FLIGHT 2 // Frames the CPU can record while the GPU is still rendering the previous ones.
+#endif
+#ifndef RUN_BENCHMARKS
+#define RUN_BENCHMARKS 0 // Log the timings of the CPU kernels at start up (see vkBenchmark.h).
+#endif
+#ifndef USE_PUSH_CONSTANTS
+#define USE_PUSH_CONSTANTS 1 // Direct drawing sends the per-object data with vkCmdPushConstants instead of a dynamic uniform buffer offset.
+#endif
+#define MAX_WORKER_THREADS 8 // Upper limit of worker threads (glTF decoding, transforms and secondary command buffer recording).
+#define PIPELINE_CACHE_FILE "pipeline_cache.bin" // Compiled pipelines saved between runs (see vkPipelineCache.h).
+#define TRANSFORM_PARALLEL_MIN_OBJECTS 1024 // Scenes with fewer objects compute their transforms on the calling thread only.
+#ifndef OPTIMIZE_MESHES
+#define OPTIMIZE_MESHES 1 // Reorder the triangles and vertices of the meshes for the post-transform cache when they are loaded (see vkMeshOptimize.h).
+#endif
+#ifndef OPTIMIZE_OVERDRAW
+#define OPTIMIZE_OVERDRAW 1 // Also sort clusters of triangles to reduce overdraw. Requires OPTIMIZE_MESHES.
+#endif
+#ifndef USE_COMPACT_VERTEX
+#define USE_COMPACT_VERTEX 1 // Store the vertices quantized to 16 bytes (CompactVertex, see vkQuantize.h) instead of 32 (Vertex).
+#endif
+#ifndef GENERATE_MESH_LODS
+#define GENERATE_MESH_LODS 1 // Generate simplified levels of detail of the meshes when they are loaded (see vkSimplify.h and vkLod.h).
+#endif
+#define MAX_MESH_LODS 4 // Levels of detail of a mesh, the full mesh included. CullMeshes.comp reads their errors as a vec4.
+#define LOD_MAX_ERROR 0.05f // Largest error of a level of detail, relative to the radius of the mesh.
+#define LOD_MIN_TRIANGLES 64 // Meshes (and levels) with fewer triangles are not simplified further.
+#define LOD_PIXEL_ERROR 1.0f // A level of detail is drawn when its error projects to at most this number of pixels.
+#ifndef USE_MESHLETS
+#define USE_MESHLETS 1 // Split the large meshes into meshlets culled one by one by the GPU culling (see vkMeshlets.h). Requires USE_GPU_CULLING.
+#endif
+#define MESHLET_MAX_VERTICES 64 // Vertices of a meshlet.
+#define MESHLET_MAX_TRIANGLES 124 // Triangles of a meshlet.
+#define MESHLET_MIN_MESH_TRIANGLES 4096 // Meshes with fewer triangles are culled whole.
+#define VERTEX_CACHE_SIZE 16 // Entries of the post-transform cache simulated by the mesh optimization.
+#define INDEX_SECTION_COUNT 3 // Sections of the index buffer: 8, 16 and 32-bit indices (see vkIndices.h).
+
+// Indices of the shader stages in AppManager::shaderStages.
+#define SHADER_VERTEX 0
+#define SHADER_FRAGMENT 1
+#define SHADER_VERTEX_INDIRECT 2
+#define SHADER_COMPUTE_CULL 3
+#define SHADER_VERTEX_PUSH 4
+#define NUM_SHADER_STAGES 5
 
 inline size_t _getAlignedDataSize(size_t dataSize, size_t minimumAlignment){
     return (dataSize / minimumAlignment) * minimumAlignment + ((dataSize % minimumAlignment) > 0 ? minimumAlignment : 0);
 }
 
+// A sub-allocation handed out by the memory allocator (see vkMemory.h).
+// "memory" is the page the resource lives in and "offset" is where it starts inside that page.
+struct MemoryAllocation
+{
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint32_t memoryTypeIndex;
+    uint32_t pageIndex;
+    void* mappedData; // Only valid for host visible memory.
+
+    MemoryAllocation() : memory(VK_NULL_HANDLE), offset(0), size(0), memoryTypeIndex(0), pageIndex(0), mappedData(nullptr) {}
+};
+
+// A free or used range inside a memory page.
+struct MemoryBlock
+{
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    bool free;
+};
+
+// A large VkDeviceMemory allocation that is split into blocks.
+// Buffers (linear) and optimal tiled images never share a page so bufferImageGranularity can be ignored.
+struct MemoryPage
+{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    VkDeviceSize used;
+    uint32_t memoryTypeIndex;
+    bool linear;
+    bool dedicated;
+    void* mappedData;
+    std::vector<MemoryBlock> blocks; // Sorted by offset.
+};
+
+struct MemoryAllocator
+{
+    std::vector<MemoryPage> pages;
+    VkDeviceSize pageSize;
+    uint32_t allocationCount;
+
+    MemoryAllocator() : pageSize(MEMORY_PAGE_SIZE), allocationCount(0) {}
+};
+
 struct SwapchainImage
 {
     VkImage image;
     VkImageView view;
+    VkImage depth_image;
+    MemoryAllocation depth_memory;
     VkImageView depth_view;
 };
 
 struct BufferData
 {
     VkBuffer buffer;
-    VkDeviceMemory memory;
+    MemoryAllocation memory;
     size_t size;
     VkMemoryPropertyFlags memPropFlags;
     void* mappedData;
     VkDescriptorBufferInfo bufferInfo;
 
-    BufferData() : buffer(VK_NULL_HANDLE), memory(VK_NULL_HANDLE), size(0), memPropFlags(0), mappedData(nullptr) {}
+    BufferData() : buffer(VK_NULL_HANDLE), size(0), memPropFlags(0), mappedData(nullptr) {}
+};
+
+// An image waiting for its upload: imageCopies[firstRegion, firstRegion + regionCount) are copied from srcBuffer.
+struct StagingImage
+{
+    VkImage image;
+    VkBuffer srcBuffer;
+    uint32_t mipLevels;
+    uint32_t firstRegion;
+    uint32_t regionCount;
+};
+
+// The copies of one submit of the staging ring, running on the transfer queue (see vkStaging.h).
+struct StagingBatch
+{
+    VkCommandBuffer cmdBuffer;        // Copies and release barriers, executed by the transfer queue.
+    VkCommandBuffer acquireCmdBuffer; // Acquire barriers, executed by the graphics queue. VK_NULL_HANDLE if both queues are the same family.
+    VkSemaphore semaphore;            // Signalled by the transfer queue, waited by the first frame that uses the data.
+    VkFence fence;                    // Signalled by the transfer queue, polled by the CPU.
+    std::vector<BufferData> largeBuffers;
+    int32_t frameId;                  // Frame in flight that acquired the data, -1 while it is uploading.
+    uint32_t serial;                  // Number of the submit, from 1. The resources it uploads keep it to know when they are resident.
+};
+
+// Host visible ring used to upload data into device local buffers and images (see vkStaging.h).
+// Copies are queued while the ring has space and submitted together in one command buffer.
+struct StagingBuffer
+{
+    BufferData buffer;
+    VkDeviceSize head;
+    VkCommandPool commandPool; // Pool of the transfer queue family.
+    VkFence ringFence;         // Fence of the last submit that reads from the ring. The ring is not written until it is signalled.
+    std::vector<VkBuffer> srcBuffers; // Source of each pending copy: the ring, or a staging buffer of largeBuffers.
+    std::vector<VkBuffer> dstBuffers; // Destination of each pending copy.
+    std::vector<VkBufferCopy> copies;
+    std::vector<StagingImage> images;
+    std::vector<VkBufferImageCopy> imageCopies;
+    std::vector<BufferData> largeBuffers; // Staging buffers of the buffers and images that do not fit in the ring, destroyed after the upload.
+    std::vector<StagingBatch> batches;    // Submitted batches, until the frame that acquired them has finished.
+    std::vector<VkSemaphore> acquireSemaphores;  // Semaphores and acquire command buffers of the batches acquired by the current frame.
+    std::vector<VkCommandBuffer> acquireCmdBuffers;
+    uint32_t pendingBatches;   // Batches still uploading.
+    uint32_t streamingFrames;  // Frames presented while the uploads were running.
+    uint32_t submitCount;
+    uint32_t bufferSerial;     // Batch of the last device local buffer upload. All the draws read the shared buffers.
+    uint32_t residentSerial;   // The uploads of the batches with a lower serial are resident in the current frame.
+
+    StagingBuffer() : head(0), commandPool(VK_NULL_HANDLE), ringFence(VK_NULL_HANDLE), pendingBatches(0), streamingFrames(0), submitCount(0),
+                      bufferSerial(0), residentSerial(1) {}
+};
+
+// A mip level inside TextureData::data.
+struct TextureMip
+{
+    VkDeviceSize offset;
+    uint32_t width;
+    uint32_t height;
 };
 
 struct TextureData
 {
-    std::vector<uint8_t> data;
+    std::vector<uint8_t> data; // All the mip levels, one after the other.
+    std::vector<TextureMip> mips;
+    VkFormat format;
     VkExtent2D textureDimensions;
     VkImage image;
-    VkDeviceMemory memory;
+    MemoryAllocation memory;
     VkImageView view;
     VkSampler sampler;
     std::string uri;
+    uint32_t uploadSerial; // Staging batch that uploads the image, the meshes using it are not drawn before it is resident (see vkStaging.h).
 };
 
 struct Vertex
@@ -47,6 +213,29 @@ struct Vertex
     VEC2 tex; // texture UVs.
 };
 
+// Quantized Vertex (see vkQuantize.h), 16 bytes.
+struct CompactVertex
+{
+    uint16_t pos[4]; // VK_FORMAT_R16G16B16A16_UNORM, inside the bounding box of the object. The fourth value is padding.
+    int16_t nor[2];  // VK_FORMAT_R16G16_SNORM, octahedral encoding.
+    uint16_t tex[2]; // VK_FORMAT_R16G16_SFLOAT.
+};
+
+// Format of the vertex buffer.
+#if USE_COMPACT_VERTEX
+typedef CompactVertex DrawVertex;
+#else
+typedef Vertex DrawVertex;
+#endif
+
+// Moves the quantized positions of an object back to object space: position = quantized * scale + offset.
+// Without quantization it is the identity (offset 0, scale 1).
+struct PositionQuantization
+{
+    VEC3 offset;
+    VEC3 scale;
+};
+
 struct Transform
 {
     VEC3 translation;
@@ -54,13 +243,122 @@ struct Transform
     VEC3 scale;
 };
 
+// A level of detail of a mesh: a range of indices in the section of the mesh.
+struct MeshLod
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error; // Distance to the full mesh, relative to the bounding sphere radius.
+};
+
+// The geometry of every mesh lives in the shared vertex and index buffers of AppManager.
+// A mesh is just a range of indices (firstIndex, vertexCount) and the base added to them (vertexOffset), drawn with one texture.
+// Each primitive of a glTF mesh is a Mesh of its own (a submesh); the submeshes of a node share its transform (objectIndex).
+// The nodes that reference the same glTF mesh are its instances: their objects are consecutive and share the submeshes.
 struct Mesh
 {
-    BufferData vertexBuffer;
-    BufferData indexBuffer;
-    uint32_t vertexCount;
-    Transform transform;
+    VkIndexType indexType; // Narrowest type for the vertices of the mesh, selects the section of the index buffer.
+    uint32_t firstIndex;   // Relative to the section of indexType.
+    int32_t vertexOffset;
+    uint32_t vertexCount; // Number of indices to draw.
+    uint32_t objectIndex; // Selects the transform and the per-object data of the first instance.
+    uint32_t instanceCount; // Objects drawing the mesh: objectIndex and the ones after it.
     uint32_t textureID;
+    VEC3 boundsCenter; // Bounding sphere in object space, used by the culling.
+    float boundsRadius;
+    uint32_t lodCount; // Levels of detail, at least 1.
+    MeshLod lods[MAX_MESH_LODS]; // lods[0] is the full mesh (firstIndex, vertexCount), the next ones are simplified from it.
+    uint32_t firstMeshlet; // Meshlets of lods[0] in AppManager::meshlets, none if meshletCount is 0.
+    uint32_t meshletCount;
+};
+
+// A cluster of the triangles of a mesh (see vkMeshlets.h): a range of indices in the section of the mesh, with the bounds to cull it.
+struct Meshlet
+{
+    uint32_t firstIndex; // Relative to the section of the mesh, as Mesh::firstIndex.
+    uint32_t indexCount;
+    VEC3 center; // Bounding sphere in object space.
+    float radius;
+    VEC3 coneAxis; // Normal cone in object space: average normal of the triangles
+    float coneCutoff; // and sine of its half angle, 1 if the meshlet can not be backface culled.
+};
+
+#define NO_MESHLET 0xFFFFFFFF
+
+// Kinds of indirect draws (CullData::drawKind).
+#define DRAW_KIND_MESH 0 // A level of detail of a mesh, drawn for the instances at that level.
+#define DRAW_KIND_MESHLET 1 // A meshlet, drawn for the instances at full detail.
+
+// A range of the indirect draw buffer where all the draws use the same texture.
+struct DrawGroup
+{
+    VkIndexType indexType;
+    uint32_t textureID;
+    uint32_t firstDraw;
+    uint32_t drawCount;
+};
+
+// Indices of one type in the shared index buffer.
+struct IndexSection
+{
+    VkIndexType type;
+    VkDeviceSize offset; // Bytes from the start of the index buffer, where the section is bound.
+    uint32_t count;      // Number of indices.
+};
+
+// Input of the culling compute shader, one per indirect draw (std430 layout).
+struct CullData
+{
+    float sphere[4]; // Bounding sphere in object space: center (xyz) and radius (w).
+    uint32_t group; // Draw group of the draw, selects the counter.
+    uint32_t groupFirstDraw; // Where the visible draws of the group are compacted to.
+    uint32_t lodCount;
+    uint32_t drawLod; // Level of detail drawn by the draw, 0 for the meshlets.
+    uint32_t drawKind; // DRAW_KIND_MESH or DRAW_KIND_MESHLET.
+    uint32_t instanceCount; // Instances tested, starting at the firstInstance (object) of the draw.
+    uint32_t instanceBase; // Where the visible instances of the draw are written in the instance buffer.
+    uint32_t padding;
+    float lodError[MAX_MESH_LODS]; // Error of each level of detail of the mesh (MeshLod), to select the level of each instance.
+    float meshletSphere[4]; // Meshlet draws: bounding sphere of the meshlet in object space,
+    float meshletCone[4];   // and its normal cone: axis (xyz) and cutoff (w).
+};
+
+// Objects of the GPU culling pass (see vkCulling.h).
+// The output draws and the counters have one slice per frame in flight, as the uniform buffer does.
+struct GpuCulling
+{
+    BufferData cullDataBuffer; // One CullData per indirect draw, sorted as the indirect buffer.
+    BufferData drawBuffer; // Visible draws written by the compute shader.
+    BufferData countBuffer; // Number of visible draws of each group. Host visible so it can be read back.
+    VkDeviceSize drawSliceSize;
+    VkDeviceSize countSliceSize;
+    bool compact; // Visible draws are packed and drawn with vkCmdDrawIndexedIndirectCount.
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSetLayout descriptorSetLayout;
+    std::vector<VkDescriptorSet> descSets; // One per frame in flight.
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+    uint32_t culledMeshes; // Result of the last readback.
+
+    GpuCulling() : drawSliceSize(0), countSliceSize(0), compact(false), descriptorPool(VK_NULL_HANDLE), descriptorSetLayout(VK_NULL_HANDLE),
+                   pipelineLayout(VK_NULL_HANDLE), pipeline(VK_NULL_HANDLE), culledMeshes(0xFFFFFFFF) {}
+};
+
+// Persistent threads that run the same job with a different thread index (see vkThreads.h).
+// The thread calling the job is index 0, so there is one less worker than threadCount.
+struct WorkerThreads
+{
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    std::function<void(uint32_t)> job;
+    uint32_t threadCount;
+    uint32_t generation; // Incremented for each job so the workers know there is new work.
+    uint32_t pending; // Workers that have not finished the current job.
+    bool quit;
+
+    WorkerThreads() : threadCount(1), generation(0), pending(0), quit(false) {}
 };
 
 struct Light
@@ -81,10 +379,47 @@ struct Camera
     float znear;
 };
 
+// Per-object uniform data. It only changes when the transform of the object (or the light) changes.
 struct UBO
 {
-    MATRIX matrixMVP;
-    VEC3 lightDirection;
+    MATRIX matrixModel;
+    VEC3 lightDirection; // Light in object space.
+    float padding;
+    float positionOffset[4]; // PositionQuantization of the object, as vec4s. Set once, the transforms do not change it.
+    float positionScale[4];
+};
+
+// Per-frame uniform data, shared by all the objects. A frame where only the camera moves only writes this block.
+struct FrameUBO
+{
+    MATRIX matrixViewProjection;
+    float cameraPosition[4]; // Camera in world space (xyz) and LodCamera::pixelsPerUnit (w), for the level of detail selection.
+};
+
+// Camera used to select the levels of detail (see vkLod.h).
+struct LodCamera
+{
+    VEC3 position; // In world space.
+    float pixelsPerUnit; // Pixels covered by one unit of length at distance 1: viewport height / (2 tan(yfov / 2)).
+
+    LodCamera() : pixelsPerUnit(0.0f) {}
+};
+
+// Translation, rotation and scale of every mesh as one array per component (structure of arrays, see vkTransforms.h).
+// The arrays are padded with identity transforms to a multiple of 4, so they can always be read four objects at a time.
+struct TransformArrays
+{
+    std::vector<float> tx, ty, tz;     // Translation.
+    std::vector<float> rx, ry, rz, rw; // Rotation quaternion.
+    std::vector<float> sx, sy, sz;     // Scale.
+    uint32_t count;                    // Number of objects, without the padding.
+
+    std::vector<UBO> uniformCache;      // Model matrix and object space light of every object, as written to the uniform buffer.
+    std::vector<uint8_t> dirty;         // The cached uniform data of the object has to be recomputed.
+    std::vector<uint8_t> pendingFrames; // Number of uniform buffer slices (frames in flight) that still have old data of the object.
+    VEC3 lightPosition;                 // Light used to compute the cache. Changing it makes every object dirty.
+
+    TransformArrays() : count(0) {}
 };
 
 struct AppManager
@@ -97,37 +432,56 @@ struct AppManager
     std::vector<VkPhysicalDevice> gpus;
     std::vector<VkQueueFamilyProperties> queueFamilyProperties;
     std::vector<SwapchainImage> swapChainImages;
-    std::vector<VkCommandBuffer> cmdBuffers;
+    std::vector<VkCommandBuffer> cmdBuffers; // One per frame in flight.
+    std::vector<VkCommandPool> threadCommandPools; // One per frame in flight and recording thread: [frame * threadCount + thread].
+    std::vector<VkCommandBuffer> secondaryCmdBuffers; // One per thread pool.
     std::vector<VkFramebuffer> frameBuffers;
     std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
-    std::vector<Mesh> meshes;
+    std::vector<Mesh> meshes; // Sorted in draw order (see _sortMeshesByState).
+    std::vector<Meshlet> meshlets; // Meshlets of all the meshes (see Mesh::firstMeshlet).
+    std::vector<Transform> objectTransforms; // Transform of every object (glTF node with a mesh), shared by its meshes.
+    TransformArrays transforms; // Transforms of the objects, indexed like objectTransforms.
+    std::vector<PositionQuantization> objectQuantization; // Quantization of the vertices of every object, indexed like objectTransforms.
+    BufferData vertexBuffer; // Vertices of all the meshes.
+    BufferData indexBuffer;  // Indices of all the meshes.
+    IndexSection indexSections[INDEX_SECTION_COUNT]; // 8, 16 and 32-bit indices, in this order.
     std::vector<Camera> cameras;
     std::vector<Light> lights;
     std::vector<TextureData> textures;
 
-    std::vector<VkSemaphore> acquireSemaphore;
-    std::vector<VkSemaphore> presentSemaphores;
-    std::vector<VkFence> frameFences;
+    std::vector<VkSemaphore> acquireSemaphore; // One per frame in flight.
+    std::vector<VkSemaphore> presentSemaphores; // One per swapchain image.
+    std::vector<VkFence> frameFences; // One per frame in flight.
 
     VkInstance instance;
     VkPhysicalDevice physicalDevice;
 
     VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
     VkPhysicalDeviceProperties deviceProperties;
+    VkPhysicalDeviceFeatures deviceFeatures; // Features enabled in the logical device.
+    bool supportsDrawIndirectCount; // VK_KHR_draw_indirect_count is enabled.
+    bool supportsIndexTypeUint8; // VK_EXT_index_type_uint8 is enabled.
     uint32_t graphicsQueueFamilyIndex;
     uint32_t presentQueueFamilyIndex;
+    uint32_t transferQueueFamilyIndex; // Transfer-only family if the device has one, the graphics family otherwise.
     VkDevice device;
     VkQueue graphicQueue;
     VkQueue presentQueue;
+    VkQueue transferQueue;
     VkSurfaceKHR surface;
     VkSurfaceFormatKHR surfaceFormat;
     VkSwapchainKHR swapchain;
     VkPresentModeKHR presentMode;
     VkExtent2D swapchainExtent;
-    VkPipelineShaderStageCreateInfo shaderStages[2];
+    VkPipelineShaderStageCreateInfo shaderStages[NUM_SHADER_STAGES];
     VkRenderPass renderPass;
     VkPipelineLayout pipelineLayout;
     VkPipeline pipeline;
+    bool usePushConstants; // Direct draws use pushPipeline.
+    VkPipeline pushPipeline; // VK_NULL_HANDLE if the UBO does not fit in the push constants of the device.
+    VkPipelineLayout pushPipelineLayout;
+    VkPipelineCache pipelineCache;
+    bool pipelineCacheWarm; // The cache was loaded from PIPELINE_CACHE_FILE.
     VkCommandPool commandPool;
     VkViewport viewport;
     VkRect2D scissor;
@@ -137,17 +491,40 @@ struct AppManager
     VkDescriptorSetLayout staticDescriptorSetLayout;
     VkDescriptorSetLayout dynamicDescriptorSetLayout;
 
-    BufferData dynamicUniformBufferData;
-
-    VkImage depth_image;
-    VkDeviceMemory depth_memory;
-
-    uint32_t offset;
-
-    unsigned int frameId;
-    uint32_t currentBuffer;
+    BufferData dynamicUniformBufferData; // Per-object UBOs, one slice per frame in flight.
+    BufferData frameUniformBufferData;   // FrameUBO, one slice per frame in flight.
+
+    MemoryAllocator allocator;
+    StagingBuffer staging;
+
+    bool useIndirectDraw;
+    BufferData indirectBuffer; // One VkDrawIndexedIndirectCommand per mesh, sorted by index type and texture.
+    std::vector<VkDrawIndexedIndirectCommand> drawCommands; // CPU copy of the indirect buffer.
+    std::vector<uint32_t> drawMeshes; // Mesh of each indirect draw.
+    std::vector<uint32_t> drawMeshlets; // Meshlet of each indirect draw, NO_MESHLET for the whole mesh draws.
+    std::vector<uint32_t> drawLods; // Level of detail of each indirect draw.
+    bool useMeshletDraws; // The meshlets have indirect draws of their own, culled by the GPU culling.
+    BufferData instanceBuffer; // Object of each instance of the indirect and instanced draws, read by the vertex shader with gl_InstanceIndex.
+    VkDeviceSize instanceSliceSize; // Written by the culling every frame: one slice per frame in flight. 0 if the buffer is static.
+    std::vector<DrawGroup> drawGroups;
+    VkPipeline indirectPipeline;
+    VkPipelineLayout indirectPipelineLayout;
+    VkDescriptorSetLayout indirectDescriptorSetLayout;
+    VkDescriptorSet indirectDescSet; // The per-object data as a storage buffer.
+    bool useIndirectPipeline; // The indirect pipeline is created: for the indirect draws, or the instanced direct draws.
+    bool useGpuCulling;
+    GpuCulling culling;
+
+    WorkerThreads workers; // Record the secondary command buffers.
+    double recordingTime; // Milliseconds spent recording since the last log.
+    uint32_t recordedFrames;
+    bool unifiedMemory; // True if device local memory can be mapped (integrated GPUs), so staging is not needed.
+
+    unsigned int frameId; // Frame in flight, selects the command buffers, fences and uniform buffer slices.
+    uint32_t currentBuffer; // Swapchain image acquired for the frame, selects the framebuffer.
 
     Camera defaultCamera;
+    LodCamera lodCamera; // Set every frame with the camera of the view (see _setLodCamera).
 
     std::string gltfPath;
 
@@ -3,12 +3,17 @@
 
 #include <limits>
 #include "vkStructs.h"
+#include "vkMemory.h"
+#include "vkStaging.h"
 
-// currentBuffer will be used to point to the correct frame/command buffer/uniform buffer data.
-// It is going to be the general index of the data being worked on.
+// frameId points to the data of the frame in flight: command buffers, fence, acquire semaphore and uniform buffer slice.
+// currentBuffer is the swapchain image acquired for the frame: framebuffer and present semaphore.
+// The two are independent, the number of frames in flight (MAX_FRAMES_IN_FLIGHT) does not depend on the number of swapchain images.
 inline void _startCurrentBuffer(AppManager& appManager)
 {
-    VkPipelineStageFlags pipe_stage_flags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    // Wait for the GPU to finish the last use of this frame's objects before reusing them. With MAX_FRAMES_IN_FLIGHT frames
+    // the CPU can run that many frames ahead of the GPU before it blocks here.
+    debugAssertFunctionResult(vk::WaitForFences(appManager.device, 1, &appManager.frameFences[appManager.frameId], true, FENCE_TIMEOUT), "Fence - Signalled");
 
     // Acquire and get the index of the next available swapchain image.
     debugAssertFunctionResult(
@@ -16,30 +21,41 @@ inline void _startCurrentBuffer(AppManager& appManager)
                                 appManager.acquireSemaphore[appManager.frameId], VK_NULL_HANDLE, & appManager.currentBuffer),
         "Draw - Acquire Image");
 
-    // Wait for the fence to be signalled before starting to render the current frame, then reset it so it can be reused.
-    debugAssertFunctionResult(vk::WaitForFences(appManager.device, 1, &appManager.frameFences[appManager.currentBuffer], true, FENCE_TIMEOUT), "Fence - Signalled");
+    // Reset the fence so it can be signalled by the submission of this frame.
+    vk::ResetFences(appManager.device, 1, &appManager.frameFences[appManager.frameId]);
 
-    vk::ResetFences(appManager.device, 1, &appManager.frameFences[appManager.currentBuffer]);
+    // Take the uploads that have finished since the last frame. This frame waits for them and acquires their ownership.
+    _acquireStagingBatches(appManager);
 }
 
 // Submit the command buffer to the queue to start rendering.
 // The command buffer is submitted to the graphics queue which was created earlier.
 // Notice the wait (acquire) and signal (present) semaphores, and the fence.
+// The frame also waits for the semaphores of the uploads it acquired, and executes their acquire barriers before its own commands.
 inline void _presentCurrentBuffer(AppManager& appManager){
 
-    VkPipelineStageFlags pipe_stage_flags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    const StagingBuffer& staging = appManager.staging;
+
+    std::vector<VkSemaphore> waitSemaphores(1, appManager.acquireSemaphore[appManager.frameId]);
+    std::vector<VkPipelineStageFlags> waitStages(1, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    waitSemaphores.insert(waitSemaphores.end(), staging.acquireSemaphores.begin(), staging.acquireSemaphores.end());
+    waitStages.resize(waitSemaphores.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    std::vector<VkCommandBuffer> cmdBuffers(staging.acquireCmdBuffers);
+    cmdBuffers.push_back(appManager.cmdBuffers[appManager.frameId]);
+
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.pNext = nullptr;
-    submitInfo.pWaitDstStageMask = &pipe_stage_flags;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &appManager.acquireSemaphore[appManager.frameId];
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
     submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &appManager.presentSemaphores[appManager.frameId];
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &appManager.cmdBuffers[appManager.currentBuffer];
+    submitInfo.pSignalSemaphores = &appManager.presentSemaphores[appManager.currentBuffer];
+    submitInfo.commandBufferCount = static_cast<uint32_t>(cmdBuffers.size());
+    submitInfo.pCommandBuffers = cmdBuffers.data();
 
-    debugAssertFunctionResult(vk::QueueSubmit(appManager.graphicQueue, 1, &submitInfo, appManager.frameFences[appManager.currentBuffer]), "Draw - Submit to Graphic Queue");
+    debugAssertFunctionResult(vk::QueueSubmit(appManager.graphicQueue, 1, &submitInfo, appManager.frameFences[appManager.frameId]), "Draw - Submit to Graphic Queue");
 
     // Queue the rendered image for presentation to the surface.
     // The currentBuffer is again used to select the correct swapchain images to present. A wait
@@ -51,14 +67,14 @@ inline void _presentCurrentBuffer(AppManager& appManager){
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &appManager.swapchain;
     presentInfo.pImageIndices = &appManager.currentBuffer;
-    presentInfo.pWaitSemaphores = &appManager.presentSemaphores[appManager.frameId];
+    presentInfo.pWaitSemaphores = &appManager.presentSemaphores[appManager.currentBuffer];
     presentInfo.waitSemaphoreCount = 1;
     presentInfo.pResults = nullptr;
 
     debugAssertFunctionResult(vk::QueuePresentKHR(appManager.presentQueue, &presentInfo), "Draw - Submit to Present Queue");
 
     // Update the appManager.frameId to get the next suitable one.
-    appManager.frameId = (appManager.frameId + 1) % appManager.swapChainImages.size();
+    appManager.frameId = (appManager.frameId + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
 /// <summary>Creates a number of framebuffer objects equal to the number of images in the swapchain</summary>
@@ -472,7 +488,7 @@ inline void createImage(AppManager& appManager,
                         VkFormat format,
                         VkImageUsageFlags usage,
                         VkMemoryPropertyFlags properties,
-                        VkImage& image, VkDeviceMemory& imageMemory) {
+                        VkImage& image, MemoryAllocation& imageMemory) {
     VkImageCreateInfo imageInfo = {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -493,14 +509,9 @@ inline void createImage(AppManager& appManager,
     VkMemoryRequirements memRequirements;
     vk::GetImageMemoryRequirements(appManager.device, image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(appManager, memRequirements.memoryTypeBits, properties);
+    _allocateMemory(appManager, memRequirements, properties, false, imageMemory);
 
-    debugAssertFunctionResult(vk::AllocateMemory(appManager.device, &allocInfo, nullptr, &imageMemory), "createImage - AllocateMemory");
-
-    debugAssertFunctionResult(vk::BindImageMemory(appManager.device, image, imageMemory, 0), "createImage - BindImageMemory");
+    debugAssertFunctionResult(vk::BindImageMemory(appManager.device, image, imageMemory.memory, imageMemory.offset), "createImage - BindImageMemory");
 }
 
 /// <summary>Initialises the images of a previously created swapchain and creates an associated image view for each image</summary>
@@ -517,16 +528,12 @@ inline void _initImagesAndViews(AppManager& appManager)
     // This vector is used as a temporary vector to hold the retrieved images.
     uint32_t swapchainImageCount;
     std::vector<VkImage> images;
-    std::vector<VkImage> depth_images;
-    std::vector<VkDeviceMemory> depth_memory;
 
     // Get the number of the images which are held by the swapchain. This is set in InitSwapchain function and is the minimum number of images supported.
     debugAssertFunctionResult(vk::GetSwapchainImagesKHR(appManager.device, appManager.swapchain, &swapchainImageCount, nullptr), "SwapChain Images - Get Count");
 
     // Resize the temporary images vector to hold the number of images.
     images.resize(swapchainImageCount);
-    depth_images.resize(swapchainImageCount);
-    depth_memory.resize(swapchainImageCount);
 
     // Resize the application's permanent swapchain images vector to be able to hold the number of images.
     appManager.swapChainImages.resize(swapchainImageCount);
@@ -534,10 +541,6 @@ inline void _initImagesAndViews(AppManager& appManager)
     // Get all of the images from the swapchain and save them in a temporary vector.
     debugAssertFunctionResult(vk::GetSwapchainImagesKHR(appManager.device, appManager.swapchain, &swapchainImageCount, images.data()), "SwapChain Images - Allocate Data");
 
-
-  //  appManager.depth_image = depth_image; // The swapchain can use the same depth buffer for each image as it is cleared at the render start. The views have to be one per chain image
-  //  appManager.depth_memory = depth_memory;
-
     // Iterate over each image in order to create an image view for each one.
     for (uint32_t i = 0; i < swapchainImageCount; ++i)
     {
@@ -545,7 +548,7 @@ inline void _initImagesAndViews(AppManager& appManager)
         createImage(appManager,
                     appManager.swapchainExtent.width, appManager.swapchainExtent.height,
                     VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                    depth_images[i], depth_memory[i]);
+                    appManager.swapChainImages[i].depth_image, appManager.swapChainImages[i].depth_memory);
 
         // Copy over the images to the permanent vector.
         appManager.swapChainImages[i].image = images[i];
@@ -574,7 +577,7 @@ inline void _initImagesAndViews(AppManager& appManager)
         VkImageViewCreateInfo image_depth_view_info = {};
         image_depth_view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         image_depth_view_info.pNext = nullptr;
-        image_depth_view_info.image = depth_images[i];
+        image_depth_view_info.image = appManager.swapChainImages[i].depth_image;
         image_depth_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
         image_depth_view_info.format = VK_FORMAT_D32_SFLOAT;
         image_depth_view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
@@ -0,0 +1,160 @@
+#ifndef VKTEXTUREDECODE_H
+#define VKTEXTUREDECODE_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "dds-ktx.h"
+
+// CPU decoders used when the GPU cannot sample the format of a texture file (see _loadTexture).
+// They cover the block compressed formats of DDS files (BC1 to BC5) and the uncompressed formats that GPUs rarely sample (RGB8, A8).
+// The output is always R8G8B8A8. Decoding loses the memory savings of compression, so it is only the last resort.
+
+/// <summary>Expands a RGB565 colour to 8 bits per channel</summary>
+inline void _decodeRGB565(uint16_t colour, uint8_t* rgba)
+{
+    rgba[0] = static_cast<uint8_t>((((colour >> 11) & 31) * 527 + 23) >> 6);
+    rgba[1] = static_cast<uint8_t>((((colour >> 5) & 63) * 259 + 33) >> 6);
+    rgba[2] = static_cast<uint8_t>(((colour & 31) * 527 + 23) >> 6);
+    rgba[3] = 255;
+}
+
+/// <summary>Decodes the colour part of a BC1, BC2 or BC3 block (8 bytes) into 16 RGBA texels</summary>
+/// <param name="allowAlpha">BC1 only: two equal or decreasing end points select the mode with a transparent texel</param>
+inline void _decodeColourBlock(const uint8_t* block, uint8_t* texels, bool allowAlpha)
+{
+    uint16_t c0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+    uint16_t c1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+
+    uint8_t palette[4][4];
+    _decodeRGB565(c0, palette[0]);
+    _decodeRGB565(c1, palette[1]);
+
+    for (int c = 0; c < 3; c++)
+    {
+        if (c0 > c1 || !allowAlpha)
+        {
+            palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c]) / 3);
+            palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c]) / 3);
+        }
+        else
+        {
+            palette[2][c] = static_cast<uint8_t>((palette[0][c] + palette[1][c]) / 2);
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = (c0 > c1 || !allowAlpha) ? 255 : 0;
+
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+    for (int i = 0; i < 16; i++) memcpy(texels + i * 4, palette[(indices >> (2 * i)) & 3], 4);
+}
+
+/// <summary>Decodes a BC4 block (8 bytes, also the alpha of BC3 and each channel of BC5) into one channel of 16 RGBA texels</summary>
+inline void _decodeChannelBlock(const uint8_t* block, uint8_t* texels, int channel)
+{
+    uint8_t palette[8];
+    palette[0] = block[0];
+    palette[1] = block[1];
+
+    if (palette[0] > palette[1])
+    {
+        for (int i = 1; i < 7; i++) palette[i + 1] = static_cast<uint8_t>(((7 - i) * palette[0] + i * palette[1]) / 7);
+    }
+    else
+    {
+        for (int i = 1; i < 5; i++) palette[i + 1] = static_cast<uint8_t>(((5 - i) * palette[0] + i * palette[1]) / 5);
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    // 16 indices of 3 bits.
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; i++) indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; i++) texels[i * 4 + channel] = palette[(indices >> (3 * i)) & 7];
+}
+
+/// <summary>Returns true if the format has a CPU decoder</summary>
+inline bool _canDecodeTexture(ddsktx_format format)
+{
+    switch (format)
+    {
+    case DDSKTX_FORMAT_BC1: case DDSKTX_FORMAT_BC2: case DDSKTX_FORMAT_BC3: case DDSKTX_FORMAT_BC4: case DDSKTX_FORMAT_BC5:
+    case DDSKTX_FORMAT_RGB8: case DDSKTX_FORMAT_A8:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// <summary>Decodes one mip level to R8G8B8A8 and appends it to outData</summary>
+/// <param name="src">Data of the level, as returned by ddsktx_get_sub</param>
+/// <returns>False if the format has no CPU decoder</returns>
+inline bool _decodeTexture(ddsktx_format format, const uint8_t* src, uint32_t width, uint32_t height, std::vector<uint8_t>& outData)
+{
+    if (!_canDecodeTexture(format)) return false;
+
+    size_t outOffset = outData.size();
+    outData.resize(outOffset + static_cast<size_t>(width) * height * 4);
+    uint8_t* out = outData.data() + outOffset;
+
+    if (format == DDSKTX_FORMAT_RGB8 || format == DDSKTX_FORMAT_A8)
+    {
+        for (uint32_t i = 0; i < width * height; i++)
+        {
+            if (format == DDSKTX_FORMAT_RGB8) { memcpy(out + i * 4, src + i * 3, 3); out[i * 4 + 3] = 255; }
+            else { out[i * 4 + 0] = out[i * 4 + 1] = out[i * 4 + 2] = 255; out[i * 4 + 3] = src[i]; }
+        }
+        return true;
+    }
+
+    // Block compressed: 4x4 texels per block, 8 bytes per block for BC1 and BC4, 16 for the others.
+    const uint32_t blockBytes = (format == DDSKTX_FORMAT_BC1 || format == DDSKTX_FORMAT_BC4) ? 8 : 16;
+    const uint32_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+
+    for (uint32_t by = 0; by < blocksY; by++)
+    {
+        for (uint32_t bx = 0; bx < blocksX; bx++)
+        {
+            const uint8_t* block = src + (by * blocksX + bx) * blockBytes;
+            uint8_t texels[16 * 4];
+
+            switch (format)
+            {
+            case DDSKTX_FORMAT_BC1:
+                _decodeColourBlock(block, texels, true);
+                break;
+            case DDSKTX_FORMAT_BC2:
+                _decodeColourBlock(block + 8, texels, false);
+                for (int i = 0; i < 16; i++) texels[i * 4 + 3] = static_cast<uint8_t>(((block[i / 2] >> (4 * (i & 1))) & 15) * 17);
+                break;
+            case DDSKTX_FORMAT_BC3:
+                _decodeColourBlock(block + 8, texels, false);
+                _decodeChannelBlock(block, texels, 3);
+                break;
+            case DDSKTX_FORMAT_BC4:
+                _decodeChannelBlock(block, texels, 0);
+                for (int i = 0; i < 16; i++) { texels[i * 4 + 1] = texels[i * 4 + 2] = texels[i * 4]; texels[i * 4 + 3] = 255; }
+                break;
+            default: // BC5
+                _decodeChannelBlock(block, texels, 0);
+                _decodeChannelBlock(block + 8, texels, 1);
+                for (int i = 0; i < 16; i++) { texels[i * 4 + 2] = 0; texels[i * 4 + 3] = 255; }
+                break;
+            }
+
+            // Copy the texels of the block that are inside the image (the last blocks of a row or column can be partial).
+            for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++)
+            {
+                for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++)
+                {
+                    memcpy(out + ((by * 4 + y) * width + bx * 4 + x) * 4, texels + (y * 4 + x) * 4, 4);
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+#endif // VKTEXTUREDECODE_H
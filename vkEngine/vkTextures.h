@@ -4,8 +4,69 @@
 #include "vkStructs.h"
 #include "vkMemory.h"
 #include "dds-ktx.h"
+#include "vkTextureDecode.h"
+#include "vkStaging.h"
 #include <vector>
 
+/// <summary>Returns the Vulkan format of a dds-ktx format, or VK_FORMAT_UNDEFINED if there is none</summary>
+/// <param name="blockBytes">Bytes per texel, or per block of texels for the compressed formats</param>
+inline VkFormat _getTextureFormat(ddsktx_format format, uint32_t& blockBytes)
+{
+    // The UNORM formats are used even for sRGB files: the shaders do not light in linear space, so the texels are used as they are.
+    blockBytes = 16;
+    switch (format)
+    {
+    case DDSKTX_FORMAT_BC1:      blockBytes = 8; return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case DDSKTX_FORMAT_BC2:      return VK_FORMAT_BC2_UNORM_BLOCK;
+    case DDSKTX_FORMAT_BC3:      return VK_FORMAT_BC3_UNORM_BLOCK;
+    case DDSKTX_FORMAT_BC4:      blockBytes = 8; return VK_FORMAT_BC4_UNORM_BLOCK;
+    case DDSKTX_FORMAT_BC5:      return VK_FORMAT_BC5_UNORM_BLOCK;
+    case DDSKTX_FORMAT_BC6H:     return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+    case DDSKTX_FORMAT_BC7:      return VK_FORMAT_BC7_UNORM_BLOCK;
+    case DDSKTX_FORMAT_ETC1:     blockBytes = 8; return VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK; // ETC2 decoders read ETC1 data.
+    case DDSKTX_FORMAT_ETC2:     blockBytes = 8; return VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;
+    case DDSKTX_FORMAT_ETC2A:    return VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK;
+    case DDSKTX_FORMAT_ETC2A1:   blockBytes = 8; return VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK;
+    case DDSKTX_FORMAT_ASTC4x4:  return VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+    case DDSKTX_FORMAT_ASTC5x5:  return VK_FORMAT_ASTC_5x5_UNORM_BLOCK;
+    case DDSKTX_FORMAT_ASTC6x6:  return VK_FORMAT_ASTC_6x6_UNORM_BLOCK;
+    case DDSKTX_FORMAT_ASTC8x5:  return VK_FORMAT_ASTC_8x5_UNORM_BLOCK;
+    case DDSKTX_FORMAT_ASTC8x6:  return VK_FORMAT_ASTC_8x6_UNORM_BLOCK;
+    case DDSKTX_FORMAT_ASTC10x5: return VK_FORMAT_ASTC_10x5_UNORM_BLOCK;
+    case DDSKTX_FORMAT_R8:       blockBytes = 1; return VK_FORMAT_R8_UNORM;
+    case DDSKTX_FORMAT_RGBA8:    blockBytes = 4; return VK_FORMAT_R8G8B8A8_UNORM;
+    case DDSKTX_FORMAT_RGBA8S:   blockBytes = 4; return VK_FORMAT_R8G8B8A8_SNORM;
+    case DDSKTX_FORMAT_RG16:     blockBytes = 4; return VK_FORMAT_R16G16_UNORM;
+    case DDSKTX_FORMAT_RGB8:     blockBytes = 3; return VK_FORMAT_R8G8B8_UNORM;
+    case DDSKTX_FORMAT_R16:      blockBytes = 2; return VK_FORMAT_R16_UNORM;
+    case DDSKTX_FORMAT_R32F:     blockBytes = 4; return VK_FORMAT_R32_SFLOAT;
+    case DDSKTX_FORMAT_R16F:     blockBytes = 2; return VK_FORMAT_R16_SFLOAT;
+    case DDSKTX_FORMAT_RG16F:    blockBytes = 4; return VK_FORMAT_R16G16_SFLOAT;
+    case DDSKTX_FORMAT_RG16S:    blockBytes = 4; return VK_FORMAT_R16G16_SNORM;
+    case DDSKTX_FORMAT_RGBA16F:  blockBytes = 8; return VK_FORMAT_R16G16B16A16_SFLOAT;
+    case DDSKTX_FORMAT_RGBA16:   blockBytes = 8; return VK_FORMAT_R16G16B16A16_UNORM;
+    case DDSKTX_FORMAT_BGRA8:    blockBytes = 4; return VK_FORMAT_B8G8R8A8_UNORM;
+    case DDSKTX_FORMAT_RGB10A2:  blockBytes = 4; return VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+    case DDSKTX_FORMAT_RG11B10F: blockBytes = 4; return VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+    case DDSKTX_FORMAT_RG8:      blockBytes = 2; return VK_FORMAT_R8G8_UNORM;
+    case DDSKTX_FORMAT_RG8S:     blockBytes = 2; return VK_FORMAT_R8G8_SNORM;
+    default:                     return VK_FORMAT_UNDEFINED; // PVRTC, ATC and A8.
+    }
+}
+
+/// <summary>Checks that images of the format can be sampled with linear filtering and be the destination of a copy</summary>
+inline bool _isTextureFormatSupported(AppManager& appManager, VkFormat format)
+{
+    if (format == VK_FORMAT_UNDEFINED) return false;
+
+    VkFormatProperties formatProperties;
+    vk::GetPhysicalDeviceFormatProperties(appManager.physicalDevice, format, &formatProperties);
+
+    const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (formatProperties.optimalTilingFeatures & required) == required;
+}
+
+/// <summary>Reads a DDS or KTX file with all its mip levels, in the native format of the file if the GPU supports it</summary>
 inline bool loadDDS(AppManager& appManager, const char* textureFileName, TextureData& texture)
 {
     FILE* textureFile;
@@ -28,27 +89,78 @@ inline bool loadDDS(AppManager& appManager, const char* textureFileName, Texture
     fread(fileData, sizeof(char), fileSize, textureFile);
 
     ddsktx_texture_info tc = {0};
+    bool loaded = false;
 
     if (ddsktx_parse(&tc, fileData, fileSize, NULL))
     {
-        for (int mip = 0; mip < 1 /*tc.num_mips*/; mip++)
+        // Concept: Compressed Textures
+        // Block compressed formats (BC on desktop, ETC2 and ASTC on mobile) are sampled by the GPU directly, without decompressing
+        // them to memory, so they use 4 to 8 times less memory and bandwidth than R8G8B8A8. The GPU has to support the format;
+        // when it does not, the texture is decoded on the CPU instead, which keeps the memory savings only on the disk.
+        uint32_t blockBytes;
+        VkFormat format = _getTextureFormat(tc.format, blockBytes);
+        bool decode = !_isTextureFormatSupported(appManager, format);
+
+        if (decode && !_canDecodeTexture(tc.format))
+        {
+            Log(true, "Texture %s: format %d is not supported by the GPU and cannot be decoded", textureFileName, (int)tc.format);
+        }
+        else
         {
+            if (decode) { format = VK_FORMAT_R8G8B8A8_UNORM; blockBytes = 4; }
+
+            texture.format = format;
+            texture.data.clear();
+            texture.mips.clear();
+
+            // Every mip level is appended to the same data, so it is uploaded with one staging copy. The offset of each level in the
+            // staging buffer has to be a multiple of 4 and of the texel (or block) size.
+            const VkDeviceSize alignment = blockBytes * 4;
+
+            for (int mip = 0; mip < tc.num_mips; mip++)
+            {
+                ddsktx_sub_data sub_data;
+                ddsktx_get_sub(&tc, &sub_data, fileData, fileSize, 0, 0, mip);
+
+                texture.data.resize(static_cast<size_t>(_getAlignedDataSize(texture.data.size(), alignment)));
 
-            ddsktx_sub_data sub_data;
-            ddsktx_get_sub(&tc, &sub_data, fileData, fileSize, 0, 0, mip);
-            texture.data.assign((uint8_t*)sub_data.buff, (uint8_t*)sub_data.buff + sub_data.size_bytes);
-            texture.textureDimensions.width = sub_data.width;
-            texture.textureDimensions.height = sub_data.height;
+                TextureMip level;
+                level.offset = texture.data.size();
+                level.width = sub_data.width;
+                level.height = sub_data.height;
+                texture.mips.push_back(level);
+
+                const uint8_t* subData = static_cast<const uint8_t*>(sub_data.buff);
+                if (decode) _decodeTexture(tc.format, subData, level.width, level.height, texture.data);
+                else texture.data.insert(texture.data.end(), subData, subData + sub_data.size_bytes);
+            }
+
+            texture.textureDimensions.width = texture.mips[0].width;
+            texture.textureDimensions.height = texture.mips[0].height;
+            loaded = true;
+
+            Log(false, "Texture %s: %ux%u, %u mip levels, %u KB, %s", textureFileName, texture.textureDimensions.width, texture.textureDimensions.height,
+                (unsigned int)texture.mips.size(), (unsigned int)(texture.data.size() / 1024), decode ? "decoded on the CPU" : "native format");
         }
     }
 
     free(fileData);
     fclose (textureFile);
 
-    return true;
+    return loaded;
+}
+
+/// <summary>Fills the texture with a single white texel, used when its file cannot be loaded</summary>
+inline void _setDefaultTexture(TextureData& texture)
+{
+    texture.format = VK_FORMAT_R8G8B8A8_UNORM;
+    texture.data.assign(4, 255);
+    texture.mips.assign(1, TextureMip{ 0, 1, 1 });
+    texture.textureDimensions.width = 1;
+    texture.textureDimensions.height = 1;
 }
 
-/// <summary>Creates a texture image (VkImage) and maps it into GPU memory</summary>
+/// <summary>Creates a texture image (VkImage) and queues the upload of its data. The texture can be used after _flushStagingBuffer.</summary>
 inline void _loadTexture(AppManager& appManager, TextureData& texture, const char* textureFileName)
 {
     // In Vulkan, uploading an image requires multiple steps:
@@ -59,10 +171,9 @@ inline void _loadTexture(AppManager& appManager, TextureData& texture, const cha
     //		c) Bind the memory to the image.
 
     // 2) Uploading the data into the texture.
-    //		a) Create a staging buffer.
-    //		b) Determine its memory requirements and create the backing memory object ("VkDeviceMemory" object).
-    //		c) Map the staging buffer and copy the image data into it.
-    //		d) Perform a copy from the staging buffer to the image using the vkCmdCopyBufferToImage command to transfer the data. This requires a command buffer and related objects.
+    //		a) Copy the image data into the staging ring (see vkStaging.h).
+    //		b) Perform a copy from the staging ring to the image using the vkCmdCopyBufferToImage command to transfer the data.
+    //		   The copies of all the textures are recorded in one command buffer and submitted together.
 
     // A texture (sampled image) is stored in the GPU in an implementation-defined way, which may be completely different
     // to the layout of the texture on the disk/CPU-side.
@@ -70,18 +181,11 @@ inline void _loadTexture(AppManager& appManager, TextureData& texture, const cha
     // Using the vkCmdCopyBufferToImage command in the second (uploading) step guarantees the correct
     // translation/swizzling of the texture data.
 
-    loadDDS(appManager, textureFileName, texture); // format = VK_FORMAT_R8G8B8A8_UNORM;
-
-    // The BufferData struct has been defined in this application to hold the necessary data for the staging buffer.
-    BufferData stagingBufferData;
-    stagingBufferData.size = texture.data.size();
-
-    // Use the buffer creation function to generate a staging buffer. The VK_BUFFER_USAGE_TRANSFER_SRC_BIT flag is passed to specify that the buffer
-    // is going to be used as the source buffer of a transfer command.
-    _createBuffer(appManager, stagingBufferData, texture.data.data(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    if (!loadDDS(appManager, textureFileName, texture)) _setDefaultTexture(texture);
+    const uint32_t mipLevels = static_cast<uint32_t>(texture.mips.size());
 
     // Create the image object.
-    // The format is set to the most common format, R8G8B8_UNORM, 8-bits per channel, unsigned, and normalised.
+    // The format is the one of the file (or R8G8B8A8_UNORM, 8-bits per channel, unsigned, and normalised, if it was decoded on the CPU).
     // Additionally, the dimensions of the image, the number of mipmap levels, the intended usage of the image, the number of samples per texel,
     // and whether this image can be accessed concurrently by multiple queue families are all also set here.
     // Some of the other parameters specified include the tiling and the initialLayout.
@@ -94,14 +198,14 @@ inline void _loadTexture(AppManager& appManager, TextureData& texture, const cha
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
     imageInfo.flags = 0;
     imageInfo.pNext = nullptr;
-    imageInfo.format = VK_FORMAT_B8G8R8A8_UNORM;
+    imageInfo.format = texture.format;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.extent = { texture.textureDimensions.width, texture.textureDimensions.height, 1 };
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = mipLevels;
     imageInfo.arrayLayers = 1;
 
     debugAssertFunctionResult(vk::CreateImage(appManager.device, &imageInfo, nullptr, &texture.image), "Texture Image Creation");
@@ -111,144 +215,45 @@ inline void _loadTexture(AppManager& appManager, TextureData& texture, const cha
     VkMemoryRequirements memoryRequirments;
     vk::GetImageMemoryRequirements(appManager.device, texture.image, &memoryRequirments);
 
-    // Populate a memory allocation info struct with the memory requirements size for the image.
-    VkMemoryAllocateInfo allocateInfo = {};
-    allocateInfo.pNext = nullptr;
-    allocateInfo.memoryTypeIndex = 0;
-    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateInfo.allocationSize = memoryRequirments.size;
-
-    // This helper function queries available memory types to find memory with the features that are suitable for a sampled
-    // image. Device Local memory is the preferred choice.
-    _getMemoryTypeFromProperties(appManager.deviceMemoryProperties, memoryRequirments.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &(allocateInfo.memoryTypeIndex));
-
-    // Use all of this information to allocate memory with the correct features for the image and bind the memory to the texture buffer.
-    debugAssertFunctionResult(vk::AllocateMemory(appManager.device, &allocateInfo, nullptr, &texture.memory), "Texture Image Memory Allocation");
-    debugAssertFunctionResult(vk::BindImageMemory(appManager.device, texture.image, texture.memory, 0), "Texture Image Memory Binding");
-
-    // Specify the region which should be copied from the texture. In this case it is the entire image, so
-    // the texture width and height are passed as extents.
-    VkBufferImageCopy copyRegion = {};
-    copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    copyRegion.imageSubresource.mipLevel = 0;
-    copyRegion.imageSubresource.baseArrayLayer = 0;
-    copyRegion.imageSubresource.layerCount = 1;
-    copyRegion.imageExtent.width = static_cast<uint32_t>(texture.textureDimensions.width);
-    copyRegion.imageExtent.height = static_cast<uint32_t>(texture.textureDimensions.height);
-    copyRegion.imageExtent.depth = 1;
-    copyRegion.bufferOffset = 0;
-
-    // Allocate a command buffer from the command pool. This command buffer will be used to execute the copy operation.
-    // The allocation info struct below specifies that a single primary command buffer needs
-    // to be allocated. Primary command buffers can be contrasted with secondary command buffers
-    // which cannot be submitted directly to queues but instead are executed as part of a primary command
-    // buffer.
-    // The command pool referenced here was created in initCommandPoolAndBuffer().
-    VkCommandBuffer commandBuffer;
-
-    VkCommandBufferAllocateInfo commandAllocateInfo = {};
-    commandAllocateInfo.commandPool = appManager.commandPool;
-    commandAllocateInfo.pNext = nullptr;
-    commandAllocateInfo.commandBufferCount = 1;
-    commandAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-
-    debugAssertFunctionResult(vk::AllocateCommandBuffers(appManager.device, &commandAllocateInfo, &commandBuffer), "Allocate Command Buffers");
-
-    // Begin recording the copy commands into the command buffer.
-    VkCommandBufferBeginInfo commandBufferBeginInfo = {};
-    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    commandBufferBeginInfo.flags = 0;
-    commandBufferBeginInfo.pNext = nullptr;
-    commandBufferBeginInfo.pInheritanceInfo = nullptr;
-
-    debugAssertFunctionResult(vk::BeginCommandBuffer(commandBuffer, &commandBufferBeginInfo), "Begin Image Copy to Staging Buffer Command Buffer Recording");
-
-    // Specify the sub resource range of the image. In the case of this image, the parameters are default, with one mipmap level and layer,
-    // because the image is very simple.
-    VkImageSubresourceRange subResourceRange = {};
-    subResourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    subResourceRange.baseMipLevel = 0;
-    subResourceRange.levelCount = 1;
-    subResourceRange.layerCount = 1;
-
-    // A memory barrier needs to be created to make sure that the image layout is set up for a copy operation.
-    // The barrier will transition the image layout from VK_IMAGE_LAYOUT_UNDEFINED to
-    // VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL. This new layout is optimal for images which are the destination
-    // of a transfer command.
-    VkImageMemoryBarrier copyMemoryBarrier = {};
-    copyMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    copyMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    copyMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    copyMemoryBarrier.image = texture.image;
-    copyMemoryBarrier.subresourceRange = subResourceRange;
-    copyMemoryBarrier.srcAccessMask = 0;
-    copyMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-    // Use the pipeline barrier defined above.
-    vk::CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &copyMemoryBarrier);
-
-    // Copy the staging buffer data to the image that was just created.
-    vk::CmdCopyBufferToImage(commandBuffer, stagingBufferData.buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-    // Create a barrier to make sure that the image layout is shader read-only.
-    // This barrier will transition the image layout from VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL to
-    // VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
-    VkImageMemoryBarrier layoutMemoryBarrier = {};
-    layoutMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    layoutMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    layoutMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    layoutMemoryBarrier.image = texture.image;
-    layoutMemoryBarrier.subresourceRange = subResourceRange;
-    layoutMemoryBarrier.srcAccessMask = 0;
-    layoutMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    // Use a pipeline barrier to change the image layout to be optimised for reading by the shader.
-    vk::CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &layoutMemoryBarrier);
-
-    // End the recording of the command buffer.
-    debugAssertFunctionResult(vk::EndCommandBuffer(commandBuffer), "End Image Copy to Staging Buffer Command Buffer Recording");
-
-    // Create a fence object which will signal when all of the commands in this command buffer have been completed.
-    VkFence copyFence;
-    VkFenceCreateInfo copyFenceInfo = {};
-    copyFenceInfo.flags = 0;
-    copyFenceInfo.pNext = nullptr;
-    copyFenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-
-    debugAssertFunctionResult(vk::CreateFence(appManager.device, &copyFenceInfo, nullptr, &copyFence), "Image Copy to Staging Buffer Fence Creation");
-
-    // Finally, submit the command buffer to the graphics queue to get the GPU to perform the copy operations.
-    // When submitting command buffers, it is possible to set wait and signal semaphores to control synchronisation. These
-    // are not used here but they will be used later during rendering.
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pNext = nullptr;
-    submitInfo.pWaitDstStageMask = nullptr;
-    submitInfo.waitSemaphoreCount = 0;
-    submitInfo.pWaitSemaphores = nullptr;
-    submitInfo.signalSemaphoreCount = 0;
-    submitInfo.pSignalSemaphores = nullptr;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    debugAssertFunctionResult(vk::QueueSubmit(appManager.graphicQueue, 1, &submitInfo, copyFence), "Submit Image Copy to Staging Buffer Command Buffer");
-
-    // Wait for the fence to be signalled. This ensures the command buffer has finished executing.
-    debugAssertFunctionResult(vk::WaitForFences(appManager.device, 1, &copyFence, VK_TRUE, FENCE_TIMEOUT), "Image Copy to Staging Buffer Fence Signal");
-
-    // After the image is complete and all the texture data has been copied, an image view needs to be created to make sure
-    // that the API can understand what the image is. For example, information can be provided on the format or view type.
+    // Get a range of an image memory page with the features that are suitable for a sampled image.
+    // Device Local memory is the preferred choice.
+    _allocateMemory(appManager, memoryRequirments, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, texture.memory);
+
+    // Bind the memory to the texture image at the offset of its range inside the page.
+    debugAssertFunctionResult(vk::BindImageMemory(appManager.device, texture.image, texture.memory.memory, texture.memory.offset), "Texture Image Memory Binding");
+
+    // Specify the regions which should be copied from the staging buffer, one per mip level. Each one is an entire level, so
+    // the width and height of the level are passed as extents.
+    std::vector<VkBufferImageCopy> copyRegions(mipLevels);
+    for (uint32_t mip = 0; mip < mipLevels; mip++)
+    {
+        VkBufferImageCopy& copyRegion = copyRegions[mip];
+        copyRegion = {};
+        copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copyRegion.imageSubresource.mipLevel = mip;
+        copyRegion.imageSubresource.baseArrayLayer = 0;
+        copyRegion.imageSubresource.layerCount = 1;
+        copyRegion.imageExtent.width = texture.mips[mip].width;
+        copyRegion.imageExtent.height = texture.mips[mip].height;
+        copyRegion.imageExtent.depth = 1;
+        copyRegion.bufferOffset = texture.mips[mip].offset;
+    }
+
+    // Queue the copy in the staging ring. It is recorded with the copies of the other textures and the geometry, and submitted
+    // by the next _flushStagingBuffer, which also moves the image to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+    texture.uploadSerial = _queueImageUpload(appManager, texture.image, texture.data.data(), texture.data.size(), copyRegions, mipLevels);
+
+    // An image view needs to be created to make sure that the API can understand what the image is. For example, information can be provided on the format or view type.
     // The image parameters used here are the same as for the swapchain images created earlier.
     VkImageViewCreateInfo imageViewInfo = {};
     imageViewInfo.flags = 0;
     imageViewInfo.pNext = nullptr;
     imageViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    imageViewInfo.format = VK_FORMAT_B8G8R8A8_UNORM;
+    imageViewInfo.format = texture.format;
     imageViewInfo.image = texture.image;
     imageViewInfo.subresourceRange.layerCount = 1;
-    imageViewInfo.subresourceRange.levelCount = 1;
+    imageViewInfo.subresourceRange.levelCount = mipLevels;
     imageViewInfo.subresourceRange.baseArrayLayer = 0;
     imageViewInfo.subresourceRange.baseMipLevel = 0;
     imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -284,15 +289,9 @@ inline void _loadTexture(AppManager& appManager, TextureData& texture, const cha
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 5.0f;
+    samplerInfo.maxLod = static_cast<float>(mipLevels);
 
     debugAssertFunctionResult(vk::CreateSampler(appManager.device, &samplerInfo, nullptr, &texture.sampler), "Texture Sampler Creation");
-
-    // Clean up all the temporary data created for this operation.
-    vk::DestroyFence(appManager.device, copyFence, nullptr);
-    vk::FreeCommandBuffers(appManager.device, appManager.commandPool, 1, &commandBuffer);
-    vk::FreeMemory(appManager.device, stagingBufferData.memory, nullptr);
-    vk::DestroyBuffer(appManager.device, stagingBufferData.buffer, nullptr);
 }
 
 #endif // VKTEXTURES_H
@@ -0,0 +1,89 @@
+#ifndef VKTHREADS_H
+#define VKTHREADS_H
+
+#include <algorithm>
+#include "vkStructs.h"
+
+// Concept: Worker Threads
+// Vulkan objects that are only used by one thread at a time need no locking, so work like recording command buffers scales with
+// the number of cores as long as each thread has its own objects (a command pool per thread, for instance).
+// Creating threads is expensive compared with the work of a frame, so they are created once and wait on a condition variable
+// until there is a new job. The calling thread runs its own share of the job instead of sleeping.
+
+/// <summary>Body of the worker threads. Waits for a job, runs it with its thread index and signals when it finishes.</summary>
+inline void _workerThreadMain(WorkerThreads* workers, uint32_t threadIndex)
+{
+    uint32_t generation = 0;
+
+    for (;;)
+    {
+        std::function<void(uint32_t)> job;
+        {
+            std::unique_lock<std::mutex> lock(workers->mutex);
+            workers->startCondition.wait(lock, [&]() { return workers->quit || workers->generation != generation; });
+            if (workers->quit) return;
+
+            generation = workers->generation;
+            job = workers->job;
+        }
+
+        job(threadIndex);
+
+        std::lock_guard<std::mutex> lock(workers->mutex);
+        if (--workers->pending == 0) workers->doneCondition.notify_one();
+    }
+}
+
+/// <summary>Starts the worker threads, one per core up to maxThreads (the calling thread included)</summary>
+inline void _initWorkerThreads(AppManager& appManager, uint32_t maxThreads)
+{
+    WorkerThreads& workers = appManager.workers;
+
+    // hardware_concurrency can return 0 if it is not known.
+    uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+    workers.threadCount = std::max(1u, std::min(cores, maxThreads));
+
+    for (uint32_t i = 1; i < workers.threadCount; i++)
+    {
+        workers.threads.emplace_back(_workerThreadMain, &workers, i);
+    }
+
+    Log(false, "Worker threads: %u (%u cores)", workers.threadCount, cores);
+}
+
+/// <summary>Runs job(threadIndex) on every thread and waits for all of them to finish</summary>
+inline void _runOnWorkerThreads(AppManager& appManager, const std::function<void(uint32_t)>& job)
+{
+    WorkerThreads& workers = appManager.workers;
+
+    if (!workers.threads.empty())
+    {
+        std::lock_guard<std::mutex> lock(workers.mutex);
+        workers.job = job;
+        workers.pending = static_cast<uint32_t>(workers.threads.size());
+        workers.generation++;
+    }
+    workers.startCondition.notify_all();
+
+    // The calling thread is thread 0.
+    job(0);
+
+    std::unique_lock<std::mutex> lock(workers.mutex);
+    workers.doneCondition.wait(lock, [&]() { return workers.pending == 0; });
+}
+
+/// <summary>Stops and joins the worker threads</summary>
+inline void _destroyWorkerThreads(AppManager& appManager)
+{
+    WorkerThreads& workers = appManager.workers;
+    {
+        std::lock_guard<std::mutex> lock(workers.mutex);
+        workers.quit = true;
+    }
+    workers.startCondition.notify_all();
+
+    for (std::thread& thread : workers.threads) thread.join();
+    workers.threads.clear();
+}
+
+#endif // VKTHREADS_H
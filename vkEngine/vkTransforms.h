@@ -0,0 +1,260 @@
+#ifndef VKTRANSFORMS_H
+#define VKTRANSFORMS_H
+
+#include <algorithm>
+#include <cstring>
+#include "vkStructs.h"
+#include "vkThreads.h"
+#include "vkShaders.h"
+#include "vkMemory.h"
+
+// Concept: Structure of Arrays
+// Building a model matrix per mesh with scaling(), rotationQ() and translation() costs three full matrix products, and then it is
+// inverted to move the light to object space. Most of that work multiplies by zeros and ones.
+// The transforms are stored instead as one array per component (all the translations X, then all the translations Y...), so four
+// consecutive meshes can be loaded into the four lanes of a FLOAT4 and computed together with the same instructions.
+// The model matrix of a translation, rotation and scale is written directly from the quaternion, and because its rows are just the
+// scaled rotation axes, the light is moved to object space with three dot products instead of a matrix inverse.
+// The results are transposed back to one matrix per mesh.
+
+// Concept: Dirty Flags
+// The uniform data is split in a per-frame block (FrameUBO, the view projection matrix) and a per-object block (UBO, the model matrix
+// and the light in object space). Static meshes never change their per-object block, so it is cached and only recomputed for the
+// objects marked as dirty. The cache is then copied to the uniform buffer slice of the frame, but every frame in flight has its own
+// slice, so an object is copied MAX_FRAMES_IN_FLIGHT times after it changes. A frame where only the camera moves writes one FrameUBO.
+
+/// <summary>Sets the transform of one object in the structure of arrays and marks it as dirty</summary>
+inline void _setTransform(TransformArrays& transforms, uint32_t index, const Transform& transform)
+{
+    transforms.tx[index] = transform.translation.x;
+    transforms.ty[index] = transform.translation.y;
+    transforms.tz[index] = transform.translation.z;
+    transforms.rx[index] = transform.rotation.x;
+    transforms.ry[index] = transform.rotation.y;
+    transforms.rz[index] = transform.rotation.z;
+    transforms.rw[index] = transform.rotation.w;
+    transforms.sx[index] = transform.scale.x;
+    transforms.sy[index] = transform.scale.y;
+    transforms.sz[index] = transform.scale.z;
+    transforms.dirty[index] = 1;
+}
+
+/// <summary>Copies the transforms of the objects to the structure of arrays. The arrays are padded to a multiple of 4 with identities.</summary>
+inline void _initTransforms(AppManager& appManager)
+{
+    TransformArrays& transforms = appManager.transforms;
+    transforms.count = static_cast<uint32_t>(appManager.objectTransforms.size());
+
+    size_t paddedCount = (transforms.count + 3) & ~size_t(3);
+    std::vector<float>* zeroArrays[] = { &transforms.tx, &transforms.ty, &transforms.tz, &transforms.rx, &transforms.ry, &transforms.rz };
+    std::vector<float>* oneArrays[] = { &transforms.rw, &transforms.sx, &transforms.sy, &transforms.sz };
+    for (std::vector<float>* array : zeroArrays) array->assign(paddedCount, 0.0f);
+    for (std::vector<float>* array : oneArrays) array->assign(paddedCount, 1.0f);
+
+    // The batch writes whole groups of four, so the cache is padded too.
+    transforms.uniformCache.resize(paddedCount);
+    transforms.dirty.assign(paddedCount, 0);
+    transforms.pendingFrames.assign(paddedCount, 0);
+
+    for (uint32_t i = 0; i < transforms.count; i++) _setTransform(transforms, i, appManager.objectTransforms[i]);
+
+    // The quantization of the vertices is part of the per-object data, but never changes: the batch does not write it.
+    for (uint32_t i = 0; i < paddedCount; i++)
+    {
+        UBO& ubo = transforms.uniformCache[i];
+        PositionQuantization quantization;
+        quantization.scale = VEC3(1.0f, 1.0f, 1.0f);
+        if (i < appManager.objectQuantization.size()) quantization = appManager.objectQuantization[i];
+
+        ubo.padding = 0.0f;
+        ubo.positionOffset[0] = quantization.offset.x; ubo.positionOffset[1] = quantization.offset.y; ubo.positionOffset[2] = quantization.offset.z; ubo.positionOffset[3] = 0.0f;
+        ubo.positionScale[0] = quantization.scale.x; ubo.positionScale[1] = quantization.scale.y; ubo.positionScale[2] = quantization.scale.z; ubo.positionScale[3] = 0.0f;
+    }
+}
+
+/// <summary>Computes the per-object uniform data (UBO) of the objects [first, first + count) and writes it to outData</summary>
+/// <param name="transforms">Transforms of the objects. first must be a multiple of 4.</param>
+/// <param name="lightPosition">Light in world space, moved to the object space of each object</param>
+/// <param name="outData">Uniform data of object 0. The UBO of object i is written at outData + i * stride.</param>
+/// <param name="stride">Distance between the UBOs</param>
+inline void _computeTransformBatch(const TransformArrays& transforms, const VEC3& lightPosition, uint8_t* outData, uint32_t stride, uint32_t first, uint32_t count)
+{
+    const FLOAT4 one = f4Set(1.0f);
+    const FLOAT4 two = f4Set(2.0f);
+    const FLOAT4 zero = f4Set(0.0f);
+    const FLOAT4 lightX = f4Set(lightPosition.x);
+    const FLOAT4 lightY = f4Set(lightPosition.y);
+    const FLOAT4 lightZ = f4Set(lightPosition.z);
+
+    for (uint32_t base = first; base < first + count; base += 4)
+    {
+        FLOAT4 qx = f4Load(&transforms.rx[base]), qy = f4Load(&transforms.ry[base]), qz = f4Load(&transforms.rz[base]), qw = f4Load(&transforms.rw[base]);
+        FLOAT4 sx = f4Load(&transforms.sx[base]), sy = f4Load(&transforms.sy[base]), sz = f4Load(&transforms.sz[base]);
+        FLOAT4 tx = f4Load(&transforms.tx[base]), ty = f4Load(&transforms.ty[base]), tz = f4Load(&transforms.tz[base]);
+
+        // Rotation matrix of the quaternion, row by row (the same values as MATRIX::rotationQ).
+        FLOAT4 xx = f4Mul(qx, qx), yy = f4Mul(qy, qy), zz = f4Mul(qz, qz);
+        FLOAT4 xy = f4Mul(qx, qy), xz = f4Mul(qx, qz), yz = f4Mul(qy, qz);
+        FLOAT4 xw = f4Mul(qx, qw), yw = f4Mul(qy, qw), zw = f4Mul(qz, qw);
+
+        FLOAT4 r[3][3];
+        r[0][0] = f4Sub(one, f4Mul(two, f4Add(yy, zz)));
+        r[0][1] = f4Mul(two, f4Add(xy, zw));
+        r[0][2] = f4Mul(two, f4Sub(xz, yw));
+        r[1][0] = f4Mul(two, f4Sub(xy, zw));
+        r[1][1] = f4Sub(one, f4Mul(two, f4Add(xx, zz)));
+        r[1][2] = f4Mul(two, f4Add(yz, xw));
+        r[2][0] = f4Mul(two, f4Add(xz, yw));
+        r[2][1] = f4Mul(two, f4Sub(yz, xw));
+        r[2][2] = f4Sub(one, f4Mul(two, f4Add(xx, yy)));
+
+        // The model matrix is scale * rotation * translation: its first three rows are the rotation rows multiplied by the scale
+        // and the last row is the translation.
+        FLOAT4 scale[3] = { sx, sy, sz };
+        FLOAT4 model[4][4];
+        for (int row = 0; row < 3; row++)
+        {
+            for (int col = 0; col < 3; col++) model[row][col] = f4Mul(r[row][col], scale[row]);
+            model[row][3] = zero;
+        }
+        model[3][0] = tx; model[3][1] = ty; model[3][2] = tz; model[3][3] = one;
+
+        // Light in object space: the inverse of scale * rotation * translation applied to a direction is
+        // (dot(light, rotationRow0) / sx, dot(light, rotationRow1) / sy, dot(light, rotationRow2) / sz).
+        FLOAT4 light[4];
+        for (int row = 0; row < 3; row++)
+        {
+            FLOAT4 dot = f4Add(f4Add(f4Mul(lightX, r[row][0]), f4Mul(lightY, r[row][1])), f4Mul(lightZ, r[row][2]));
+            light[row] = f4Div(dot, scale[row]);
+        }
+        light[3] = zero;
+
+        // Transpose from one lane per object to one row per object.
+        for (int row = 0; row < 4; row++) f4Transpose(model[row][0], model[row][1], model[row][2], model[row][3]);
+        f4Transpose(light[0], light[1], light[2], light[3]);
+
+        // The tail of the last group of four belongs to the padding and is not written.
+        uint32_t objects = std::min(4u, first + count - base);
+        for (uint32_t lane = 0; lane < objects; lane++)
+        {
+            float* ubo = reinterpret_cast<float*>(outData + (base + lane) * stride);
+            for (int row = 0; row < 4; row++) f4Store(ubo + row * 4, model[row][lane]);
+
+            float lightDirection[4];
+            f4Store(lightDirection, light[lane]);
+            memcpy(ubo + 16, lightDirection, sizeof(VEC3));
+        }
+    }
+}
+
+/// <summary>Recomputes the dirty objects of [first, first + count) and copies the ones with old data to the uniform buffer slice</summary>
+/// <param name="sliceData">Mapped uniform buffer slice of the frame</param>
+/// <param name="stride">Distance between the UBOs in the slice</param>
+/// <returns>Number of objects copied to the slice</returns>
+inline uint32_t _updateTransformRange(TransformArrays& transforms, uint8_t* sliceData, uint32_t stride, uint32_t first, uint32_t count)
+{
+    uint8_t* cacheData = reinterpret_cast<uint8_t*>(transforms.uniformCache.data());
+    uint32_t copied = 0;
+
+    for (uint32_t base = first; base < first + count; base += 4)
+    {
+        uint32_t objects = std::min(4u, first + count - base);
+
+        // Recompute the whole group of four if any of its objects is dirty; the batch costs the same for one or four objects.
+        // The clean objects of the group get the same values again, so only the dirty ones have to be copied.
+        bool dirty = false;
+        for (uint32_t i = base; i < base + objects; i++) dirty = dirty || transforms.dirty[i];
+        if (dirty)
+        {
+            _computeTransformBatch(transforms, transforms.lightPosition, cacheData, sizeof(UBO), base, objects);
+            for (uint32_t i = base; i < base + objects; i++)
+            {
+                if (transforms.dirty[i]) transforms.pendingFrames[i] = MAX_FRAMES_IN_FLIGHT;
+                transforms.dirty[i] = 0;
+            }
+        }
+
+        for (uint32_t i = base; i < base + objects; i++)
+        {
+            if (transforms.pendingFrames[i] == 0) continue;
+
+            memcpy(sliceData + i * stride, &transforms.uniformCache[i], sizeof(UBO));
+            transforms.pendingFrames[i]--;
+            copied++;
+        }
+    }
+
+    return copied;
+}
+
+/// <summary>Flushes a range of a mapped buffer, if its memory is not host coherent</summary>
+inline void _flushUniformSlice(AppManager& appManager, BufferData& buffer, VkDeviceSize offset, VkDeviceSize size)
+{
+    if ((buffer.memPropFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0) return;
+
+    VkMappedMemoryRange mapMemRange = _getMappedMemoryRange(appManager, buffer.memory, offset, size);
+    vk::FlushMappedMemoryRanges(appManager.device, 1, &mapMemRange);
+}
+
+/// <summary>Writes the uniform data of frame frameIndex: the per-frame block, and the per-object blocks that changed</summary>
+/// <param name="mViewProjection">View matrix multiplied by the projection matrix</param>
+/// <param name="lightPosition">Light in world space</param>
+inline void _updateTransforms(AppManager& appManager, const MATRIX& mViewProjection, const VEC3& lightPosition, uint32_t frameIndex)
+{
+    TransformArrays& transforms = appManager.transforms;
+
+    // The object space light of every object depends on the light.
+    if (lightPosition.x != transforms.lightPosition.x || lightPosition.y != transforms.lightPosition.y || lightPosition.z != transforms.lightPosition.z)
+    {
+        transforms.lightPosition = lightPosition;
+        std::fill(transforms.dirty.begin(), transforms.dirty.begin() + transforms.count, 1);
+    }
+
+    // Per-object blocks.
+    BufferData& objectBuffer = appManager.dynamicUniformBufferData;
+    VkDeviceSize sliceOffset = objectBuffer.bufferInfo.range * frameIndex;
+    uint8_t* sliceData = static_cast<uint8_t*>(objectBuffer.mappedData) + sliceOffset;
+    uint32_t stride = _getUniformDataStride(appManager);
+    uint32_t copied = 0;
+
+    // Small scenes are updated on the calling thread: waking the workers costs more than the work.
+    uint32_t threadCount = appManager.workers.threadCount;
+    if (transforms.count < TRANSFORM_PARALLEL_MIN_OBJECTS || threadCount == 1)
+    {
+        copied = _updateTransformRange(transforms, sliceData, stride, 0, transforms.count);
+    }
+    else
+    {
+        // Chunks of a multiple of 4 objects, one per thread.
+        uint32_t groups = (transforms.count + 3) / 4;
+        uint32_t groupsPerThread = (groups + threadCount - 1) / threadCount;
+        std::vector<uint32_t> threadCopied(threadCount, 0);
+
+        _runOnWorkerThreads(appManager, [&](uint32_t threadIndex)
+        {
+            uint32_t first = std::min(threadIndex * groupsPerThread * 4, transforms.count);
+            uint32_t last = std::min(first + groupsPerThread * 4, transforms.count);
+            if (last > first) threadCopied[threadIndex] = _updateTransformRange(transforms, sliceData, stride, first, last - first);
+        });
+
+        for (uint32_t threadCopies : threadCopied) copied += threadCopies;
+    }
+
+    if (copied > 0) _flushUniformSlice(appManager, objectBuffer, sliceOffset, objectBuffer.bufferInfo.range);
+
+    // Per-frame block.
+    BufferData& frameBuffer = appManager.frameUniformBufferData;
+    VkDeviceSize frameOffset = frameBuffer.bufferInfo.range * frameIndex;
+
+    FrameUBO frameUBO;
+    frameUBO.matrixViewProjection = mViewProjection;
+    frameUBO.cameraPosition[0] = appManager.lodCamera.position.x;
+    frameUBO.cameraPosition[1] = appManager.lodCamera.position.y;
+    frameUBO.cameraPosition[2] = appManager.lodCamera.position.z;
+    frameUBO.cameraPosition[3] = appManager.lodCamera.pixelsPerUnit;
+    memcpy(static_cast<uint8_t*>(frameBuffer.mappedData) + frameOffset, &frameUBO, sizeof(FrameUBO));
+
+    _flushUniformSlice(appManager, frameBuffer, frameOffset, frameBuffer.bufferInfo.range);
+}
+
+#endif // VKTRANSFORMS_H
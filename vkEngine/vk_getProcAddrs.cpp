@@ -52,6 +52,7 @@ PVR_VULKAN_FUNCTION_POINTER_DEFINITION(DestroySurfaceKHR)
 PVR_VULKAN_FUNCTION_POINTER_DEFINITION(GetInstanceProcAddr)
 PVR_VULKAN_FUNCTION_POINTER_DEFINITION(GetDeviceProcAddr)
 PVR_VULKAN_FUNCTION_POINTER_DEFINITION(GetPhysicalDeviceFeatures)
+PVR_VULKAN_FUNCTION_POINTER_DEFINITION(GetPhysicalDeviceFeatures2KHR)
 PVR_VULKAN_FUNCTION_POINTER_DEFINITION(GetPhysicalDeviceFormatProperties)
 PVR_VULKAN_FUNCTION_POINTER_DEFINITION(GetPhysicalDeviceImageFormatProperties)
 PVR_VULKAN_FUNCTION_POINTER_DEFINITION(GetPhysicalDeviceProperties)
@@ -183,6 +184,7 @@ PVR_VULKAN_FUNCTION_POINTER_DEFINITION(CmdBeginRenderPass)
 PVR_VULKAN_FUNCTION_POINTER_DEFINITION(CmdNextSubpass)
 PVR_VULKAN_FUNCTION_POINTER_DEFINITION(CmdEndRenderPass)
 PVR_VULKAN_FUNCTION_POINTER_DEFINITION(CmdExecuteCommands)
+PVR_VULKAN_FUNCTION_POINTER_DEFINITION(CmdDrawIndexedIndirectCountKHR)
 
 PVR_VULKAN_FUNCTION_POINTER_DEFINITION(CreateDebugReportCallbackEXT)
 PVR_VULKAN_FUNCTION_POINTER_DEFINITION(DebugReportMessageEXT)
@@ -265,6 +267,9 @@ bool vk::initVulkanInstance(VkInstance instance)
     VULKAN_GET_INSTANCE_POINTER(instance, GetPhysicalDeviceImageFormatProperties)
     VULKAN_GET_INSTANCE_POINTER(instance, GetPhysicalDeviceSparseImageFormatProperties)
 
+    // Optional: only available when VK_KHR_get_physical_device_properties2 is enabled on the instance.
+    VULKAN_GET_INSTANCE_POINTER(instance, GetPhysicalDeviceFeatures2KHR)
+
     VULKAN_GET_INSTANCE_POINTER(instance, CreateDebugReportCallbackEXT)
     VULKAN_GET_INSTANCE_POINTER(instance, DebugReportMessageEXT)
     VULKAN_GET_INSTANCE_POINTER(instance, DestroyDebugReportCallbackEXT)
@@ -407,6 +412,9 @@ bool vk::initVulkanDevice(VkDevice device)
     VULKAN_GET_DEVICE_POINTER(device, CmdEndRenderPass)
     VULKAN_GET_DEVICE_POINTER(device, CmdExecuteCommands)
 
+    // Extension functions, these are null if the extension is not enabled.
+    VULKAN_GET_DEVICE_POINTER(device, CmdDrawIndexedIndirectCountKHR)
+
     return true;
 }
 
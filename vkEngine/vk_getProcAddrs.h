@@ -154,6 +154,7 @@ public:
 	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(GetDeviceProcAddr)
 
 	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(GetPhysicalDeviceFeatures)
+	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(GetPhysicalDeviceFeatures2KHR)
 	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(GetPhysicalDeviceFormatProperties)
 	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(GetPhysicalDeviceImageFormatProperties)
 	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(GetPhysicalDeviceProperties)
@@ -285,6 +286,7 @@ public:
 	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(CmdNextSubpass)
 	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(CmdEndRenderPass)
 	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(CmdExecuteCommands)
+	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(CmdDrawIndexedIndirectCountKHR)
 
 	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(CreateDebugReportCallbackEXT)
 	PVR_VULKAN_FUNCTION_POINTER_DECLARATION(DebugReportMessageEXT)